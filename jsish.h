@@ -6,16 +6,32 @@
  *
  * You can prevent inclusion of standard library headers by defining
  * JSISH_NO_STDLIB before including this header. In that case, you will need to
- * also define JSISH_STRTOD so it is an alias for an implementation of the
- * stdlib strtod() function, JSISH_SPRINTF as an alias for the sprintf()
- * function, JSISH_STRLEN as an alias for strlen(), JSISH_STRCMP for strcmp(),
- * and JSISH_FLOAT_DIGITS(V) so that when it's invoked as a function it returns
- * the number of digits required * to serialize the double precision floating
- * point number V.
+ * also define JSISH_STRLEN as an alias for the strlen() function,
+ * JSISH_STRCMP for strcmp(), JSISH_MEMCPY for memcpy() and JSISH_MEMCHR for
+ * memchr().
  *
- * You can also define either of the above without defining JSISH_NO_STDLIB, in
+ * You can also define any of the above without defining JSISH_NO_STDLIB, in
  * which case they will override the default versions.
  *
+ * Numbers are parsed and formatted by the library itself, independently of the
+ * C locale. Parsing always rounds correctly, and the encoder writes the
+ * shortest digits that read back as the same double.
+ *
+ * The decoder scans strings and whitespace with SSE2, AVX2 or NEON
+ * instructions when the compiler targets them. Define JSISH_NO_SIMD to use the
+ * plain scalar loops instead.
+ *
+ * Define JSISH_COMPACT to store values in 16 bytes rather than 32 on 64-bit
+ * targets, see jsish_value_t.
+ *
+ * Define JSISH_THREADS to get jsish_batch_decode_parallel() and
+ * jsish_split_decode_parallel(), which use POSIX threads, or Windows threads on
+ * Windows.
+ *
+ * Define JSISH_STATS to have decoders and the encoder keep statistics on the
+ * documents they handle, see jsish_stats_t. It must be defined the same way
+ * wherever this header is included, as it adds to jsish_decoder_t.
+ *
  * =====
  *
  * zlib License
@@ -41,8 +57,8 @@
 #ifndef __JSISH_H
 #define __JSISH_H
 
-#define JSISH_VERSION_MAJOR 1
-#define JSISH_VERSION_MINOR 2
+#define JSISH_VERSION_MAJOR 2
+#define JSISH_VERSION_MINOR 0
 #define JSISH_VERSION_PATCH 0
 
 #ifdef __cplusplus
@@ -51,30 +67,59 @@ extern "C" {
 
 #ifndef JSISH_NO_STDLIB
 #include <stdlib.h>
-#include <stdio.h>
 #include <string.h>
-#ifndef JSISH_STRTOD
-#define JSISH_STRTOD strtod
-#endif
-#ifndef JSISH_SPRINTF
-#define JSISH_SPRINTF sprintf
-#endif
 #ifndef JSISH_STRLEN
 #define JSISH_STRLEN strlen
 #endif
 #ifndef JSISH_STRCMP
 #define JSISH_STRCMP strcmp
 #endif
+#ifndef JSISH_MEMCPY
+#define JSISH_MEMCPY memcpy
+#endif
+#ifndef JSISH_MEMCHR
+#define JSISH_MEMCHR memchr
 #endif
+#endif
+
+/* For offsetof(), used by JSISH_FIELD() and the like. It is a freestanding
+ * header, so it is included even with JSISH_NO_STDLIB. */
+#include <stddef.h>
 
 #ifndef NULL
 #define NULL 0
 #endif
 
+/* 64-bit integers, for JSISH_INTEGER values. */
+#if defined(_MSC_VER)
+typedef __int64 jsish_int_t;
+typedef unsigned __int64 _jsish_uint_t;
+#elif defined(__GNUC__)
+__extension__ typedef long long jsish_int_t;
+__extension__ typedef unsigned long long _jsish_uint_t;
+#else
+typedef long long jsish_int_t;
+typedef unsigned long long _jsish_uint_t;
+#endif
+
 typedef enum {
 	JSISH_OK = 0,
 	JSISH_ERR_MALFORMED,
-	JSISH_ERR_MEM_OVERFLOW
+	JSISH_ERR_MEM_OVERFLOW,
+	/* Returned by jsish_decode_feed() while the document is still open. */
+	JSISH_INCOMPLETE,
+	/* The output callback of jsish_encode_to() reported a failure. */
+	JSISH_ERR_WRITE,
+	/* A cursor has no such member or element, see jsish_cursor_find(). */
+	JSISH_NOT_FOUND,
+	/* Arrays and objects are nested deeper than allowed, see JSISH_MAX_DEPTH.
+	 */
+	JSISH_ERR_DEPTH,
+	/* An event callback of jsish_parse() returned JSISH_STOP. */
+	JSISH_STOPPED,
+	/* A value does not fit the struct field it is decoded into, see
+	 * jsish_struct_decode(). */
+	JSISH_ERR_TYPE
 } jsish_result_t;
 
 typedef enum {
@@ -83,7 +128,15 @@ typedef enum {
 	JSISH_BOOL,
 	JSISH_STRING,
 	JSISH_ARRAY,
-	JSISH_KEYVAL
+	JSISH_KEYVAL,
+	/* A key-value pair within an object. */
+	JSISH_PAIR,
+	/* Only produced with the JSISH_INTEGERS flag. */
+	JSISH_INTEGER,
+	/* A decoded string that still contains escape sequences from the source.
+	 * JSISH_IS_STRING() holds for it too, and the encoder writes the escapes
+	 * back as they are. */
+	JSISH_RAW_STRING
 } jsish_type_t;
 
 struct jsish_value;
@@ -99,17 +152,81 @@ typedef struct {
 	struct jsish_value* next;
 } jsish_keyval_t;
 
+typedef struct {
+	/* Use JSISH_OBJECT_SIZE(), as flags are kept in the upper bits. */
+	unsigned int size;
+	/* The key-value pairs, stored one after another, each followed by its key
+	 * and value. NULL if the object is empty. */
+	struct jsish_value* pairs;
+	/* Hash table for key lookups, or NULL, see JSISH_INDEX_KEYS. */
+	struct jsish_value* index;
+} jsish_object_t;
+
+#ifdef JSISH_COMPACT
+/* The compact layout, 16 bytes on 64-bit targets rather than 32. The members
+ * of an object are stored like the elements of an array, each key followed by
+ * its value, so that an object takes two values per member rather than three.
+ * Keys are string values; instead of a JSISH_PAIR, a key is the pair as far
+ * as the JSISH_KV_*() macros are concerned. Use the macros to get at arrays
+ * and objects. */
+typedef struct jsish_value {
+	jsish_type_t type;
+	/* Number of elements of an array or members of an object, or for a key,
+	 * the number of members after it. */
+	unsigned int size;
+	union {
+		double vnum;
+		jsish_int_t vint;
+		char vbool;
+		const char* vstr;
+		struct jsish_value* varr;
+		struct jsish_value* vmap;
+	} data;
+} jsish_value_t;
+#else
 typedef struct jsish_value {
 	jsish_type_t type;
 	union {
 		double vnum;
+		jsish_int_t vint;
 		char vbool;
 		const char* vstr; 
 		jsish_array_t varr;
 		/* An object is just a list of key-value pairs. */
+		jsish_object_t vmap;
 		jsish_keyval_t vobj;
 	} data;
 } jsish_value_t;
+#endif
+
+/* Allocator hooks for the decoder, see jsish_decoder_t. jsish_allocate_t
+ * returns a block of at least bytes bytes, aligned for a jsish_value_t, or
+ * NULL if there is no more memory. */
+typedef void* (*jsish_allocate_t)(void* user, unsigned int bytes);
+typedef void (*jsish_deallocate_t)(void* user, void* block);
+
+/* What a decode or encode came across, kept with JSISH_STATS, see
+ * JSISH_END_PHASE. Each decode starts the decoder's over, except that the
+ * chunks of an incremental decode add up. */
+typedef struct jsish_stats {
+	/* Values by type. Object members count as one JSISH_PAIR each, whatever
+	 * the layout, and their keys are not counted as strings. */
+	unsigned int values[JSISH_RAW_STRING + 1];
+	/* Most values the decoder's stack took up at once, which needs room in
+	 * the values memory besides the tree itself. Always 0 when encoding. */
+	unsigned int peak_stack;
+	/* Deepest nesting of arrays and objects. */
+	unsigned int max_depth;
+	/* Longest string or key, in bytes as written in the source, or as stored
+	 * when encoding. */
+	unsigned int longest_string;
+	/* Bytes of source decoded up to where decoding stopped, which is the end
+	 * of the root value, or bytes of output written when encoding, without the
+	 * zero terminator. */
+	unsigned int bytes;
+	/* Escape sequences read or written. */
+	unsigned int escapes;
+} jsish_stats_t;
 
 typedef struct {
 	jsish_value_t* values;
@@ -119,10 +236,338 @@ typedef struct {
 
 	jsish_value_t root;
 
+	/* Decoding options, see JSISH_INDEX_KEYS. */
+	unsigned int flags;
+
+	/* Deepest nesting of arrays and objects to accept before failing with
+	 * JSISH_ERR_DEPTH, JSISH_MAX_DEPTH unless changed, or 0 for no limit. */
+	unsigned int max_depth;
+
+	/* Where to get more values once they run out, or NULL to fail with
+	 * JSISH_ERR_MEM_OVERFLOW instead. Each block allocated is at least twice
+	 * the size of the one before, and decoding carries on in it without
+	 * starting over. Values stay where they were decoded, so the tree spans
+	 * all blocks until jsish_free_blocks() hands them to deallocate. */
+	jsish_allocate_t allocate;
+	jsish_deallocate_t deallocate;
+	void* user;
+	/* The last block allocated, linked to the ones before. */
+	jsish_value_t* blocks;
+
 	char* source;
 	unsigned int cursor;
+
+	/* Incremental decoding state, see jsish_decode_feed(). */
+	unsigned int source_size;
+	unsigned int source_length;
+	unsigned int frame;
+	unsigned int depth;
+	unsigned int state;
+	unsigned int resume;
+	int final;
+
+	/* Two-stage decoding state, see jsish_decode_indexed(). */
+	unsigned int* structurals;
+	unsigned int structurals_size;
+	unsigned int structurals_count;
+	unsigned int structural;
+	unsigned int indexed;
+	_jsish_uint_t index_carry[3];
+
+	/* Set while decoding from a cursor, see _jsish_decode_string(). */
+	int revisit;
+
+#ifdef JSISH_STATS
+	/* Statistics of the last decode, see jsish_stats_t. */
+	jsish_stats_t stats;
+#endif
 } jsish_decoder_t;
 
+/* A position in a JSON document for on-demand access, see jsish_cursor_init().
+ */
+typedef struct {
+	char* source;
+	unsigned int length;
+	/* Where the value starts and, for a member of an object, its key. */
+	unsigned int position;
+	unsigned int key;
+} jsish_cursor_t;
+
+/* A segment of a compiled set of paths, see jsish_path_compile(). The segments
+ * form a tree where paths with a common prefix share nodes, linked by node
+ * numbers; node 0 is the root of the document and ends no other list. */
+typedef struct {
+	/* The segment as written in the path, with ~0 and ~1 escapes. */
+	const char* segment;
+	unsigned int length;
+	/* Hash of the unescaped segment, the same as that of JSISH_INDEX_KEYS. */
+	unsigned int hash;
+	/* Array index named by the segment, JSISH_PATH_ANY or JSISH_PATH_NONE. */
+	unsigned int index;
+	unsigned int child;
+	unsigned int sibling;
+	/* Number of the path ending here, or JSISH_PATH_NONE. */
+	unsigned int path;
+} jsish_path_node_t;
+
+#define JSISH_PATH_NONE 0xFFFFFFFFu
+#define JSISH_PATH_ANY 0xFFFFFFFEu
+
+typedef struct {
+	jsish_path_node_t* nodes;
+	unsigned int nodes_count;
+	/* Number of distinct paths, and whether any of them has a wildcard. */
+	unsigned int targets;
+	int wildcards;
+} jsish_path_t;
+
+typedef struct {
+	unsigned int path;
+	jsish_value_t* value;
+} jsish_match_t;
+
+/* A line of newline-delimited JSON, see jsish_batch_init(). */
+typedef struct {
+	unsigned int offset;
+	unsigned int length;
+	jsish_result_t result;
+	jsish_value_t root;
+} jsish_record_t;
+
+#ifndef JSISH_MAX_WORKERS
+#define JSISH_MAX_WORKERS 64
+#endif
+
+typedef struct {
+	char* source;
+	unsigned int source_length;
+	jsish_record_t* records;
+	unsigned int records_count;
+	jsish_value_t* values;
+	unsigned int values_size;
+	unsigned int workers;
+	/* Decoding options for every record, see JSISH_INDEX_KEYS. */
+	unsigned int flags;
+	/* Values used so far in the slice of each part. */
+	unsigned int used[JSISH_MAX_WORKERS];
+} jsish_batch_t;
+
+/* A run of elements of a large array, see jsish_split_init(). */
+typedef struct {
+	/* Position and index of the first element, and of the first one that no
+	 * other part can read while decoding. */
+	unsigned int start;
+	unsigned int first;
+	unsigned int own_start;
+	unsigned int own_first;
+	/* Values used so far in the slice of the part. */
+	unsigned int used;
+	jsish_result_t result;
+} jsish_part_t;
+
+typedef struct {
+	char* source;
+	unsigned int source_length;
+	jsish_value_t* values;
+	unsigned int values_size;
+	unsigned int workers;
+	/* Decoding options, see JSISH_INDEX_KEYS. */
+	unsigned int flags;
+	jsish_value_t root;
+	/* The last part only marks the closing bracket and the element count. */
+	jsish_part_t parts[JSISH_MAX_WORKERS + 1];
+} jsish_split_t;
+
+/* Event callbacks for jsish_parse(), each passed the user pointer given to it.
+ * Any of them can be NULL to ignore those events. Strings and keys are
+ * zero-terminated in the source, and raw is nonzero for those that would be
+ * decoded as JSISH_RAW_STRING. Numbers go to on_integer rather than on_number
+ * where they would be decoded as JSISH_INTEGER. Each returns JSISH_CONTINUE,
+ * JSISH_SKIP or JSISH_STOP. */
+typedef struct {
+	int (*on_null)(void* user);
+	int (*on_bool)(void* user, int value);
+	int (*on_number)(void* user, double value);
+	int (*on_integer)(void* user, jsish_int_t value);
+	int (*on_string)(void* user, const char* value, int raw);
+	int (*on_key)(void* user, const char* key, int raw);
+	int (*on_array_begin)(void* user);
+	int (*on_array_end)(void* user);
+	int (*on_object_begin)(void* user);
+	int (*on_object_end)(void* user);
+} jsish_events_t;
+
+/* Return values of jsish_events_t callbacks. JSISH_SKIP passes over the array
+ * or object just begun, with no end event, or over the value of the key just
+ * reported, and is the same as JSISH_CONTINUE anywhere else. JSISH_STOP makes
+ * jsish_parse() return JSISH_STOPPED right away. */
+#define JSISH_CONTINUE 0
+#define JSISH_SKIP 1
+#define JSISH_STOP 2
+
+/* Types of the struct fields that jsish_struct_decode() fills in, with the C
+ * type each is stored as. */
+typedef enum {
+	/* int, from true or false. */
+	JSISH_FIELD_BOOL,
+	/* int, from a number with an integral value in its range. */
+	JSISH_FIELD_INT,
+	/* jsish_int_t, from a number with an integral value in its range. */
+	JSISH_FIELD_INTEGER,
+	/* double, from any number. */
+	JSISH_FIELD_NUMBER,
+	/* char*, pointing to the unescaped string in the source, or NULL for
+	 * null. */
+	JSISH_FIELD_STRING,
+	/* A struct, from an object, described by its own fields. */
+	JSISH_FIELD_OBJECT,
+	/* A C array, from an array, with its length stored next to it. */
+	JSISH_FIELD_ARRAY
+} jsish_field_type_t;
+
+/* Describes a field of a struct and the member of an object that it is decoded
+ * from. Tables of them are best written with the JSISH_FIELD() macros, and
+ * must be prepared with jsish_struct_compile() before use. */
+typedef struct jsish_field {
+	/* Key of the member, as written in the source after unescaping. */
+	const char* name;
+	jsish_field_type_t type;
+	/* Where the field is within its struct, from offsetof(). */
+	unsigned int offset;
+	/* For JSISH_FIELD_OBJECT, the fields of the struct and their number. For
+	 * JSISH_FIELD_ARRAY, a single field describing each element, with an
+	 * offset within the element, usually 0. */
+	struct jsish_field* fields;
+	unsigned int fields_count;
+	/* For JSISH_FIELD_ARRAY, how many elements the array has room for, the
+	 * distance between them in bytes, and where the unsigned int that is set
+	 * to the number of elements decoded is within the same struct. */
+	unsigned int capacity;
+	unsigned int stride;
+	unsigned int count_offset;
+	/* Hash of name, set by jsish_struct_compile(). */
+	unsigned int hash;
+} jsish_field_t;
+
+/* A field of TYPE stored in MEMBER of STRUCT, for any type but
+ * JSISH_FIELD_OBJECT and JSISH_FIELD_ARRAY. */
+#define JSISH_FIELD(NAME, TYPE, STRUCT, MEMBER) \
+	{ NAME, TYPE, offsetof(STRUCT, MEMBER), NULL, 0, 0, 0, 0, 0 }
+
+/* A struct stored in MEMBER of STRUCT, whose fields are in the array FIELDS. */
+#define JSISH_OBJECT_FIELD(NAME, STRUCT, MEMBER, FIELDS) \
+	{ NAME, JSISH_FIELD_OBJECT, offsetof(STRUCT, MEMBER), FIELDS, \
+		sizeof(FIELDS) / sizeof(FIELDS[0]), 0, 0, 0, 0 }
+
+/* A C array declared as MEMBER of STRUCT, whose elements are described by the
+ * field ELEMENT, with the number of them in the unsigned int COUNT. */
+#define JSISH_ARRAY_FIELD(NAME, STRUCT, MEMBER, COUNT, ELEMENT) \
+	{ NAME, JSISH_FIELD_ARRAY, offsetof(STRUCT, MEMBER), &(ELEMENT), 1, \
+		sizeof(((STRUCT*) 0)->MEMBER) / sizeof(((STRUCT*) 0)->MEMBER[0]), \
+		sizeof(((STRUCT*) 0)->MEMBER[0]), offsetof(STRUCT, COUNT), 0 }
+
+/* Elements of an array field: of TYPE, or structs with the fields FIELDS. */
+#define JSISH_ELEMENT(TYPE) { NULL, TYPE, 0, NULL, 0, 0, 0, 0, 0 }
+#define JSISH_OBJECT_ELEMENT(FIELDS) \
+	{ NULL, JSISH_FIELD_OBJECT, 0, FIELDS, \
+		sizeof(FIELDS) / sizeof(FIELDS[0]), 0, 0, 0, 0 }
+
+/* Deepest nesting of objects and arrays within the fields given to
+ * jsish_struct_compile(), where the top struct counts as one level. Each
+ * level takes 32 bytes of C stack on 64-bit targets while decoding. */
+#ifndef JSISH_MAX_STRUCT_DEPTH
+#define JSISH_MAX_STRUCT_DEPTH 32
+#endif
+
+/* Decoder flags */
+
+/* Build a hash table for each object with at least JSISH_INDEX_MIN_KEYS keys,
+ * making jsish_get_property() a constant time operation on it. The table is
+ * stored in the values memory, using 8 bytes per slot at a load factor of at
+ * most 50%. */
+#define JSISH_INDEX_KEYS 1
+
+#ifndef JSISH_INDEX_MIN_KEYS
+#define JSISH_INDEX_MIN_KEYS 8
+#endif
+
+/* Decode numbers without fraction or exponent that fit in a jsish_int_t as
+ * JSISH_INTEGER values, so IDs and counters beyond 2^53 stay exact. */
+#define JSISH_INTEGERS 2
+
+/* Sort the members of each object by key, in JSISH_STRCMP() order, so that
+ * jsish_get_property() can do a binary search. Members with equal keys keep
+ * their order. */
+#define JSISH_SORT_KEYS 4
+
+/* Rewrite escape sequences in decoded strings as the characters they stand
+ * for, in place in the source, so that they come out as JSISH_STRING rather
+ * than JSISH_RAW_STRING. Strings containing \u0000 or an unpaired surrogate
+ * are left escaped, as they have no zero-terminated UTF-8 form. */
+#define JSISH_UNESCAPE 8
+
+/* Reject strings that are not valid UTF-8 as JSISH_ERR_MALFORMED. */
+#define JSISH_VALIDATE_UTF8 16
+
+/* Copy decoded strings into the values memory, zero-terminated, rather than
+ * terminating them in the source, which is then never written to and no longer
+ * needed once decoded. Each string takes up its length plus one bytes, rounded
+ * up to whole values. */
+#define JSISH_COPY_STRINGS 32
+
+/* Have jsish_minify() write numbers the way the encoder does, as the shortest
+ * form that reads back the same, or as integers with JSISH_INTEGERS. */
+#define JSISH_NORMALIZE_NUMBERS 64
+
+/* Deepest nesting of arrays and objects that the decoder accepts by default,
+ * see jsish_decoder_t, and that jsish_measure(), jsish_minify() and
+ * jsish_parse() can handle. Those keep their place in each level on the C
+ * stack, 4 bytes per level, 1 for jsish_parse(), rather than recursing; the
+ * decoder keeps it in its values. Deeper input gives JSISH_ERR_DEPTH.
+ * jsish_measure_ex() and jsish_minify_ex() keep it where the caller says
+ * instead, with a limit of their own. */
+#ifndef JSISH_MAX_DEPTH
+#define JSISH_MAX_DEPTH 1024
+#endif
+
+/* Deepest nesting that jsish_encode() and jsish_encode_to() can handle. They
+ * keep a frame for each level on the C stack, 16 bytes on 64-bit targets, so
+ * this is kept small for threads with small stacks; deeper trees give
+ * JSISH_ERR_DEPTH, and jsish_encode_ex() and jsish_encode_to_ex() take the
+ * frames from the caller instead. */
+#ifndef JSISH_ENCODE_DEPTH
+#define JSISH_ENCODE_DEPTH 64
+#endif
+
+/* Phases of work that JSISH_BEGIN_PHASE and JSISH_END_PHASE are placed
+ * around. */
+typedef enum {
+	/* A call to jsish_decode(), jsish_decode_feed(), jsish_decode_finish(),
+	 * jsish_decode_indexed(), jsish_decode_const(), jsish_cursor_decode() or
+	 * jsish_parse(), including those made by jsish_batch_decode() and
+	 * jsish_struct_decode(). */
+	JSISH_PHASE_DECODE,
+	/* The first stage of two-stage decoding indexing the next part of the
+	 * source, several times within a decode for larger documents. */
+	JSISH_PHASE_INDEX,
+	/* A call to jsish_encode(), jsish_encode_to() or jsish_struct_encode(). */
+	JSISH_PHASE_ENCODE
+} jsish_phase_t;
+
+/* Hooks for timing and tracing, expanded at the beginning and end of each
+ * phase, with the jsish_phase_t, the jsish_result_t it ends with and a const
+ * jsish_stats_t* of what it has come across so far. The statistics are only
+ * kept with JSISH_STATS, and are a null pointer otherwise; they are the only
+ * way to get at them for the encoder. Both expand to nothing unless defined
+ * before including this header, and they may be expanded from the threads of
+ * jsish_batch_decode_parallel(). */
+#ifndef JSISH_BEGIN_PHASE
+#define JSISH_BEGIN_PHASE(PHASE)
+#endif
+#ifndef JSISH_END_PHASE
+#define JSISH_END_PHASE(PHASE, RESULT, STATS)
+#endif
+
 /* Public API */
 
 void jsish_init_decoder(
@@ -132,578 +577,6795 @@ void jsish_init_decoder(
 
 jsish_result_t jsish_decode(jsish_decoder_t* decoder, char* source);
 
+/* Works out the exact number of values that jsish_decode() will need for
+ * source, with the given decoder flags and a fresh decoder, and how deeply its
+ * arrays and objects nest, without decoding or modifying anything. This
+ * includes the room taken up on the stack by open arrays and objects. Returns
+ * JSISH_ERR_MALFORMED for whatever jsish_decode() would reject, or
+ * JSISH_ERR_DEPTH if the nesting is deeper than JSISH_MAX_DEPTH.
+ *
+ * jsish_measure_ex() instead keeps track of each level in OPEN, and returns
+ * JSISH_ERR_DEPTH for nesting deeper than OPEN_SIZE, which is the same limit
+ * as a max_depth of OPEN_SIZE for the decoder. A document of N bytes nests at
+ * most N deep, for a decoder without a limit. */
+jsish_result_t jsish_measure(
+		const char* source,
+		unsigned int flags,
+		unsigned int* values_needed,
+		unsigned int* max_depth);
+
+jsish_result_t jsish_measure_ex(
+		const char* source,
+		unsigned int flags,
+		unsigned int* values_needed,
+		unsigned int* max_depth,
+		unsigned int* open,
+		unsigned int open_size);
+
+/* Returns the blocks that the decoder got from its allocate hook to
+ * deallocate. Whatever was decoded into them is gone, and the decoder must be
+ * initialised again before it is used. */
+void jsish_free_blocks(jsish_decoder_t* decoder);
+
+/* Incremental decoding, for documents that arrive in chunks. Chunks passed to
+ * jsish_decode_feed() are appended to buffer, which must be large enough to hold
+ * the whole document plus a zero terminator, since decoded strings point into
+ * it. Reading straight into the buffer at decoder->source_length avoids the
+ * copy. Each call decodes as much as possible and returns JSISH_INCOMPLETE if
+ * the document is not yet complete; jsish_decode_finish() marks the end of the
+ * input. Once an error has been returned, decoding must be restarted. */
+void jsish_decode_begin(
+		jsish_decoder_t* decoder, char* buffer, unsigned int buffer_size);
+
+jsish_result_t jsish_decode_feed(
+		jsish_decoder_t* decoder, const char* chunk, unsigned int length);
+
+jsish_result_t jsish_decode_finish(jsish_decoder_t* decoder);
+
+/* Batch decoding of newline-delimited JSON (NDJSON, JSON Lines).
+ * jsish_batch_init() splits source into records at its line breaks, which
+ * cannot occur within JSON strings, skipping blank lines. The records are
+ * stored in input order; if there are more than records_size, their number is
+ * stored in batch->records_count and JSISH_ERR_MEM_OVERFLOW is returned before
+ * anything in source is changed. Otherwise the line breaks are replaced with
+ * zero terminators.
+ *
+ * The records are then decoded in WORKERS parts of about the same number of
+ * bytes, each using an equal slice of VALUES; there can be at most
+ * JSISH_MAX_WORKERS parts. jsish_batch_decode() decodes one part and can be
+ * called for all parts at once from different threads, such as those of an
+ * existing pool. Once all have returned, jsish_batch_finish() decodes the
+ * records at the start of each part that were left, since the vector scans of
+ * a neighbouring part may read them. The result and root of each record are
+ * stored in it, and the first error of the batch is returned.
+ *
+ * With JSISH_THREADS defined, jsish_batch_decode_parallel() does all of that,
+ * starting a thread for each part but the first, which it decodes itself. */
+jsish_result_t jsish_batch_init(
+		jsish_batch_t* batch,
+		char* source,
+		jsish_record_t* records,
+		unsigned int records_size,
+		jsish_value_t* values,
+		unsigned int values_size,
+		unsigned int workers);
+
+void jsish_batch_decode(jsish_batch_t* batch, unsigned int worker);
+
+jsish_result_t jsish_batch_finish(jsish_batch_t* batch);
+
+#ifdef JSISH_THREADS
+jsish_result_t jsish_batch_decode_parallel(jsish_batch_t* batch);
+#endif
+
+/* Parallel decoding of a single large array. jsish_split_init() goes over the
+ * elements of the array that source holds, without decoding or changing them,
+ * and divides them into WORKERS parts of about the same number of bytes. The
+ * first values of VALUES are set aside for the elements, so that they are
+ * contiguous in split->root, and the rest is divided into equal slices for the
+ * parts; JSISH_ERR_MEM_OVERFLOW is returned if that leaves too little.
+ *
+ * The parts are decoded like the parts of a batch: jsish_split_decode() once
+ * for each part, from any thread, then jsish_split_finish(), which returns the
+ * first error. split->root holds the array once that is JSISH_OK. With
+ * JSISH_THREADS defined, jsish_split_decode_parallel() does all of that. */
+jsish_result_t jsish_split_init(
+		jsish_split_t* split,
+		char* source,
+		jsish_value_t* values,
+		unsigned int values_size,
+		unsigned int workers);
+
+void jsish_split_decode(jsish_split_t* split, unsigned int worker);
+
+jsish_result_t jsish_split_finish(jsish_split_t* split);
+
+#ifdef JSISH_THREADS
+jsish_result_t jsish_split_decode_parallel(jsish_split_t* split);
+#endif
+
+/* Two-stage decoding, for large documents. A vectorized first stage records
+ * the position of every token, quotation mark and escape sequence of source in
+ * the structurals array, and the tree is built from those positions without
+ * going over whitespace and string contents again. The stages take turns, the
+ * first one refilling the array whenever the second has used it up, so it can
+ * be small; it must have more than 64 entries, and a few thousand work well.
+ */
+jsish_result_t jsish_decode_indexed(
+		jsish_decoder_t* decoder,
+		char* source,
+		unsigned int* structurals,
+		unsigned int structurals_size);
+
+/* Two-stage decoding of the LENGTH characters at source, which need not be
+ * terminated and are never written to, so that read-only memory such as a
+ * PROT_READ mapping can be decoded without a copy. Strings are copied into the
+ * values memory as with JSISH_COPY_STRINGS, so the source is not needed once
+ * decoded. */
+jsish_result_t jsish_decode_const(
+		jsish_decoder_t* decoder,
+		const char* source,
+		unsigned int length,
+		unsigned int* structurals,
+		unsigned int structurals_size);
+
+/* On-demand access. A cursor points at a value in the source text, and moving
+ * it to a member or element passes over everything in between with a quick
+ * scan that only balances brackets and quotation marks, without decoding it or
+ * using any values memory. Only what jsish_cursor_decode() is called on is
+ * decoded, into the values memory of the given decoder, which must have been
+ * initialized; it can be called any number of times with the same decoder.
+ * Values that are skipped are not validated beyond that scan. The root cursor
+ * has to be set up before anything is decoded, since decoding terminates
+ * strings in the source. */
+jsish_result_t jsish_cursor_init(jsish_cursor_t* cursor, char* source);
+
+jsish_type_t jsish_cursor_type(const jsish_cursor_t* cursor);
+
+/* Moves child to the first element of an array or member of an object, and on
+ * to the next one; JSISH_NOT_FOUND is returned when there are no more. */
+jsish_result_t
+jsish_cursor_first(const jsish_cursor_t* container, jsish_cursor_t* child);
+
+jsish_result_t jsish_cursor_next(jsish_cursor_t* child);
+
+/* The key of an object member that a cursor points at, terminated in place in
+ * the source like decoded strings are, or NULL if it is not a member. */
+const char* jsish_cursor_key(const jsish_cursor_t* cursor);
+
+jsish_result_t jsish_cursor_find(
+		const jsish_cursor_t* object, const char* key, jsish_cursor_t* value);
+
+jsish_result_t jsish_cursor_at(
+		const jsish_cursor_t* array, unsigned int index, jsish_cursor_t* element);
+
+jsish_result_t jsish_cursor_decode(
+		const jsish_cursor_t* cursor,
+		jsish_decoder_t* decoder,
+		jsish_value_t** value);
+
+/* Event-driven decoding, which reports each value in source to the callbacks
+ * in events, in document order, rather than building a tree. No values memory
+ * is used, and the arrays and objects open at once, at most JSISH_MAX_DEPTH,
+ * are kept track of on the C stack. Strings are terminated and unescaped in
+ * the source like jsish_decode() does, with the decoder flags given, of which
+ * only JSISH_INTEGERS, JSISH_UNESCAPE and JSISH_VALIDATE_UTF8 apply. What is
+ * skipped is not validated beyond the scan that on-demand access does. The
+ * callbacks may already have seen part of a document that turns out to be
+ * malformed. */
+jsish_result_t jsish_parse(
+		char* source,
+		unsigned int flags,
+		const jsish_events_t* events,
+		void* user);
+
+/* An array or object being encoded, see jsish_encode_ex(). */
+typedef struct {
+	const struct jsish_value* next;
+	const struct jsish_value* end;
+} jsish_encode_frame_t;
+
+/* Encodes value into buffer, see the README. Arrays and objects nested deeper
+ * than JSISH_ENCODE_DEPTH give JSISH_ERR_DEPTH.
+ *
+ * jsish_encode_ex() instead keeps track of each level in FRAMES, and returns
+ * JSISH_ERR_DEPTH for nesting deeper than FRAMES_SIZE. That encodes whatever a
+ * decoder with a max_depth of FRAMES_SIZE accepts, and a tree of N values
+ * nests at most N deep. The same goes for jsish_encode_to_ex(). */
 jsish_result_t jsish_encode(
 		const jsish_value_t* value,
 		char* buffer,
 		unsigned int buffer_size,
 		unsigned int* encoded_bytes);
 
+jsish_result_t jsish_encode_ex(
+		const jsish_value_t* value,
+		char* buffer,
+		unsigned int buffer_size,
+		unsigned int* encoded_bytes,
+		jsish_encode_frame_t* frames,
+		unsigned int frames_size);
+
+/* Output callback for jsish_encode_to(), handed each chunk of encoded data in
+ * order. Returns zero on success; any other value makes the encoder stop
+ * calling it and report JSISH_ERR_WRITE. */
+typedef int (*jsish_write_t)(void* user, const char* data, unsigned int length);
+
+/* Encodes value in a single pass, collecting the output in the scratch buffer
+ * and passing it to write whenever it fills up, and once more at the end. Runs
+ * longer than the scratch buffer, such as long strings, are passed on without
+ * being copied. No zero terminator is written. */
+jsish_result_t jsish_encode_to(
+		const jsish_value_t* value,
+		jsish_write_t write,
+		void* user,
+		char* scratch,
+		unsigned int scratch_size);
+
+jsish_result_t jsish_encode_to_ex(
+		const jsish_value_t* value,
+		jsish_write_t write,
+		void* user,
+		char* scratch,
+		unsigned int scratch_size,
+		jsish_encode_frame_t* frames,
+		unsigned int frames_size);
+
+/* Writes source without whitespace, in a single pass from text to text without
+ * decoding it, through write like jsish_encode_to() does. Everything between
+ * whitespace is copied as it is unless JSISH_NORMALIZE_NUMBERS is given, and
+ * with JSISH_SORT_KEYS the members of each object are put in order by key as
+ * the decoder would. That is what the encoder writes for the tree that
+ * jsish_decode() builds with the same flags, except for strings, which are
+ * kept as they are written in the source. Without JSISH_SORT_KEYS, scratch can
+ * be of any size. With it, the output of each outermost object is held back
+ * in scratch, which needs room for twice the output of the largest such object
+ * plus 24 bytes for each member within it, nested ones included, or else
+ * JSISH_ERR_MEM_OVERFLOW is returned. Source is checked like jsish_decode()
+ * does with the decoder flags given, and stays unmodified. Nothing is written
+ * for whatever follows the root value, and what was written before an error
+ * is returned should be discarded.
+ *
+ * jsish_minify_ex() keeps track of each level in OPEN rather than on the C
+ * stack, and returns JSISH_ERR_DEPTH for nesting deeper than OPEN_SIZE, like a
+ * decoder with that max_depth. */
+jsish_result_t jsish_minify(
+		const char* source,
+		unsigned int flags,
+		jsish_write_t write,
+		void* user,
+		char* scratch,
+		unsigned int scratch_size);
+
+jsish_result_t jsish_minify_ex(
+		const char* source,
+		unsigned int flags,
+		jsish_write_t write,
+		void* user,
+		char* scratch,
+		unsigned int scratch_size,
+		unsigned int* open,
+		unsigned int open_size);
+
+/* Schema-driven decoding, straight into structs without building a tree.
+ * jsish_struct_compile() checks a table of COUNT fields, and those nested in
+ * it, and stores the hash of each name in it. That only needs to be done once
+ * for each table, which can then be used from any number of threads.
+ *
+ * jsish_struct_decode() decodes source, which must be an object, into the
+ * struct at DATA in a single pass using jsish_parse(), with the decoder flags
+ * given, of which JSISH_VALIDATE_UTF8 applies; strings are always unescaped,
+ * and one that cannot be, as it contains \u0000 or an unpaired surrogate,
+ * gives JSISH_ERR_TYPE like any other value that does not fit its field. Keys
+ * are looked up by their hash, trying the field after the last one found
+ * first, so members in the same order as the fields take one comparison each.
+ * Members without a field are skipped, with no more validation than
+ * jsish_parse() gives skipped values, fields without a member and fields
+ * given null, other than strings, are left as they were, and where an object
+ * has the same key more than once, the last one counts. An array with more
+ * elements than its field has room for gives JSISH_ERR_MEM_OVERFLOW. The
+ * struct may already be partly filled in when an error is returned.
+ *
+ * jsish_struct_encode() writes the struct at DATA as an object with a member
+ * for every field, like jsish_encode() does. */
+jsish_result_t jsish_struct_compile(jsish_field_t* fields, unsigned int count);
+
+jsish_result_t jsish_struct_decode(
+		char* source,
+		unsigned int flags,
+		const jsish_field_t* fields,
+		unsigned int fields_count,
+		void* data);
+
+jsish_result_t jsish_struct_encode(
+		const void* data,
+		const jsish_field_t* fields,
+		unsigned int fields_count,
+		char* buffer,
+		unsigned int buffer_size,
+		unsigned int* encoded_bytes);
+
 jsish_value_t* jsish_get_property(const jsish_value_t* value, const char* key);
 
+/* Makes OBJECT an object of SIZE members, for encoding a tree built by hand.
+ * MEMBERS holds the key of each member, a string value, followed by its value,
+ * and must have room for JSISH_OBJECT_VALUES(SIZE) values, as the members are
+ * spread out within it to the layout of a decoded object. */
+void jsish_init_object(
+		jsish_value_t* object, jsish_value_t* members, unsigned int size);
+
+/* Path queries. jsish_path_compile() turns COUNT JSON Pointers (RFC 6901),
+ * like "/events/0/user/id", into a tree of segments stored in NODES, which
+ * needs at most one node per segment plus one. A segment that is just "*" is a
+ * wildcard that matches every element of an array and every member of an
+ * object. A path listed more than once is only reported under the first.
+ *
+ * jsish_path_match() then finds all paths in a decoded tree and
+ * jsish_path_match_cursor() in source text, decoding only the matched values
+ * into the values memory of DECODER. Both visit each value at most once for
+ * all paths together, and stop as soon as every path has been found, unless
+ * there are wildcards. Each match is stored in MATCHES as the number of the
+ * path and the value; JSISH_ERR_MEM_OVERFLOW is returned if there are more
+ * than MATCHES_SIZE. Keys are compared as they are written in the source, like
+ * jsish_get_property() does, and where an object has the same key more than
+ * once, only the first counts. */
+jsish_result_t jsish_path_compile(
+		jsish_path_t* query,
+		const char* const* paths,
+		unsigned int count,
+		jsish_path_node_t* nodes,
+		unsigned int nodes_size);
+
+jsish_result_t jsish_path_match(
+		const jsish_path_t* query,
+		const jsish_value_t* value,
+		jsish_match_t* matches,
+		unsigned int matches_size,
+		unsigned int* match_count);
+
+jsish_result_t jsish_path_match_cursor(
+		const jsish_path_t* query,
+		const jsish_cursor_t* cursor,
+		jsish_decoder_t* decoder,
+		jsish_match_t* matches,
+		unsigned int matches_size,
+		unsigned int* match_count);
+
+/* Snapshots, for loading a decoded tree again without parsing it.
+ * jsish_snapshot_write() copies the tree under value, with its strings, into
+ * buffer, which must be aligned for a jsish_value_t, as one self-contained
+ * block where pointers are stored as offsets, and sets snapshot_size to the
+ * bytes used. jsish_snapshot_open() turns the offsets into pointers again in
+ * place, for wherever the snapshot is now, after which root can be used like
+ * any decoded tree. Opening it again at the same address writes nothing. A
+ * snapshot can only be opened by a build with the same value layout, and
+ * should be trusted, as little more than its header is checked. */
+jsish_result_t jsish_snapshot_write(
+		const jsish_value_t* value,
+		void* buffer,
+		unsigned int buffer_size,
+		unsigned int* snapshot_size);
+
+jsish_result_t jsish_snapshot_open(
+		void* snapshot,
+		unsigned int snapshot_size,
+		jsish_value_t** root);
+
 #define JSISH_IS_NUMBER(VALUE) ((VALUE)->type == JSISH_NUMBER)
+#define JSISH_IS_INTEGER(VALUE) ((VALUE)->type == JSISH_INTEGER)
 #define JSISH_IS_BOOL(VALUE) ((VALUE)->type == JSISH_BOOL)
-#define JSISH_IS_STRING(VALUE) ((VALUE)->type == JSISH_STRING)
+#define JSISH_IS_STRING(VALUE) \
+	((VALUE)->type == JSISH_STRING || (VALUE)->type == JSISH_RAW_STRING)
 #define JSISH_IS_NULL(VALUE) ((VALUE)->type == JSISH_NULL)
 #define JSISH_IS_ARRAY(VALUE) ((VALUE)->type == JSISH_ARRAY)
 #define JSISH_IS_KEYVAL(VALUE) ((VALUE)->type == JSISH_KEYVAL)
 
 #define JSISH_GET_NUMBER(VALUE) ((VALUE)->data.vnum)
+#define JSISH_GET_INTEGER(VALUE) ((VALUE)->data.vint)
 #define JSISH_GET_BOOL(VALUE) ((VALUE)->data.vbool)
 #define JSISH_GET_STRING(VALUE) ((VALUE)->data.vstr)
 
+/* Set in the size of an object that has a hash table following its last
+ * member (only in the compact layout), or whose members are sorted. */
+#define _JSISH_INDEXED 0x80000000u
+#define _JSISH_SORTED 0x40000000u
+
+#ifdef JSISH_COMPACT
+#define JSISH_ARRAY_INDEX(VALUE, INDEX) &((VALUE)->data.varr[INDEX])
+#define JSISH_ARRAY_SIZE(VALUE) ((VALUE)->size)
+
+#define JSISH_OBJECT_SIZE(VALUE) \
+	((VALUE)->size & ~(_JSISH_INDEXED | _JSISH_SORTED))
+#define JSISH_OBJECT_VALUES(SIZE) ((SIZE) * 2)
+#else
 #define JSISH_ARRAY_INDEX(VALUE, INDEX) &((VALUE)->data.varr.data[INDEX])
 #define JSISH_ARRAY_SIZE(VALUE) ((VALUE)->data.varr.size)
 
-#define JSISH_KV_KEY(VALUE) ((VALUE)->data.vobj.key->data.vstr)
-#define JSISH_KV_VALUE(VALUE) ((VALUE)->data.vobj.value)
-#define JSISH_KV_NEXT(VALUE) ((VALUE)->data.vobj.next)
+#define JSISH_OBJECT_SIZE(VALUE) \
+	((VALUE)->data.vmap.size & ~(_JSISH_INDEXED | _JSISH_SORTED))
+#define JSISH_OBJECT_VALUES(SIZE) ((SIZE) * 3)
+#endif
+
+/* Iteration over the key-value pairs of an object. JSISH_KV_FIRST() returns
+ * the first pair, or NULL if the object is empty, and JSISH_KV_INDEX() the
+ * pair at an index below JSISH_OBJECT_SIZE(). The other macros accept either a
+ * pair or a non-empty object, in which case its first pair is used. */
+#ifdef JSISH_COMPACT
+#define JSISH_KV_INDEX(VALUE, INDEX) (&(VALUE)->data.vmap[(INDEX) * 2])
+#define JSISH_KV_FIRST(VALUE) ((VALUE)->data.vmap)
+#define JSISH_KV_PAIR(VALUE) \
+	((VALUE)->type == JSISH_KEYVAL ? (VALUE)->data.vmap : (VALUE))
+#define JSISH_KV_KEY(VALUE) (JSISH_KV_PAIR(VALUE)->data.vstr)
+#define JSISH_KV_VALUE(VALUE) ((jsish_value_t*) JSISH_KV_PAIR(VALUE) + 1)
+#define JSISH_KV_NEXT(VALUE) (JSISH_KV_PAIR(VALUE)->size \
+	? (jsish_value_t*) JSISH_KV_PAIR(VALUE) + 2 : NULL)
+#else
+#define JSISH_KV_INDEX(VALUE, INDEX) (&(VALUE)->data.vmap.pairs[(INDEX) * 3])
+#define JSISH_KV_FIRST(VALUE) ((VALUE)->data.vmap.pairs)
+#define JSISH_KV_PAIR(VALUE) \
+	((VALUE)->type == JSISH_KEYVAL ? (VALUE)->data.vmap.pairs : (VALUE))
+#define JSISH_KV_KEY(VALUE) (JSISH_KV_PAIR(VALUE)->data.vobj.key->data.vstr)
+#define JSISH_KV_VALUE(VALUE) (JSISH_KV_PAIR(VALUE)->data.vobj.value)
+#define JSISH_KV_NEXT(VALUE) (JSISH_KV_PAIR(VALUE)->data.vobj.next)
+#endif
 
 /* Function definitions below this line. */
 
 #ifdef JSISH_MAIN
 
-#ifndef JSISH_FLOAT_DIGITS
-#if __STDC_VERSION__ >= 199901L
-#define JSISH_FLOAT_DIGITS(V) snprintf(NULL, 0, "%g", (V))
-#else
-unsigned int _jsish_float_digits(double v) {
-	static char buffer[1024];
-	return JSISH_SPRINTF(buffer, "%g", v);
-}
-#define JSISH_FLOAT_DIGITS(V) _jsish_float_digits((V))
+/* Vectorized scanning kernels. The widest instruction set enabled at compile
+ * time is used; define JSISH_NO_SIMD to always use the scalar loops. Blocks are
+ * loaded from aligned addresses only, so a scan never reads across a page
+ * boundary past the terminating zero of the source. */
+#ifndef JSISH_NO_SIMD
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define JSISH_SIMD_AVX2
+#define JSISH_SIMD_WIDTH 32
+#elif defined(__SSE2__) || defined(_M_X64) \
+		|| (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define JSISH_SIMD_SSE2
+#define JSISH_SIMD_WIDTH 16
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define JSISH_SIMD_NEON
+#define JSISH_SIMD_WIDTH 16
 #endif
 #endif
 
-void jsish_init_decoder(
-		jsish_decoder_t* decoder,
-		jsish_value_t* values,
-		unsigned int values_size) {
-	decoder->values = values;
-	decoder->values_size = values_size;
-	decoder->values_cursor = 0;
-	decoder->stack_cursor = values_size - 1;
-	decoder->source = NULL;
-	decoder->cursor = 0;
+#ifdef JSISH_SIMD_WIDTH
+/* The kernels may read past the end of a string within its aligned block. That
+ * can never fault, but AddressSanitizer would report it. */
+#if defined(__SANITIZE_ADDRESS__)
+#define _JSISH_NO_ASAN __attribute__((no_sanitize_address))
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define _JSISH_NO_ASAN __attribute__((no_sanitize_address))
+#endif
+#endif
+#ifndef _JSISH_NO_ASAN
+#define _JSISH_NO_ASAN
+#endif
+
+/* Offset of a pointer from the previous JSISH_SIMD_WIDTH boundary. */
+#define _JSISH_SIMD_MISALIGNMENT(P) \
+	((unsigned int) ((size_t) (P) & (JSISH_SIMD_WIDTH - 1)))
+
+unsigned int _jsish_first_bit(unsigned int mask) {
+#if defined(__GNUC__) || defined(__clang__)
+	return (unsigned int) __builtin_ctz(mask);
+#else
+	unsigned int i;
+	for (i = 0; !(mask & 1); ++i) {
+		mask >>= 1;
+	}
+	return i;
+#endif
 }
 
-int _jsish_is_whitespace(char c) {
-	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+#if defined(JSISH_SIMD_AVX2)
+
+/* Bit mask of the bytes in the aligned block at P that may end a string: '"',
+ * '\\' and control characters (including the zero terminator). */
+_JSISH_NO_ASAN unsigned int _jsish_string_stop_mask(const char* p) {
+	__m256i v;
+	__m256i stops;
+	v = _mm256_load_si256((const __m256i*) p);
+	stops = _mm256_or_si256(
+			_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')),
+			_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
+	stops = _mm256_or_si256(stops, _mm256_cmpeq_epi8(
+			_mm256_min_epu8(v, _mm256_set1_epi8(0x1f)), v));
+	return (unsigned int) _mm256_movemask_epi8(stops);
 }
 
-void _jsish_skip_whitespace(jsish_decoder_t* decoder) {
-	while (_jsish_is_whitespace(decoder->source[decoder->cursor])) {
-		decoder->cursor++;
-	}
+/* Bit mask of the bytes in the aligned block at P that are not whitespace. */
+_JSISH_NO_ASAN unsigned int _jsish_non_whitespace_mask(const char* p) {
+	__m256i v;
+	__m256i ws;
+	v = _mm256_load_si256((const __m256i*) p);
+	ws = _mm256_or_si256(
+			_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+			_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')));
+	ws = _mm256_or_si256(ws, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+	ws = _mm256_or_si256(ws, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')));
+	return ~(unsigned int) _mm256_movemask_epi8(ws);
 }
 
-jsish_value_t* _jsish_alloc_value(jsish_decoder_t* decoder) {
-	jsish_value_t* value;
-	if (decoder->values_cursor + 1 >= decoder->stack_cursor) {
-		return NULL;
-	}
+/* Bit mask of the bytes in the aligned block at P that are not ASCII. */
+_JSISH_NO_ASAN unsigned int _jsish_non_ascii_mask(const char* p) {
+	return (unsigned int) _mm256_movemask_epi8(
+			_mm256_load_si256((const __m256i*) p));
+}
 
-	value = &decoder->values[decoder->values_cursor++];
-	value->type = JSISH_NULL;
-	value->data.vobj.key = NULL;
-	value->data.vobj.value = NULL;
-	value->data.vobj.next = NULL;
+/* Masks of the quotation marks, backslashes, structural characters ({}[]:,),
+ * whitespace and line breaks among the bytes at P, which need not be aligned.
+ * '[' and ']' differ from '{' and '}' only in bit 5, so setting that bit
+ * matches both brackets with one comparison. */
+void _jsish_classify(const char* p, unsigned int* masks) {
+	__m256i v;
+	__m256i folded;
+	__m256i breaks;
+	v = _mm256_loadu_si256((const __m256i*) p);
+	folded = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+	masks[0] = (unsigned int) _mm256_movemask_epi8(
+			_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')));
+	masks[1] = (unsigned int) _mm256_movemask_epi8(
+			_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
+	masks[2] = (unsigned int) _mm256_movemask_epi8(_mm256_or_si256(
+			_mm256_or_si256(
+				_mm256_cmpeq_epi8(folded, _mm256_set1_epi8('{')),
+				_mm256_cmpeq_epi8(folded, _mm256_set1_epi8('}'))),
+			_mm256_or_si256(
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')),
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8(',')))));
+	breaks = _mm256_or_si256(
+			_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')),
+			_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')));
+	masks[3] = (unsigned int) _mm256_movemask_epi8(_mm256_or_si256(breaks,
+			_mm256_or_si256(
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')))));
+	masks[4] = (unsigned int) _mm256_movemask_epi8(breaks);
+}
 
-	return value;
+/* Masks of the quotation marks or zeros, backslashes, opening brackets and
+ * closing brackets among the bytes at P, which need not be aligned. */
+void _jsish_classify_brackets(const char* p, unsigned int* masks) {
+	__m256i v;
+	__m256i folded;
+	v = _mm256_loadu_si256((const __m256i*) p);
+	folded = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+	masks[0] = (unsigned int) _mm256_movemask_epi8(_mm256_or_si256(
+			_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')),
+			_mm256_cmpeq_epi8(v, _mm256_setzero_si256())));
+	masks[1] = (unsigned int) _mm256_movemask_epi8(
+			_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
+	masks[2] = (unsigned int) _mm256_movemask_epi8(
+			_mm256_cmpeq_epi8(folded, _mm256_set1_epi8('{')));
+	masks[3] = (unsigned int) _mm256_movemask_epi8(
+			_mm256_cmpeq_epi8(folded, _mm256_set1_epi8('}')));
 }
 
-jsish_value_t* _jsish_alloc_fifo(jsish_decoder_t* decoder) {
-	jsish_value_t* stack_val;
-	if (decoder->stack_cursor <= decoder->values_cursor + 1) {
-		return NULL;
-	}
+#elif defined(JSISH_SIMD_SSE2)
 
-	stack_val = &decoder->values[decoder->stack_cursor--];
-	stack_val->type = JSISH_NULL;
-	stack_val->data.vobj.key = NULL;
-	stack_val->data.vobj.value = NULL;
-	stack_val->data.vobj.next = NULL;
+_JSISH_NO_ASAN unsigned int _jsish_string_stop_mask(const char* p) {
+	__m128i v;
+	__m128i stops;
+	v = _mm_load_si128((const __m128i*) p);
+	stops = _mm_or_si128(
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+	stops = _mm_or_si128(stops, _mm_cmpeq_epi8(
+			_mm_min_epu8(v, _mm_set1_epi8(0x1f)), v));
+	return (unsigned int) _mm_movemask_epi8(stops);
+}
 
-	return stack_val;
+_JSISH_NO_ASAN unsigned int _jsish_non_whitespace_mask(const char* p) {
+	__m128i v;
+	__m128i ws;
+	v = _mm_load_si128((const __m128i*) p);
+	ws = _mm_or_si128(
+			_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+	ws = _mm_or_si128(ws, _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+	ws = _mm_or_si128(ws, _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+	return ~(unsigned int) _mm_movemask_epi8(ws) & 0xffff;
 }
 
-jsish_value_t* _jsish_fifo_copy(jsish_decoder_t* decoder, unsigned int index) {
-	jsish_value_t* value;
-	jsish_value_t* stack_val;
-	if (decoder->values_size - decoder->stack_cursor - 1 < index) {
-		return NULL;
-	}
+_JSISH_NO_ASAN unsigned int _jsish_non_ascii_mask(const char* p) {
+	return (unsigned int) _mm_movemask_epi8(
+			_mm_load_si128((const __m128i*) p));
+}
 
-	value = _jsish_alloc_value(decoder);
-	if (!value) {
-		return NULL;
-	}
-	stack_val = &decoder->values[decoder->values_size - index - 1];
-	value->type = stack_val->type;
-	value->data = stack_val->data;
+void _jsish_classify(const char* p, unsigned int* masks) {
+	__m128i v;
+	__m128i folded;
+	__m128i breaks;
+	v = _mm_loadu_si128((const __m128i*) p);
+	folded = _mm_or_si128(v, _mm_set1_epi8(0x20));
+	masks[0] = (unsigned int) _mm_movemask_epi8(
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+	masks[1] = (unsigned int) _mm_movemask_epi8(
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+	masks[2] = (unsigned int) _mm_movemask_epi8(_mm_or_si128(
+			_mm_or_si128(
+				_mm_cmpeq_epi8(folded, _mm_set1_epi8('{')),
+				_mm_cmpeq_epi8(folded, _mm_set1_epi8('}'))),
+			_mm_or_si128(
+				_mm_cmpeq_epi8(v, _mm_set1_epi8(':')),
+				_mm_cmpeq_epi8(v, _mm_set1_epi8(',')))));
+	breaks = _mm_or_si128(
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+	masks[3] = (unsigned int) _mm_movemask_epi8(_mm_or_si128(breaks,
+			_mm_or_si128(
+				_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+				_mm_cmpeq_epi8(v, _mm_set1_epi8('\t')))));
+	masks[4] = (unsigned int) _mm_movemask_epi8(breaks);
+}
 
-	return value;
+void _jsish_classify_brackets(const char* p, unsigned int* masks) {
+	__m128i v;
+	__m128i folded;
+	v = _mm_loadu_si128((const __m128i*) p);
+	folded = _mm_or_si128(v, _mm_set1_epi8(0x20));
+	masks[0] = (unsigned int) _mm_movemask_epi8(_mm_or_si128(
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+			_mm_cmpeq_epi8(v, _mm_setzero_si128())));
+	masks[1] = (unsigned int) _mm_movemask_epi8(
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+	masks[2] = (unsigned int) _mm_movemask_epi8(
+			_mm_cmpeq_epi8(folded, _mm_set1_epi8('{')));
+	masks[3] = (unsigned int) _mm_movemask_epi8(
+			_mm_cmpeq_epi8(folded, _mm_set1_epi8('}')));
 }
 
-int _jsish_is_hex_digit(char c) {
-	return (c >= '0' && c <= '9')
-		|| (c >= 'a' && c <= 'f')
-		|| (c >= 'A' && c <= 'F');
+#elif defined(JSISH_SIMD_NEON)
+
+/* NEON has no movemask instruction; narrow each byte of the comparison result
+ * to a single bit instead. */
+unsigned int _jsish_neon_mask(uint8x16_t cmp) {
+	static const unsigned char bits[16] = {
+		1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128
+	};
+	uint8x16_t masked;
+	masked = vandq_u8(cmp, vld1q_u8(bits));
+	return (unsigned int) vaddv_u8(vget_low_u8(masked))
+		| ((unsigned int) vaddv_u8(vget_high_u8(masked)) << 8);
 }
 
-jsish_result_t
-_jsish_decode_string(jsish_decoder_t* decoder, jsish_value_t* value) {
-	char c;
-	int i;
-	char* decoded; 
-	if (decoder->source[decoder->cursor] != '"') {
-		return JSISH_ERR_MALFORMED;
-	}
+_JSISH_NO_ASAN unsigned int _jsish_string_stop_mask(const char* p) {
+	uint8x16_t v;
+	uint8x16_t stops;
+	v = vld1q_u8((const unsigned char*) p);
+	stops = vorrq_u8(vceqq_u8(v, vdupq_n_u8('"')), vceqq_u8(v, vdupq_n_u8('\\')));
+	stops = vorrq_u8(stops, vcltq_u8(v, vdupq_n_u8(0x20)));
+	return _jsish_neon_mask(stops);
+}
 
-	decoded = &decoder->source[decoder->cursor + 1];
+_JSISH_NO_ASAN unsigned int _jsish_non_whitespace_mask(const char* p) {
+	uint8x16_t v;
+	uint8x16_t ws;
+	v = vld1q_u8((const unsigned char*) p);
+	ws = vorrq_u8(vceqq_u8(v, vdupq_n_u8(' ')), vceqq_u8(v, vdupq_n_u8('\t')));
+	ws = vorrq_u8(ws, vceqq_u8(v, vdupq_n_u8('\n')));
+	ws = vorrq_u8(ws, vceqq_u8(v, vdupq_n_u8('\r')));
+	return ~_jsish_neon_mask(ws) & 0xffff;
+}
 
-	while ((c = decoder->source[++decoder->cursor]) != '"') {
-		switch (c) {
-			case '\\':
-				/* Verify the backslash is followed by a valid escape code. */
-				c = decoder->source[++decoder->cursor];
-				switch (c) {
-					case '\\': case '/': case '"': case 'f': case 't': case 'n':
-					case 'r':
-						break;
-					case 'u':
-						/* \u needs to be followed by four hex digits. */
-						for (i = 0; i < 4; ++i) {
-							c = decoder->source[++decoder->cursor];
-							if (!_jsish_is_hex_digit(c)) {
-								return JSISH_ERR_MALFORMED;
-							}
-						}
-						break;
-					default:
-						return JSISH_ERR_MALFORMED;
-				}
-				break;
-			case '\0': case '\n': case '\r':
-				return JSISH_ERR_MALFORMED;
-			default:
-				break;
-		}
-	}
-
-	/* Replace the end quote with a zero terminator in the source, so the
-	 * decoded string can be referenced in situ. */
-	decoder->source[decoder->cursor++] = '\0';
-	value->type = JSISH_STRING;
-	value->data.vstr = decoded;
+_JSISH_NO_ASAN unsigned int _jsish_non_ascii_mask(const char* p) {
+	return _jsish_neon_mask(vcgeq_u8(
+			vld1q_u8((const unsigned char*) p), vdupq_n_u8(0x80)));
+}
 
-	_jsish_skip_whitespace(decoder);
+void _jsish_classify(const char* p, unsigned int* masks) {
+	uint8x16_t v;
+	uint8x16_t folded;
+	uint8x16_t breaks;
+	v = vld1q_u8((const unsigned char*) p);
+	folded = vorrq_u8(v, vdupq_n_u8(0x20));
+	masks[0] = _jsish_neon_mask(vceqq_u8(v, vdupq_n_u8('"')));
+	masks[1] = _jsish_neon_mask(vceqq_u8(v, vdupq_n_u8('\\')));
+	masks[2] = _jsish_neon_mask(vorrq_u8(
+			vorrq_u8(
+				vceqq_u8(folded, vdupq_n_u8('{')),
+				vceqq_u8(folded, vdupq_n_u8('}'))),
+			vorrq_u8(
+				vceqq_u8(v, vdupq_n_u8(':')),
+				vceqq_u8(v, vdupq_n_u8(',')))));
+	breaks = vorrq_u8(vceqq_u8(v, vdupq_n_u8('\n')), vceqq_u8(v, vdupq_n_u8('\r')));
+	masks[3] = _jsish_neon_mask(vorrq_u8(breaks, vorrq_u8(
+			vceqq_u8(v, vdupq_n_u8(' ')), vceqq_u8(v, vdupq_n_u8('\t')))));
+	masks[4] = _jsish_neon_mask(breaks);
+}
 
-	return JSISH_OK;
+void _jsish_classify_brackets(const char* p, unsigned int* masks) {
+	uint8x16_t v;
+	uint8x16_t folded;
+	v = vld1q_u8((const unsigned char*) p);
+	folded = vorrq_u8(v, vdupq_n_u8(0x20));
+	masks[0] = _jsish_neon_mask(
+			vorrq_u8(vceqq_u8(v, vdupq_n_u8('"')), vceqq_u8(v, vdupq_n_u8(0))));
+	masks[1] = _jsish_neon_mask(vceqq_u8(v, vdupq_n_u8('\\')));
+	masks[2] = _jsish_neon_mask(vceqq_u8(folded, vdupq_n_u8('{')));
+	masks[3] = _jsish_neon_mask(vceqq_u8(folded, vdupq_n_u8('}')));
 }
 
-jsish_result_t
-_jsish_decode_number(jsish_decoder_t* decoder, jsish_value_t* value) {
-	double num;
-	char* end;
-	num = JSISH_STRTOD(&decoder->source[decoder->cursor], &end);
+#endif
 
-	if (end == &decoder->source[decoder->cursor]) {
-		return JSISH_ERR_MALFORMED;
+/* Returns a pointer to the first '"', '\\' or control character at or after S.
+ */
+const char* _jsish_scan_string(const char* s) {
+	unsigned int offset;
+	unsigned int mask;
+	offset = _JSISH_SIMD_MISALIGNMENT(s);
+	s -= offset;
+	mask = _jsish_string_stop_mask(s) >> offset << offset;
+	while (!mask) {
+		s += JSISH_SIMD_WIDTH;
+		mask = _jsish_string_stop_mask(s);
 	}
+	return s + _jsish_first_bit(mask);
+}
 
-	value->type = JSISH_NUMBER;
-	value->data.vnum = num;
-	decoder->cursor += (unsigned int) (end - &decoder->source[decoder->cursor]);
-
-	_jsish_skip_whitespace(decoder);
-
-	return JSISH_OK;
+/* Returns a pointer to the first non-whitespace character at or after S. */
+const char* _jsish_scan_whitespace(const char* s) {
+	unsigned int offset;
+	unsigned int mask;
+	offset = _JSISH_SIMD_MISALIGNMENT(s);
+	s -= offset;
+	mask = _jsish_non_whitespace_mask(s) >> offset << offset;
+	while (!mask) {
+		s += JSISH_SIMD_WIDTH;
+		mask = _jsish_non_whitespace_mask(s);
+	}
+	return s + _jsish_first_bit(mask);
 }
 
-jsish_result_t
-_jsish_decode_bool(jsish_decoder_t* decoder, jsish_value_t* value) {
-	const char* s;
-	s = &decoder->source[decoder->cursor];
-	if (s[0] == 'f' 
-			&& s[1] == 'a'
-			&& s[2] == 'l'
-			&& s[3] == 's'
-			&& s[4] == 'e') {
-		value->data.vbool = 0;
-		decoder->cursor += 5;
-	} else if (s[0] == 't' && s[1] == 'r' && s[2] == 'u' && s[3] == 'e') {
-		value->data.vbool = 1;
-		decoder->cursor += 4;
-	} else {
-		return JSISH_ERR_MALFORMED;
+/* Returns a pointer to the first byte that is not ASCII at or after S, or END
+ * if there is none before it. */
+const char* _jsish_scan_ascii(const char* s, const char* end) {
+	unsigned int offset;
+	unsigned int mask;
+	offset = _JSISH_SIMD_MISALIGNMENT(s);
+	s -= offset;
+	mask = _jsish_non_ascii_mask(s) >> offset << offset;
+	while (!mask) {
+		s += JSISH_SIMD_WIDTH;
+		if (s >= end) {
+			return end;
+		}
+		mask = _jsish_non_ascii_mask(s);
 	}
-	value->type = JSISH_BOOL;
+	s += _jsish_first_bit(mask);
+	return s < end ? s : end;
+}
+
+#endif
 
-	_jsish_skip_whitespace(decoder);
+/* Statistics are only kept with JSISH_STATS; otherwise these expand to
+ * nothing, and their arguments are not even looked at. */
+#ifdef JSISH_STATS
+#define _JSISH_STATS(OWNER) ((const jsish_stats_t*) &(OWNER)->stats)
+#define _JSISH_STAT_ADD(OWNER, FIELD, COUNT) ((OWNER)->stats.FIELD += (COUNT))
+#define _JSISH_STAT_MAX(OWNER, FIELD, VALUE) \
+	((OWNER)->stats.FIELD < (VALUE) \
+		? (void) ((OWNER)->stats.FIELD = (VALUE)) \
+		: (void) 0)
+#define _JSISH_STAT_RESET(OWNER) ((OWNER)->stats = _jsish_no_stats)
 
-	return JSISH_OK;
+static const jsish_stats_t _jsish_no_stats = { { 0 }, 0, 0, 0, 0, 0 };
+#else
+#define _JSISH_STATS(OWNER) ((const jsish_stats_t*) 0)
+#define _JSISH_STAT_ADD(OWNER, FIELD, COUNT)
+#define _JSISH_STAT_MAX(OWNER, FIELD, VALUE)
+#define _JSISH_STAT_RESET(OWNER)
+#endif
+
+void jsish_init_decoder(
+		jsish_decoder_t* decoder,
+		jsish_value_t* values,
+		unsigned int values_size) {
+	decoder->values = values;
+	decoder->values_size = values_size;
+	decoder->values_cursor = 0;
+	decoder->stack_cursor = values_size - 1;
+	decoder->source = NULL;
+	decoder->cursor = 0;
+	decoder->source_size = 0;
+	decoder->source_length = 0;
+	decoder->frame = 0;
+	decoder->depth = 0;
+	decoder->state = 0;
+	decoder->resume = 0;
+	decoder->final = 0;
+	decoder->structurals = NULL;
+	decoder->structurals_size = 0;
+	decoder->structurals_count = 0;
+	decoder->structural = 0;
+	decoder->indexed = 0;
+	decoder->revisit = 0;
+	decoder->root.type = JSISH_NULL;
+	decoder->flags = 0;
+	decoder->max_depth = JSISH_MAX_DEPTH;
+	decoder->allocate = NULL;
+	decoder->deallocate = NULL;
+	decoder->user = NULL;
+	decoder->blocks = NULL;
+	_JSISH_STAT_RESET(decoder);
 }
 
-jsish_result_t
-_jsish_decode_null(jsish_decoder_t* decoder, jsish_value_t* value) {
-	const char* s;
-	s = &decoder->source[decoder->cursor];
-	/* Skip checking the first char since that's already been done in
-	 * _jsish_decode_value(). */
-	if (s[1] != 'u' || s[2] != 'l' || s[3] != 'l') {
-		return JSISH_ERR_MALFORMED;
-	}
-	value->type = JSISH_NULL;
-	decoder->cursor += 4;
+int _jsish_is_whitespace(char c) {
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
 
-	_jsish_skip_whitespace(decoder);
+/* Returns the position of the first character at or after POS in S that is not
+ * whitespace. */
+unsigned int _jsish_whitespace_end(const char* s, unsigned int pos) {
+#ifdef JSISH_SIMD_WIDTH
+	/* Most runs are zero or one characters long; only hand longer runs, such
+	 * as indentation, to the vector scan. */
+	if (!_jsish_is_whitespace(s[pos])) {
+		return pos;
+	}
+	if (!_jsish_is_whitespace(s[pos + 1])) {
+		return pos + 1;
+	}
+	return (unsigned int) (_jsish_scan_whitespace(&s[pos + 2]) - s);
+#else
+	while (_jsish_is_whitespace(s[pos])) {
+		pos++;
+	}
+	return pos;
+#endif
+}
 
-	return JSISH_OK;
+void _jsish_skip_whitespace(jsish_decoder_t* decoder) {
+	decoder->cursor = _jsish_whitespace_end(decoder->source, decoder->cursor);
 }
 
-jsish_result_t
-_jsish_decode_value(jsish_decoder_t* decoder, jsish_value_t* value);
+/* The parts of a value that differ between the layouts, see JSISH_COMPACT. */
+#ifdef JSISH_COMPACT
+#define _JSISH_CLEAR(VALUE) ((VALUE)->size = 0, (VALUE)->data.varr = NULL)
+#define _JSISH_ELEMENTS(VALUE) ((VALUE)->data.varr)
+#define _JSISH_KEY_VALUE(PAIR) (PAIR)
+#define _JSISH_INDEX(VALUE) ((VALUE)->size & _JSISH_INDEXED \
+	? (VALUE)->data.vmap + 2 * JSISH_OBJECT_SIZE(VALUE) : NULL)
+#define _JSISH_IS_SORTED(VALUE) ((VALUE)->size & _JSISH_SORTED)
+#else
+#define _JSISH_CLEAR(VALUE) ((VALUE)->data.vobj.key = NULL, \
+	(VALUE)->data.vobj.value = NULL, (VALUE)->data.vobj.next = NULL)
+#define _JSISH_ELEMENTS(VALUE) ((VALUE)->data.varr.data)
+#define _JSISH_KEY_VALUE(PAIR) ((PAIR)->data.vobj.key)
+#define _JSISH_INDEX(VALUE) ((VALUE)->data.vmap.index)
+#define _JSISH_IS_SORTED(VALUE) ((VALUE)->data.vmap.size & _JSISH_SORTED)
+#endif
 
-jsish_result_t
-_jsish_decode_array(jsish_decoder_t* decoder, jsish_value_t* value) {
-	char c;
-	int first;
+/* Makes room for COUNT more values. Once the values run out, decoding moves on
+ * to a new block from the allocate hook, taking the stack of open frames along
+ * to the top of it. Values already decoded stay where they are, so pointers to
+ * them remain valid. */
+int _jsish_room(jsish_decoder_t* decoder, unsigned int count) {
+	jsish_value_t* block;
+	jsish_value_t* values;
+	jsish_value_t* frame;
+	unsigned int limit;
+	unsigned int stack;
+	unsigned int size;
+	unsigned int shift;
 	unsigned int i;
-	jsish_value_t* element;
-	jsish_result_t result;
-	first = 1;
+	if (decoder->values_cursor + count < decoder->stack_cursor) {
+		return 1;
+	}
+	if (!decoder->allocate) {
+		return 0;
+	}
 
-	/* Skip over initial brace. */
-	decoder->cursor++;
-	_jsish_skip_whitespace(decoder);
+	/* Blocks double in size, so a document needs a number of them logarithmic
+	 * in its size. The first value of each is a link to the one before. */
+	limit = 0xFFFFFFFFu / sizeof(jsish_value_t) - 1;
+	stack = decoder->values_size - 1 - decoder->stack_cursor;
+	if (decoder->values_size > limit / 2 || count > limit - stack - 2) {
+		return 0;
+	}
+	size = decoder->values_size * 2;
+	if (size < count + stack + 2) {
+		size = count + stack + 2;
+	}
+	block = (jsish_value_t*) decoder->allocate(
+			decoder->user, (unsigned int) ((size + 1) * sizeof(jsish_value_t)));
+	if (!block) {
+		return 0;
+	}
+	block->type = JSISH_NULL;
+	_JSISH_ELEMENTS(block) = decoder->blocks;
+	decoder->blocks = block;
+	values = block + 1;
 
-	/* Decode all the array elements and push the values onto a FIFO stack
-	 * at the top of the provided values memory. */
-	while ((c = decoder->source[decoder->cursor]) != ']') {
-		if (!first && c != ',') {
-			return JSISH_ERR_MALFORMED;
-		} else if (first) {
-			first = 0;
-		} else { /* c == ',' -- Skip over comma. */
-			decoder->cursor++;
+	shift = size - decoder->values_size;
+	JSISH_MEMCPY(&values[decoder->stack_cursor + 1 + shift],
+			&decoder->values[decoder->stack_cursor + 1],
+			stack * sizeof(jsish_value_t));
+	/* Frames link to the enclosing frame by index. Each nested array or object
+	 * is itself on the stack of the enclosing frame, only the outermost one is
+	 * elsewhere. */
+	if (decoder->frame) {
+		decoder->frame += shift;
+	}
+	i = decoder->frame;
+	while (i) {
+		frame = &values[i];
+		i = JSISH_ARRAY_SIZE(frame);
+		if (i) {
+			i += shift;
+			JSISH_ARRAY_SIZE(frame) = i;
+			_JSISH_ELEMENTS(frame) = values + shift
+				+ (_JSISH_ELEMENTS(frame) - decoder->values);
 		}
+	}
+	decoder->values = values;
+	decoder->values_size = size;
+	decoder->values_cursor = 0;
+	decoder->stack_cursor += shift;
 
-		element = _jsish_alloc_fifo(decoder);
-		if (!element) {
-			return JSISH_ERR_MEM_OVERFLOW;
-		}
-		
-		_jsish_skip_whitespace(decoder);
-		result = _jsish_decode_value(decoder, element);
-		if (result != JSISH_OK) {
-			return result;
-		}
+	return 1;
+}
 
-		_jsish_skip_whitespace(decoder);
+/* Allocates COUNT contiguous values, for the caller to fill in. */
+jsish_value_t* _jsish_alloc_values(
+		jsish_decoder_t* decoder, unsigned int count) {
+	jsish_value_t* values;
+	if (!_jsish_room(decoder, count)) {
+		return NULL;
+	}
 
-		value->data.varr.size++;
+	values = &decoder->values[decoder->values_cursor];
+	decoder->values_cursor += count;
+
+	return values;
+}
+
+jsish_value_t* _jsish_alloc_value(jsish_decoder_t* decoder) {
+	jsish_value_t* value;
+	if (!_jsish_room(decoder, 1)) {
+		return NULL;
 	}
 
-	/* Read array elements in FIFO order from the stack, copy them so they are
-	 * contiguous, and reset stack cursor. */
-	element = NULL;
-	for (i = 0; i < value->data.varr.size; ++i) {
-		element = _jsish_fifo_copy(decoder, i);
-		if (!element) {
-			return JSISH_ERR_MEM_OVERFLOW;
-		}
-		if (!value->data.varr.data) {
-			/* First element in array. */
-			value->data.varr.data = element;
-		}
+	value = &decoder->values[decoder->values_cursor++];
+	value->type = JSISH_NULL;
+	_JSISH_CLEAR(value);
+
+	return value;
+}
+
+jsish_value_t* _jsish_alloc_fifo(jsish_decoder_t* decoder) {
+	jsish_value_t* stack_val;
+	if (!_jsish_room(decoder, 1)) {
+		return NULL;
 	}
-	decoder->stack_cursor = decoder->values_size - 1;
-	value->type = JSISH_ARRAY;
 
-	/* Account for the closing bracket. */
-	decoder->cursor++;
-	_jsish_skip_whitespace(decoder);
+	stack_val = &decoder->values[decoder->stack_cursor--];
+	_JSISH_STAT_MAX(
+			decoder, peak_stack, decoder->values_size - 1 - decoder->stack_cursor);
+	stack_val->type = JSISH_NULL;
+	_JSISH_CLEAR(stack_val);
 
-	return JSISH_OK;
+	return stack_val;
 }
 
-jsish_result_t
-_jsish_decode_object(jsish_decoder_t* decoder, jsish_value_t* value) {
-	int first;
-	char c;
-	jsish_result_t result;
-	if (decoder->source[decoder->cursor] != '{') {
-		return JSISH_ERR_MALFORMED;
+void jsish_free_blocks(jsish_decoder_t* decoder) {
+	jsish_value_t* block;
+	while (decoder->blocks) {
+		block = decoder->blocks;
+		decoder->blocks = _JSISH_ELEMENTS(block);
+		decoder->deallocate(decoder->user, block);
 	}
-	value->type = JSISH_KEYVAL;
-	/* Decode fields in object. */
-	decoder->cursor++;
-	_jsish_skip_whitespace(decoder);
-	first = 1;
-	while ((c = decoder->source[decoder->cursor]) != '}') {
-		if (!first && c == ',') {
-			value->data.vobj.next = _jsish_alloc_value(decoder);
-			if (!value->data.vobj.next) {
-				return JSISH_ERR_MEM_OVERFLOW;
-			}
-			value = value->data.vobj.next;
-			value->type = JSISH_KEYVAL;
-			decoder->cursor++;
-		} else if (!first) {
-			return JSISH_ERR_MALFORMED;
-		} else {
-			first = 0;
-		}
+}
 
-		/* Decode key. */
-		value->data.vobj.key = _jsish_alloc_value(decoder);
-		if (!value->data.vobj.key) {
-			return JSISH_ERR_MEM_OVERFLOW;
+int _jsish_is_hex_digit(char c) {
+	return (c >= '0' && c <= '9')
+		|| (c >= 'a' && c <= 'f')
+		|| (c >= 'A' && c <= 'F');
+}
+
+/* Returns whether the bytes from S up to END are valid UTF-8: no overlong
+ * forms, surrogates or code points beyond U+10FFFF. Runs of ASCII are skipped
+ * with the vector scan. */
+int _jsish_valid_utf8(const char* s, const char* end) {
+	unsigned int c;
+	unsigned int code;
+	unsigned int length;
+	unsigned int i;
+	for (;;) {
+#ifdef JSISH_SIMD_WIDTH
+		s = _jsish_scan_ascii(s, end);
+#else
+		while (s < end && !(*s & 0x80)) {
+			s++;
 		}
-		_jsish_skip_whitespace(decoder);
-		result = _jsish_decode_string(decoder, value->data.vobj.key);
-		if (result != JSISH_OK) {
-			return result;
+#endif
+		if (s == end) {
+			return 1;
 		}
-
-		/* Verify key is followed by colon, advance cursor, and decode value. */
-		_jsish_skip_whitespace(decoder);
-		if (decoder->source[decoder->cursor] == ':') {
-			decoder->cursor++;
+		c = (unsigned char) *s;
+		if (c >= 0xc2 && c <= 0xdf) {
+			length = 2;
+			code = c & 0x1f;
+		} else if (c >= 0xe0 && c <= 0xef) {
+			length = 3;
+			code = c & 0x0f;
+		} else if (c >= 0xf0 && c <= 0xf4) {
+			length = 4;
+			code = c & 0x07;
 		} else {
-			return JSISH_ERR_MALFORMED;
+			return 0;
 		}
-		_jsish_skip_whitespace(decoder);
-
-		value->data.vobj.value = _jsish_alloc_value(decoder);
-		if (!value->data.vobj.value) {
-			return JSISH_ERR_MEM_OVERFLOW;
+		if ((unsigned int) (end - s) < length) {
+			return 0;
 		}
-		result = _jsish_decode_value(decoder, value->data.vobj.value);
-		if (result != JSISH_OK) {
-			return result;
+		for (i = 1; i < length; ++i) {
+			if ((s[i] & 0xc0) != 0x80) {
+				return 0;
+			}
+			code = code << 6 | (s[i] & 0x3f);
 		}
+		if ((length == 3 && (code < 0x800 || (code >= 0xd800 && code <= 0xdfff)))
+				|| (length == 4 && (code < 0x10000 || code > 0x10ffff))) {
+			return 0;
+		}
+		s += length;
 	}
-
-	/* Account for the closing brace. */
-	decoder->cursor++;
-
-	_jsish_skip_whitespace(decoder);
-
-	return JSISH_OK;
-}
-
-jsish_result_t
-_jsish_decode_value(jsish_decoder_t* decoder, jsish_value_t* value) {
-	char c = decoder->source[decoder->cursor];
-	switch (c) {
-		case '"':
-			return _jsish_decode_string(decoder, value);
-		case '-': case '0': case '1': case '2': case '3': case '4': case '5':
-		case '6': case '7': case '8': case '9':
-			return _jsish_decode_number(decoder, value);
-		case 't': case 'f':
-			return _jsish_decode_bool(decoder, value);
-		case 'n':
-			return _jsish_decode_null(decoder, value);
-		case '[':
-			return _jsish_decode_array(decoder, value);
-		case '{':
-			return _jsish_decode_object(decoder, value);
-		default:
-			return JSISH_ERR_MALFORMED;
-	};
 }
 
-jsish_result_t jsish_decode(jsish_decoder_t* decoder, char* source) {
-	decoder->source = source;
-	_jsish_skip_whitespace(decoder);
-	return _jsish_decode_value(decoder, &decoder->root);
+/* Value of the four hex digits at S. */
+unsigned int _jsish_hex_value(const char* s) {
+	unsigned int value;
+	unsigned int i;
+	value = 0;
+	for (i = 0; i < 4; ++i) {
+		value = value << 4 | (unsigned int) (s[i] <= '9'
+				? s[i] - '0'
+				: (s[i] | 0x20) - 'a' + 10);
+	}
+	return value;
 }
 
-void _jsish_append(
-		char* buffer,
-		char c,
-		unsigned int buffer_size,
-		unsigned int* encoded_bytes) {
-	if (*encoded_bytes < buffer_size) {
-		buffer[*encoded_bytes] = c;
+/* Returns whether the escape sequences of the checked string from S up to END
+ * can be unescaped: not if it holds \u0000 or an unpaired surrogate, as it
+ * could not be zero-terminated UTF-8 then. */
+int _jsish_can_unescape(const char* s, const char* end) {
+	const char* r;
+	unsigned int code;
+	unsigned int low;
+	for (r = s; (r = (const char*) JSISH_MEMCHR(r, '\\', end - r)); r += 2) {
+		if (r[1] != 'u') {
+			continue;
+		}
+		code = _jsish_hex_value(r + 2);
+		if (code >= 0xd800 && code <= 0xdbff) {
+			if (r[6] != '\\' || r[7] != 'u') {
+				return 0;
+			}
+			low = _jsish_hex_value(r + 8);
+			if (low < 0xdc00 || low > 0xdfff) {
+				return 0;
+			}
+			r += 6;
+		} else if (!code || (code >= 0xdc00 && code <= 0xdfff)) {
+			return 0;
+		}
+		r += 4;
 	}
-	(*encoded_bytes)++;
+	return 1;
 }
 
-void _jsish_encode_null(
-		char* buffer, unsigned int buffer_size, unsigned int* encoded_bytes) {
-	_jsish_append(buffer, 'n', buffer_size, encoded_bytes); 
-	_jsish_append(buffer, 'u', buffer_size, encoded_bytes); 
-	_jsish_append(buffer, 'l', buffer_size, encoded_bytes); 
-	_jsish_append(buffer, 'l', buffer_size, encoded_bytes); 
+/* Writes the character that the escape sequence at R stands for to W, \u
+ * escapes, including surrogate pairs, as UTF-8, which never takes more room
+ * than the escape. Returns the number of bytes written, at most 4, and sets
+ * LENGTH to that of the escape sequence. */
+unsigned int _jsish_unescape_char(
+		const char* r, char* w, unsigned int* length) {
+	unsigned int code;
+	*length = 2;
+	switch (r[1]) {
+		case 'b': *w = '\b'; return 1;
+		case 'f': *w = '\f'; return 1;
+		case 'n': *w = '\n'; return 1;
+		case 'r': *w = '\r'; return 1;
+		case 't': *w = '\t'; return 1;
+		case 'u':
+			break;
+		default:
+			/* '"', '\\' and '/' stand for themselves. */
+			*w = r[1];
+			return 1;
+	}
+	code = _jsish_hex_value(r + 2);
+	*length = 6;
+	if (code >= 0xd800 && code <= 0xdbff) {
+		code = 0x10000 + ((code - 0xd800) << 10)
+			+ (_jsish_hex_value(r + 8) - 0xdc00);
+		*length = 12;
+	}
+	if (code < 0x80) {
+		w[0] = (char) code;
+		return 1;
+	} else if (code < 0x800) {
+		w[0] = (char) (0xc0 | code >> 6);
+		w[1] = (char) (0x80 | (code & 0x3f));
+		return 2;
+	} else if (code < 0x10000) {
+		w[0] = (char) (0xe0 | code >> 12);
+		w[1] = (char) (0x80 | (code >> 6 & 0x3f));
+		w[2] = (char) (0x80 | (code & 0x3f));
+		return 3;
+	}
+	w[0] = (char) (0xf0 | code >> 18);
+	w[1] = (char) (0x80 | (code >> 12 & 0x3f));
+	w[2] = (char) (0x80 | (code >> 6 & 0x3f));
+	w[3] = (char) (0x80 | (code & 0x3f));
+	return 4;
 }
 
-void _jsish_encode_number(
-		const jsish_value_t* value,
-		char* buffer,
-		unsigned int buffer_size,
-		unsigned int* encoded_bytes) {
+/* Rewrites the escape sequences of the checked string from S up to END in
+ * place as the characters they stand for. Returns the new end, or NULL
+ * without changing anything if _jsish_can_unescape() says no. */
+char* _jsish_unescape(char* s, char* end) {
+	const char* r;
+	char* w;
 	unsigned int length;
-	length = JSISH_FLOAT_DIGITS(JSISH_GET_NUMBER(value));
-	if (*encoded_bytes + length <= buffer_size) {
-		JSISH_SPRINTF(&buffer[*encoded_bytes], "%g", JSISH_GET_NUMBER(value));
+	if (!_jsish_can_unescape(s, end)) {
+		return NULL;
 	}
-	*encoded_bytes += length;
-}
 
-void _jsish_encode_bool(
-		const jsish_value_t* value,
-		char* buffer,
-		unsigned int buffer_size,
-		unsigned int* encoded_bytes) {
-	if (JSISH_GET_BOOL(value)) {
-		_jsish_append(buffer, 't', buffer_size, encoded_bytes); 
-		_jsish_append(buffer, 'r', buffer_size, encoded_bytes); 
-		_jsish_append(buffer, 'u', buffer_size, encoded_bytes); 
-		_jsish_append(buffer, 'e', buffer_size, encoded_bytes); 
-		return;
+	r = s;
+	w = s;
+	while (r < end) {
+		if (*r != '\\') {
+			*w++ = *r++;
+			continue;
+		}
+		w += _jsish_unescape_char(r, w, &length);
+		r += length;
 	}
-	_jsish_append(buffer, 'f', buffer_size, encoded_bytes); 
-	_jsish_append(buffer, 'a', buffer_size, encoded_bytes); 
-	_jsish_append(buffer, 'l', buffer_size, encoded_bytes); 
-	_jsish_append(buffer, 's', buffer_size, encoded_bytes); 
-	_jsish_append(buffer, 'e', buffer_size, encoded_bytes); 
+
+	return w;
 }
 
-void _jsish_encode_string(
-		const jsish_value_t* value,
-		char* buffer,
-		unsigned int buffer_size,
-		unsigned int* encoded_bytes) {
-	unsigned int length;
-	/* String length + quotation marks. */
-	length = JSISH_STRLEN(JSISH_GET_STRING(value)) + 2;
-	if (*encoded_bytes + length <= buffer_size) { 
-		JSISH_SPRINTF(
-				&buffer[*encoded_bytes], "\"%s\"", JSISH_GET_STRING(value));
+/* True if POS is the end of the input fed so far and more input may follow, in
+ * which case a token cut short there is incomplete rather than malformed. */
+#define _JSISH_AWAITS_INPUT(DECODER, POS) \
+	(!(DECODER)->final && (POS) == (DECODER)->source_length)
+
+unsigned int _jsish_trailing_zeros(_jsish_uint_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+	return (unsigned int) __builtin_ctzll(x);
+#else
+	unsigned int i;
+	for (i = 0; !(x & 1); ++i) {
+		x >>= 1;
 	}
-	*encoded_bytes += length;
+	return i;
+#endif
 }
 
-void _jsish_encode_value(
-		const jsish_value_t* value,
-		char* buffer,
-		unsigned int buffer_size,
-		unsigned int* encoded_bytes);
+unsigned int _jsish_popcount(_jsish_uint_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+	return (unsigned int) __builtin_popcountll(x);
+#else
+	unsigned int n;
+	for (n = 0; x; ++n) {
+		x &= x - 1;
+	}
+	return n;
+#endif
+}
 
-void _jsish_encode_array(
-		const jsish_value_t* value,
-		char* buffer,
-		unsigned int buffer_size,
-		unsigned int* encoded_bytes) {
+/* First stage of jsish_decode_indexed(), run whenever the second stage has
+ * used up the structurals buffer so that both work on data still in the cache.
+ * The source is classified 64 bytes at a time into bit masks, one bit per
+ * byte, from which the escaped characters and the extent of strings are worked
+ * out without branching on the data. Recorded are the structural characters
+ * and the first character of every other token outside strings, all unescaped
+ * quotation marks, and within strings the backslashes that begin escape
+ * sequences and any line breaks. The source length is recorded once the end
+ * has been reached. */
+void _jsish_index_structurals(jsish_decoder_t* decoder) {
+	const char* p;
+	char tail[64];
+	unsigned int* structurals;
+	unsigned int block;
+	unsigned int count;
 	unsigned int i;
-	int sep;
-	_jsish_append(buffer, '[', buffer_size, encoded_bytes); 
-	sep = 0;
-	for (i = 0; i < JSISH_ARRAY_SIZE(value); ++i) {
-		/* Write the field separator. */
-		if (sep) {
-			_jsish_append(buffer, ',', buffer_size, encoded_bytes); 
+#ifdef JSISH_SIMD_WIDTH
+	unsigned int masks[5];
+#endif
+	_jsish_uint_t quote, backslash, op, space, breaks;
+	_jsish_uint_t bits, bit, escaped, in_string, scalar;
+	structurals = decoder->structurals;
+	count = 0;
+	/* Stop while there is still room for a whole block and the end. */
+	for (block = decoder->indexed;
+			block < decoder->source_length
+				&& count + 64 < decoder->structurals_size;
+			block += 64) {
+		p = &decoder->source[block];
+		if (decoder->source_length - block < 64) {
+			/* Pad the last block with whitespace. */
+			JSISH_MEMCPY(tail, p, decoder->source_length - block);
+			for (i = decoder->source_length - block; i < 64; ++i) {
+				tail[i] = ' ';
+			}
+			p = tail;
+		}
+
+		quote = backslash = op = space = breaks = 0;
+#ifdef JSISH_SIMD_WIDTH
+		for (i = 0; i < 64; i += JSISH_SIMD_WIDTH) {
+			_jsish_classify(&p[i], masks);
+			quote |= (_jsish_uint_t) masks[0] << i;
+			backslash |= (_jsish_uint_t) masks[1] << i;
+			op |= (_jsish_uint_t) masks[2] << i;
+			space |= (_jsish_uint_t) masks[3] << i;
+			breaks |= (_jsish_uint_t) masks[4] << i;
+		}
+#else
+		for (i = 0; i < 64; ++i) {
+			bit = (_jsish_uint_t) 1 << i;
+			switch (p[i]) {
+				case '"':
+					quote |= bit;
+					break;
+				case '\\':
+					backslash |= bit;
+					break;
+				case '{': case '}': case '[': case ']': case ':': case ',':
+					op |= bit;
+					break;
+				case '\n': case '\r':
+					breaks |= bit;
+					/* Fall through. */
+				case ' ': case '\t':
+					space |= bit;
+					break;
+				default:
+					break;
+			}
+		}
+#endif
+
+		/* Each backslash that is not escaped itself escapes the next character,
+		 * possibly the first one of the next block. */
+		escaped = decoder->index_carry[0];
+		decoder->index_carry[0] = 0;
+		bits = backslash & ~escaped;
+		while (bits) {
+			bit = bits & (~bits + 1);
+			escaped |= bit << 1;
+			decoder->index_carry[0] = bit >> 63;
+			bits &= ~(bit | bit << 1);
 		}
+		quote &= ~escaped;
+
+		/* A prefix XOR over the quotation marks sets the bits from each opening
+		 * quotation mark up to, but not including, its closing one. */
+		in_string = quote ^ quote << 1;
+		in_string ^= in_string << 2;
+		in_string ^= in_string << 4;
+		in_string ^= in_string << 8;
+		in_string ^= in_string << 16;
+		in_string ^= in_string << 32;
+		in_string ^= decoder->index_carry[1];
+		decoder->index_carry[1] = (_jsish_uint_t) 0 - (in_string >> 63);
 
-		/* Encode the value at array index i.  */
-		_jsish_encode_value(
-				JSISH_ARRAY_INDEX(value, i),
-				buffer,
-				buffer_size,
-				encoded_bytes);
+		/* Other tokens start where a run of characters that are neither
+		 * whitespace nor structural begins. */
+		scalar = ~(op | space | quote | in_string);
+		bits = (op & ~in_string) | quote
+			| (scalar & ~(scalar << 1 | decoder->index_carry[2]))
+			| (((backslash & ~escaped) | breaks) & in_string);
+		decoder->index_carry[2] = scalar >> 63;
 
-		sep = 1;
+		while (bits) {
+			structurals[count++] = block + _jsish_trailing_zeros(bits);
+			bits &= bits - 1;
+		}
+	}
+	decoder->indexed = block;
+	if (block >= decoder->source_length) {
+		structurals[count++] = decoder->source_length;
 	}
-	_jsish_append(buffer, ']', buffer_size, encoded_bytes); 
+	decoder->structurals_count = count;
+	decoder->structural = 0;
 }
 
-void _jsish_encode_object(
+/* Returns the next recorded position without moving past it. */
+unsigned int _jsish_peek_structural(jsish_decoder_t* decoder) {
+	if (decoder->structural == decoder->structurals_count) {
+		JSISH_BEGIN_PHASE(JSISH_PHASE_INDEX);
+		_jsish_index_structurals(decoder);
+		JSISH_END_PHASE(JSISH_PHASE_INDEX, JSISH_OK, _JSISH_STATS(decoder));
+	}
+	return decoder->structurals[decoder->structural];
+}
+
+/* Number of values that JSISH_COPY_STRINGS takes up for a string of LENGTH
+ * characters between its quotation marks, with its zero terminator. */
+unsigned int _jsish_string_values(unsigned int length) {
+	return length / (unsigned int) sizeof(jsish_value_t) + 1;
+}
+
+/* Copies the characters from S to END into the values memory for
+ * JSISH_COPY_STRINGS, leaving room for a zero terminator. */
+char* _jsish_copy_string(
+		jsish_decoder_t* decoder, const char* s, const char* end) {
+	char* copy;
+	unsigned int length;
+	length = (unsigned int) (end - s);
+	copy = (char*) _jsish_alloc_values(decoder, _jsish_string_values(length));
+	if (copy) {
+		JSISH_MEMCPY(copy, s, length);
+	}
+
+	return copy;
+}
+
+#ifdef JSISH_STATS
+/* Returns the number of escape sequences from S to END. */
+unsigned int _jsish_count_escapes(const char* s, const char* end) {
+	unsigned int count;
+	count = 0;
+	for (; s < end; ++s) {
+		if (*s == '\\') {
+			count++;
+			s++;
+		}
+	}
+	return count;
+}
+#endif
+
+/* Ends the string that starts with the quotation mark at START at END, where
+ * the source gets a zero terminator, and stores it in VALUE. With
+ * JSISH_COPY_STRINGS, the string is copied into the values memory and
+ * terminated there instead. Strings are checked for valid UTF-8 with
+ * JSISH_VALIDATE_UTF8, and unescaped with JSISH_UNESCAPE, except in the source
+ * when decoding from a cursor, which would no longer be able to find its way
+ * through it otherwise. */
+jsish_result_t _jsish_finish_string(
+		jsish_decoder_t* decoder,
+		jsish_value_t* value,
+		unsigned int start,
+		unsigned int end,
+		int escaped) {
+	char* s;
+	char* terminator;
+	char* unescaped;
+	s = &decoder->source[start + 1];
+	terminator = &decoder->source[end];
+	_JSISH_STAT_MAX(decoder, longest_string, end - start - 1);
+#ifdef JSISH_STATS
+	if (escaped) {
+		decoder->stats.escapes += _jsish_count_escapes(s, terminator);
+	}
+#endif
+	if ((decoder->flags & JSISH_VALIDATE_UTF8)
+			&& !_jsish_valid_utf8(s, terminator)) {
+		decoder->cursor = start;
+		return JSISH_ERR_MALFORMED;
+	}
+	if (decoder->flags & JSISH_COPY_STRINGS) {
+		s = _jsish_copy_string(decoder, s, terminator);
+		if (!s) {
+			return JSISH_ERR_MEM_OVERFLOW;
+		}
+		terminator = s + (end - start - 1);
+	}
+	if (escaped && (decoder->flags & JSISH_UNESCAPE)
+			&& (!decoder->revisit || (decoder->flags & JSISH_COPY_STRINGS))) {
+		unescaped = _jsish_unescape(s, terminator);
+		if (unescaped) {
+			terminator = unescaped;
+			escaped = 0;
+		}
+	}
+
+	*terminator = '\0';
+	value->type = escaped ? JSISH_RAW_STRING : JSISH_STRING;
+	value->data.vstr = s;
+	decoder->cursor = end + 1;
+
+	return JSISH_OK;
+}
+
+/* Decodes the string at the cursor from the positions recorded for two-stage
+ * decoding, where the entries after the opening quotation mark are the
+ * backslashes of its escape sequences, if any, and then the closing quotation
+ * mark. Anything else there is a line break or the end of the source. */
+jsish_result_t
+_jsish_decode_indexed_string(jsish_decoder_t* decoder, jsish_value_t* value) {
+	char* s;
+	unsigned int end;
+	int escaped;
+	int i;
+	escaped = 0;
+	for (;;) {
+		end = _jsish_peek_structural(decoder);
+		decoder->structural++;
+		s = &decoder->source[end];
+		/* Nothing at or past the end of the source is read, as it need not be
+		 * terminated, see jsish_decode_const(). */
+		if (end == decoder->source_length || *s != '\\') {
+			break;
+		}
+		escaped = 1;
+		switch (end + 1 < decoder->source_length ? s[1] : '\0') {
+			case '\\': case '/': case '"': case 'b': case 'f': case 't':
+			case 'n': case 'r':
+				continue;
+			case 'u':
+				for (i = 2; i < 6 && end + i < decoder->source_length
+						&& _jsish_is_hex_digit(s[i]); ++i) {
+				}
+				if (i == 6) {
+					continue;
+				}
+				/* Fall through. */
+			default:
+				decoder->cursor = end;
+				return JSISH_ERR_MALFORMED;
+		}
+	}
+	if (end == decoder->source_length || *s != '"') {
+		decoder->cursor = end;
+		return JSISH_ERR_MALFORMED;
+	}
+
+	return _jsish_finish_string(
+			decoder, value, decoder->cursor, end, escaped);
+}
+
+jsish_result_t
+_jsish_decode_string(jsish_decoder_t* decoder, jsish_value_t* value) {
+	char c;
+	int i;
+	int escaped;
+	unsigned int start;
+	unsigned int consumed;
+	if (decoder->source[decoder->cursor] != '"') {
+		return JSISH_ERR_MALFORMED;
+	}
+	if (decoder->structurals) {
+		return _jsish_decode_indexed_string(decoder, value);
+	}
+
+	start = decoder->cursor;
+	escaped = 0;
+
+	/* Pick up where an earlier attempt ran out of input. */
+	if (decoder->resume > start) {
+		for (consumed = start + 1; consumed <= decoder->resume; ++consumed) {
+			if (decoder->source[consumed] == '\\') {
+				escaped = 1;
+			}
+		}
+		decoder->cursor = decoder->resume;
+	}
+	decoder->resume = 0;
+
+	for (;;) {
+#ifdef JSISH_SIMD_WIDTH
+		/* Skip ahead to the next character that needs a closer look. */
+		decoder->cursor = (unsigned int) (_jsish_scan_string(
+				&decoder->source[decoder->cursor + 1]) - decoder->source);
+		c = decoder->source[decoder->cursor];
+#else
+		c = decoder->source[++decoder->cursor];
+#endif
+		if (c == '"') {
+			break;
+		}
+		/* Everything before the current character has been checked. */
+		consumed = decoder->cursor - 1;
+		switch (c) {
+			case '\\':
+				/* Verify the backslash is followed by a valid escape code. */
+				escaped = 1;
+				c = decoder->source[++decoder->cursor];
+				switch (c) {
+					case '\\': case '/': case '"': case 'b': case 'f': case 't':
+					case 'n': case 'r':
+						break;
+					case 'u':
+						/* \u needs to be followed by four hex digits. */
+						for (i = 0; i < 4; ++i) {
+							c = decoder->source[++decoder->cursor];
+							if (!_jsish_is_hex_digit(c)) {
+								break;
+							}
+						}
+						if (i == 4) {
+							break;
+						}
+						/* Fall through. */
+					default:
+						if (c == '\0' && _JSISH_AWAITS_INPUT(
+								decoder, decoder->cursor)) {
+							goto incomplete;
+						}
+						return JSISH_ERR_MALFORMED;
+				}
+				break;
+			case '\0':
+				/* Cursors can come back to a part of the source that has
+				 * been decoded before, where end quotes have been replaced
+				 * with zero terminators. */
+				if (decoder->revisit
+						&& decoder->cursor < decoder->source_length) {
+					goto terminated;
+				}
+				if (_JSISH_AWAITS_INPUT(decoder, decoder->cursor)) {
+					goto incomplete;
+				}
+				return JSISH_ERR_MALFORMED;
+			case '\n': case '\r':
+				return JSISH_ERR_MALFORMED;
+			default:
+				break;
+		}
+	}
+
+terminated:
+	/* Replace the end quote with a zero terminator in the source, so the
+	 * decoded string can be referenced in situ. */
+	return _jsish_finish_string(
+			decoder, value, start, decoder->cursor, escaped);
+
+incomplete:
+	decoder->resume = consumed;
+	decoder->cursor = start;
+	return JSISH_INCOMPLETE;
+}
+
+/* Exact powers of ten representable as doubles. */
+static const double _jsish_pow10[23] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+	1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* Multiplies V by 2^E. Exact as long as the result is representable, since
+ * every intermediate product lies between V and the result. */
+double _jsish_scale2(double v, int e) {
+	const double step = (double) ((_jsish_uint_t) 1 << 60);
+	while (e > 60) {
+		v *= step;
+		e -= 60;
+	}
+	while (e < -60) {
+		v /= step;
+		e += 60;
+	}
+	return e < 0
+		? v / (double) ((_jsish_uint_t) 1 << -e)
+		: v * (double) ((_jsish_uint_t) 1 << e);
+}
+
+/* Arbitrary precision decimal, used to correctly round the numbers that the
+ * fast paths can't handle. This is the simple decimal conversion algorithm
+ * also found in Go's strconv package. */
+#define _JSISH_DECIMAL_DIGITS 800
+#define _JSISH_DECIMAL_MAX_SHIFT 28
+
+typedef struct {
+	unsigned char digits[_JSISH_DECIMAL_DIGITS];
+	int count;
+	/* Position of the decimal point relative to the first digit. */
+	int point;
+	/* Whether non-zero digits were dropped after the last one stored. */
+	int truncated;
+} _jsish_decimal_t;
+
+void _jsish_decimal_trim(_jsish_decimal_t* d) {
+	while (d->count > 0 && d->digits[d->count - 1] == 0) {
+		d->count--;
+	}
+	if (d->count == 0) {
+		d->point = 0;
+	}
+}
+
+/* Divides D by 2^K. */
+void _jsish_decimal_shift_right(_jsish_decimal_t* d, int k) {
+	unsigned long n;
+	unsigned long digit;
+	int r;
+	int w;
+	n = 0;
+	r = 0;
+	w = 0;
+	/* Pick up enough leading digits to cover the first shift. */
+	while (!(n >> k)) {
+		if (r < d->count) {
+			n = n * 10 + d->digits[r];
+		} else if (n == 0) {
+			d->count = 0;
+			return;
+		} else {
+			n *= 10;
+		}
+		r++;
+	}
+	d->point -= r - 1;
+
+	/* Pick up a digit, put down a digit. */
+	for (; r < d->count; ++r) {
+		digit = n >> k;
+		n = (n & ((1ul << k) - 1)) * 10 + d->digits[r];
+		d->digits[w++] = (unsigned char) digit;
+	}
+
+	/* Put down extra digits. */
+	while (n > 0) {
+		digit = n >> k;
+		n = (n & ((1ul << k) - 1)) * 10;
+		if (w < _JSISH_DECIMAL_DIGITS) {
+			d->digits[w++] = (unsigned char) digit;
+		} else if (digit > 0) {
+			d->truncated = 1;
+		}
+	}
+
+	d->count = w;
+	_jsish_decimal_trim(d);
+}
+
+/* Multiplies D by 2^K. */
+void _jsish_decimal_shift_left(_jsish_decimal_t* d, int k) {
+	/* The product, least significant digit first. */
+	unsigned char product[_JSISH_DECIMAL_DIGITS + 10];
+	unsigned long n;
+	int r;
+	int w;
+	int i;
+	n = 0;
+	w = 0;
+	for (r = d->count - 1; r >= 0; --r) {
+		n += (unsigned long) d->digits[r] << k;
+		product[w++] = (unsigned char) (n % 10);
+		n /= 10;
+	}
+	while (n > 0) {
+		product[w++] = (unsigned char) (n % 10);
+		n /= 10;
+	}
+
+	d->point += w - d->count;
+	d->count = w < _JSISH_DECIMAL_DIGITS ? w : _JSISH_DECIMAL_DIGITS;
+	for (i = 0; i < w - d->count; ++i) {
+		if (product[i]) {
+			d->truncated = 1;
+		}
+	}
+	for (i = 0; i < d->count; ++i) {
+		d->digits[i] = product[w - 1 - i];
+	}
+	_jsish_decimal_trim(d);
+}
+
+void _jsish_decimal_shift(_jsish_decimal_t* d, int k) {
+	if (d->count == 0) {
+		return;
+	}
+	for (; k > _JSISH_DECIMAL_MAX_SHIFT; k -= _JSISH_DECIMAL_MAX_SHIFT) {
+		_jsish_decimal_shift_left(d, _JSISH_DECIMAL_MAX_SHIFT);
+	}
+	for (; k < -_JSISH_DECIMAL_MAX_SHIFT; k += _JSISH_DECIMAL_MAX_SHIFT) {
+		_jsish_decimal_shift_right(d, _JSISH_DECIMAL_MAX_SHIFT);
+	}
+	if (k > 0) {
+		_jsish_decimal_shift_left(d, k);
+	} else if (k < 0) {
+		_jsish_decimal_shift_right(d, -k);
+	}
+}
+
+/* The integer part of D, rounded half to even. */
+_jsish_uint_t _jsish_decimal_round(const _jsish_decimal_t* d) {
+	_jsish_uint_t n;
+	int i;
+	int up;
+	n = 0;
+	for (i = 0; i < d->point && i < d->count; ++i) {
+		n = n * 10 + d->digits[i];
+	}
+	for (; i < d->point; ++i) {
+		n *= 10;
+	}
+	if (d->point < 0 || d->point >= d->count) {
+		up = 0;
+	} else if (d->digits[d->point] == 5 && d->point + 1 == d->count) {
+		/* Exactly halfway, unless digits were dropped. */
+		up = d->truncated || (d->point > 0 && (d->digits[d->point - 1] & 1));
+	} else {
+		up = d->digits[d->point] >= 5;
+	}
+	return up ? n + 1 : n;
+}
+
+/* Converts the digits of a JSON number, starting at S and followed by an
+ * exponent of EXPONENT, to the nearest double. */
+double _jsish_decimal_to_double(const char* s, int exponent) {
+	/* How far a shift can move the decimal point of a decimal with its point
+	 * at the given position. */
+	static const int shifts[9] = { 1, 3, 6, 9, 13, 16, 19, 23, 26 };
+	_jsish_decimal_t d;
+	_jsish_uint_t mantissa;
+	int point_seen;
+	int e;
+	int n;
+	d.count = 0;
+	d.point = 0;
+	d.truncated = 0;
+	point_seen = 0;
+	for (;; ++s) {
+		if (*s == '.') {
+			d.point = d.count;
+			point_seen = 1;
+		} else if (*s < '0' || *s > '9') {
+			break;
+		} else if (*s == '0' && d.count == 0) {
+			/* Leading zero. */
+			d.point--;
+		} else if (d.count < _JSISH_DECIMAL_DIGITS) {
+			d.digits[d.count++] = (unsigned char) (*s - '0');
+		} else if (*s != '0') {
+			d.truncated = 1;
+		}
+	}
+	if (!point_seen) {
+		d.point = d.count;
+	}
+	_jsish_decimal_trim(&d);
+	d.point += exponent;
+
+	if (d.count == 0 || d.point < -330) {
+		return 0.0;
+	} else if (d.point > 310) {
+		return _jsish_scale2(1.0, 1100);
+	}
+
+	/* Scale by powers of two until the decimal is in [0.5, 1). */
+	e = 0;
+	while (d.point > 0) {
+		n = d.point < 9 ? shifts[d.point] : 27;
+		_jsish_decimal_shift(&d, -n);
+		e += n;
+	}
+	while (d.point < 0 || (d.point == 0 && d.digits[0] < 5)) {
+		n = -d.point < 9 ? shifts[-d.point] : 27;
+		_jsish_decimal_shift(&d, n);
+		e -= n;
+	}
+
+	/* Move to the [1, 2) range of doubles, and make room for subnormals. */
+	e--;
+	if (e < -1022) {
+		_jsish_decimal_shift(&d, e + 1022);
+		e = -1022;
+	}
+	if (e > 1023) {
+		return _jsish_scale2(1.0, 1100);
+	}
+
+	/* Extract 53 bits. Rounding may add one. */
+	_jsish_decimal_shift(&d, 53);
+	mantissa = _jsish_decimal_round(&d);
+	if (mantissa == (_jsish_uint_t) 1 << 53) {
+		mantissa >>= 1;
+		e++;
+	}
+
+	return _jsish_scale2((double) mantissa, e - 52);
+}
+
+/* Big integers of 32-bit limbs, least significant first, for the exact
+ * conversion of up to 19 significant digits. */
+#define _JSISH_BIG_LIMBS 40
+
+/* Powers of five up to the largest that fits in 31 bits. */
+static const unsigned int _jsish_pow5[14] = {
+	1, 5, 25, 125, 625, 3125, 15625, 78125, 390625, 1953125, 9765625,
+	48828125, 244140625, 1220703125
+};
+
+int _jsish_bit_length(_jsish_uint_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+	return x ? 64 - __builtin_clzll(x) : 0;
+#else
+	int bits;
+	for (bits = 0; x; x >>= 1) {
+		bits++;
+	}
+	return bits;
+#endif
+}
+
+int _jsish_big_bit(const unsigned int* x, int bit) {
+	return (x[bit / 32] >> (bit % 32)) & 1;
+}
+
+/* Rounds X * 2^E, with X having COUNT limbs, to the nearest double. STICKY tells
+ * whether the true value is a little larger than that. */
+double _jsish_big_to_double(
+		const unsigned int* x, int count, int e, int sticky) {
+	_jsish_uint_t m;
+	int bits;
+	int shift;
+	int limb;
+	int i;
+	while (count > 0 && !x[count - 1]) {
+		count--;
+	}
+	if (!count) {
+		return 0.0;
+	}
+	bits = 32 * (count - 1) + _jsish_bit_length(x[count - 1]);
+
+	/* Keep 53 bits, or fewer if the result is subnormal. */
+	shift = bits - 53;
+	if (shift < -1074 - e) {
+		shift = -1074 - e;
+	}
+	if (shift <= 0) {
+		m = 0;
+		for (i = count - 1; i >= 0; --i) {
+			m = m << 32 | x[i];
+		}
+		return _jsish_scale2((double) m, e);
+	}
+
+	limb = shift / 32;
+	m = (_jsish_uint_t) x[limb] >> (shift % 32);
+	if (limb + 1 < count) {
+		m |= (_jsish_uint_t) x[limb + 1] << (32 - shift % 32);
+	}
+	if (limb + 2 < count && shift % 32) {
+		m |= (_jsish_uint_t) x[limb + 2] << (64 - shift % 32);
+	}
+
+	/* Round half to even. */
+	if (_jsish_big_bit(x, shift - 1)) {
+		for (i = 0; i < (shift - 1) / 32 && !sticky; ++i) {
+			sticky = x[i] != 0;
+		}
+		if (sticky
+				|| (x[(shift - 1) / 32] & ((1u << (shift - 1) % 32) - 1))
+				|| (m & 1)) {
+			m++;
+		}
+	}
+
+	return _jsish_scale2((double) m, e + shift);
+}
+
+/* Converts W * 10^Q to the nearest double, using exact integer arithmetic. */
+double _jsish_exact_to_double(_jsish_uint_t w, int q) {
+	unsigned int x[_JSISH_BIG_LIMBS];
+	_jsish_uint_t carry;
+	int count;
+	int sticky;
+	int shift;
+	int n;
+	int i;
+	int j;
+	if (q > 330) {
+		return _jsish_scale2(1.0, 1100);
+	} else if (q < -360) {
+		return 0.0;
+	}
+
+	if (q >= 0) {
+		/* W * 5^Q * 2^Q, multiplying by up to 5^13 at a time. */
+		x[0] = (unsigned int) (w & 0xffffffffu);
+		x[1] = (unsigned int) (w >> 32);
+		count = 2;
+		for (i = q; i > 0; i -= n) {
+			n = i < 13 ? i : 13;
+			carry = 0;
+			for (j = 0; j < count; ++j) {
+				carry += (_jsish_uint_t) x[j] * _jsish_pow5[n];
+				x[j] = (unsigned int) (carry & 0xffffffffu);
+				carry >>= 32;
+			}
+			if (carry) {
+				x[count++] = (unsigned int) carry;
+			}
+		}
+		return _jsish_big_to_double(x, count, q, 0);
+	}
+
+	/* W * 2^SHIFT / 5^-Q * 2^(Q - SHIFT), with SHIFT chosen so that the
+	 * quotient has more than 54 significant bits (log2(5) < 75/32), dividing
+	 * by up to 5^13 at a time. */
+	shift = (-q * 75 + 31) / 32 + 57 - _jsish_bit_length(w);
+	if (shift < 0) {
+		shift = 0;
+	}
+	for (i = 0; i < shift / 32; ++i) {
+		x[i] = 0;
+	}
+	x[i] = (unsigned int) ((w << shift % 32) & 0xffffffffu);
+	x[i + 1] = (unsigned int) ((w << shift % 32 >> 32) & 0xffffffffu);
+	x[i + 2] = (unsigned int) (shift % 32 ? w >> (64 - shift % 32) : 0);
+	count = i + 3;
+	sticky = 0;
+	for (i = -q; i > 0; i -= n) {
+		n = i < 13 ? i : 13;
+		carry = 0;
+		for (j = count - 1; j >= 0; --j) {
+			carry = carry << 32 | x[j];
+			x[j] = (unsigned int) (carry / _jsish_pow5[n]);
+			carry %= _jsish_pow5[n];
+		}
+		sticky |= carry != 0;
+		while (count > 1 && !x[count - 1]) {
+			count--;
+		}
+	}
+	return _jsish_big_to_double(x, count, q - shift, sticky);
+}
+
+/* Returns the end of the JSON number at S, checked like _jsish_parse_number()
+ * does but without working out its value, or NULL if it is malformed. */
+const char* _jsish_skip_number(const char* s) {
+	s += *s == '-';
+	if (*s == '0') {
+		s++;
+	} else if (*s >= '1' && *s <= '9') {
+		while (*++s >= '0' && *s <= '9') {
+		}
+	} else {
+		return NULL;
+	}
+	if (*s == '.') {
+		if (*++s < '0' || *s > '9') {
+			return NULL;
+		}
+		while (*++s >= '0' && *s <= '9') {
+		}
+	}
+	if (*s == 'e' || *s == 'E') {
+		if (*++s == '-' || *s == '+') {
+			s++;
+		}
+		if (*s < '0' || *s > '9') {
+			return NULL;
+		}
+		while (*++s >= '0' && *s <= '9') {
+		}
+	}
+	return s;
+}
+
+/* Parses the JSON number at S, setting END to where parsing stopped. Numbers
+ * without fraction or exponent are stored as JSISH_INTEGER if INTEGERS is set
+ * and they fit in a jsish_int_t. */
+jsish_result_t _jsish_parse_number(
+		const char* s, const char** end, jsish_value_t* value, int integers) {
+	const char* digits;
+	_jsish_uint_t mantissa;
+	int significant;
+	int exponent;
+	int explicit_exponent;
+	int negative;
+	int negative_exponent;
+	int integral;
+	int truncated;
+	double num;
+	negative = *s == '-';
+	s += negative;
+	digits = s;
+	mantissa = 0;
+	significant = 0;
+	exponent = 0;
+	explicit_exponent = 0;
+	integral = 1;
+	truncated = 0;
+
+	/* Up to 19 significant digits fit in the mantissa. */
+	if (*s == '0') {
+		s++;
+	} else if (*s >= '1' && *s <= '9') {
+		for (; *s >= '0' && *s <= '9'; ++s) {
+			if (significant < 19) {
+				mantissa = mantissa * 10 + (unsigned int) (*s - '0');
+				significant++;
+			} else {
+				exponent++;
+				truncated |= *s != '0';
+			}
+		}
+	} else {
+		*end = s;
+		return JSISH_ERR_MALFORMED;
+	}
+
+	if (*s == '.') {
+		integral = 0;
+		if (*++s < '0' || *s > '9') {
+			*end = s;
+			return JSISH_ERR_MALFORMED;
+		}
+		for (; *s >= '0' && *s <= '9'; ++s) {
+			if (significant < 19) {
+				mantissa = mantissa * 10 + (unsigned int) (*s - '0');
+				exponent--;
+				significant += mantissa != 0;
+			} else {
+				truncated |= *s != '0';
+			}
+		}
+	}
+
+	if (*s == 'e' || *s == 'E') {
+		integral = 0;
+		negative_exponent = *++s == '-';
+		if (*s == '-' || *s == '+') {
+			s++;
+		}
+		if (*s < '0' || *s > '9') {
+			*end = s;
+			return JSISH_ERR_MALFORMED;
+		}
+		for (; *s >= '0' && *s <= '9'; ++s) {
+			/* Anything this large is zero or infinity anyway. */
+			if (explicit_exponent < 100000) {
+				explicit_exponent = explicit_exponent * 10 + (*s - '0');
+			}
+		}
+		if (negative_exponent) {
+			explicit_exponent = -explicit_exponent;
+		}
+		exponent += explicit_exponent;
+	}
+	*end = s;
+
+	if (integers && integral && exponent == 0
+			&& mantissa <= ((_jsish_uint_t) 1 << 63) - !negative) {
+		value->type = JSISH_INTEGER;
+		value->data.vint = negative
+			? -(jsish_int_t) (mantissa - 1) - 1
+			: (jsish_int_t) mantissa;
+		return JSISH_OK;
+	}
+
+	if (mantissa == 0) {
+		num = 0.0;
+	} else if (!truncated
+			&& mantissa <= (_jsish_uint_t) 1 << 53
+			&& exponent >= -22
+			&& exponent <= 22) {
+		/* Both operands are exact, so a single rounding gives the correctly
+		 * rounded result (Clinger's fast path). */
+		num = (double) mantissa;
+		num = exponent < 0
+			? num / _jsish_pow10[-exponent]
+			: num * _jsish_pow10[exponent];
+	} else if (!truncated) {
+		num = _jsish_exact_to_double(mantissa, exponent);
+	} else {
+		/* The dropped digits only matter if they could change the result. */
+		num = _jsish_exact_to_double(mantissa, exponent);
+		if (num != _jsish_exact_to_double(mantissa + 1, exponent)) {
+			num = _jsish_decimal_to_double(digits, explicit_exponent);
+		}
+	}
+
+	value->type = JSISH_NUMBER;
+	value->data.vnum = negative ? -num : num;
+
+	return JSISH_OK;
+}
+
+jsish_result_t
+_jsish_decode_number(jsish_decoder_t* decoder, jsish_value_t* value) {
+	const char* end;
+	jsish_result_t result;
+	result = _jsish_parse_number(
+			&decoder->source[decoder->cursor],
+			&end,
+			value,
+			decoder->flags & JSISH_INTEGERS);
+
+	/* A number running into the end of the input may continue in the next
+	 * chunk. */
+	if (*end == '\0' && _JSISH_AWAITS_INPUT(
+			decoder, (unsigned int) (end - decoder->source))) {
+		return JSISH_INCOMPLETE;
+	}
+	if (result == JSISH_OK) {
+		decoder->cursor = (unsigned int) (end - decoder->source);
+	}
+
+	return result;
+}
+
+jsish_result_t
+_jsish_decode_literal(jsish_decoder_t* decoder, const char* literal) {
+	const char* s;
+	unsigned int i;
+	s = &decoder->source[decoder->cursor];
+	for (i = 0; literal[i] != '\0'; ++i) {
+		if (s[i] != literal[i]) {
+			if (s[i] == '\0'
+					&& _JSISH_AWAITS_INPUT(decoder, decoder->cursor + i)) {
+				return JSISH_INCOMPLETE;
+			}
+			return JSISH_ERR_MALFORMED;
+		}
+	}
+	decoder->cursor += i;
+	return JSISH_OK;
+}
+
+jsish_result_t
+_jsish_decode_bool(jsish_decoder_t* decoder, jsish_value_t* value) {
+	jsish_result_t result;
+	if (decoder->source[decoder->cursor] == 'f') {
+		result = _jsish_decode_literal(decoder, "false");
+		value->data.vbool = 0;
+	} else {
+		result = _jsish_decode_literal(decoder, "true");
+		value->data.vbool = 1;
+	}
+	value->type = JSISH_BOOL;
+
+	return result;
+}
+
+jsish_result_t
+_jsish_decode_null(jsish_decoder_t* decoder, jsish_value_t* value) {
+	value->type = JSISH_NULL;
+	return _jsish_decode_literal(decoder, "null");
+}
+
+/* Decoder states, i.e. what kind of token is expected next. */
+#define _JSISH_EXPECT_VALUE 0
+#define _JSISH_EXPECT_ELEMENT 1 /* A value or ']' after '['. */
+#define _JSISH_EXPECT_MEMBER 2 /* A key or '}' after '{'. */
+#define _JSISH_EXPECT_KEY 3
+#define _JSISH_EXPECT_COLON 4
+#define _JSISH_EXPECT_ARRAY_SEP 5
+#define _JSISH_EXPECT_OBJECT_SEP 6
+#define _JSISH_DONE 7
+
+/* Arrays and objects that are still open are tracked by frames on the stack at
+ * the top of the values memory, so nesting depth costs no C stack. A frame's
+ * type is that of the container, its array size is the index of the enclosing
+ * frame (0 for none) and its elements pointer points to the array or object
+ * value being decoded. The elements of an open array, or the keys and values
+ * of an open object, are pushed onto the stack right below its frame. */
+jsish_result_t _jsish_push_frame(
+		jsish_decoder_t* decoder, jsish_type_t type, jsish_value_t* value) {
+	jsish_value_t* frame;
+	if (decoder->max_depth && decoder->depth == decoder->max_depth) {
+		return JSISH_ERR_DEPTH;
+	}
+	frame = _jsish_alloc_fifo(decoder);
+	if (!frame) {
+		return JSISH_ERR_MEM_OVERFLOW;
+	}
+	frame->type = type;
+	JSISH_ARRAY_SIZE(frame) = decoder->frame;
+	_JSISH_ELEMENTS(frame) = value;
+	decoder->frame = decoder->stack_cursor + 1;
+	decoder->depth++;
+	_JSISH_STAT_MAX(decoder, max_depth, decoder->depth);
+
+	return JSISH_OK;
+}
+
+/* Returns where the next value in the current container is to be stored. */
+jsish_value_t* _jsish_next_value(jsish_decoder_t* decoder) {
+	if (!decoder->frame) {
+		return &decoder->root;
+	}
+
+	return _jsish_alloc_fifo(decoder);
+}
+
+/* Moves on to what may follow a completed value. */
+void _jsish_end_value(jsish_decoder_t* decoder) {
+	if (!decoder->frame) {
+		decoder->state = _JSISH_DONE;
+	} else if (decoder->values[decoder->frame].type == JSISH_ARRAY) {
+		decoder->state = _JSISH_EXPECT_ARRAY_SEP;
+	} else {
+		decoder->state = _JSISH_EXPECT_OBJECT_SEP;
+	}
+}
+
+/* Pops the innermost frame, which must be that of an array or object that has
+ * just been closed. */
+void _jsish_pop_frame(jsish_decoder_t* decoder) {
+	unsigned int frame;
+	frame = decoder->frame;
+	decoder->frame = JSISH_ARRAY_SIZE(&decoder->values[frame]);
+	decoder->depth--;
+	decoder->stack_cursor = frame;
+	/* Account for the closing bracket. */
+	decoder->cursor++;
+	_jsish_end_value(decoder);
+}
+
+jsish_result_t _jsish_close_array(jsish_decoder_t* decoder) {
+	jsish_value_t* array;
+	jsish_value_t* elements;
+	unsigned int size;
+	unsigned int i;
+	size = decoder->frame - decoder->stack_cursor - 1;
+	elements = NULL;
+	if (size) {
+		elements = _jsish_alloc_values(decoder, size);
+		if (!elements) {
+			return JSISH_ERR_MEM_OVERFLOW;
+		}
+	}
+
+	/* Read array elements in FIFO order from the stack and copy them so they
+	 * are contiguous. The array itself may be on the stack, which the
+	 * allocation can have moved. */
+	array = _JSISH_ELEMENTS(&decoder->values[decoder->frame]);
+	for (i = 0; i < size; ++i) {
+		elements[i] = decoder->values[decoder->frame - 1 - i];
+	}
+	_JSISH_ELEMENTS(array) = elements;
+	JSISH_ARRAY_SIZE(array) = size;
+
+	_jsish_pop_frame(decoder);
+
+	return JSISH_OK;
+}
+
+/* Number of values taken up by each member of an object. */
+#ifdef JSISH_COMPACT
+#define _JSISH_MEMBER_VALUES 2
+#else
+#define _JSISH_MEMBER_VALUES 3
+#endif
+
+/* Sorts SIZE members, each a key followed by its value, by key. Runs of eight
+ * are sorted by insertion and then merged back and forth between MEMBERS and
+ * SCRATCH, which has room for as many values; both keep equal keys in order. */
+void _jsish_sort_members(
+		jsish_value_t* members, jsish_value_t* scratch, unsigned int size) {
+	jsish_value_t* from;
+	jsish_value_t* to;
+	jsish_value_t* swap;
+	jsish_value_t key;
+	jsish_value_t value;
+	unsigned int width;
+	unsigned int start;
+	unsigned int middle;
+	unsigned int end;
+	unsigned int i;
+	unsigned int j;
+	unsigned int k;
+	for (start = 0; start < size; start += 8) {
+		end = start + 8 < size ? start + 8 : size;
+		for (i = start + 1; i < end; ++i) {
+			key = members[i * 2];
+			value = members[i * 2 + 1];
+			for (j = i; j > start && JSISH_STRCMP(
+						members[j * 2 - 2].data.vstr, key.data.vstr) > 0; --j) {
+				members[j * 2] = members[j * 2 - 2];
+				members[j * 2 + 1] = members[j * 2 - 1];
+			}
+			members[j * 2] = key;
+			members[j * 2 + 1] = value;
+		}
+	}
+
+	from = members;
+	to = scratch;
+	for (width = 8; width < size; width *= 2) {
+		for (start = 0; start < size; start += width * 2) {
+			middle = start + width < size ? start + width : size;
+			end = middle + width < size ? middle + width : size;
+			i = start;
+			j = middle;
+			for (k = start; k < end; ++k) {
+				if (j == end || (i < middle && JSISH_STRCMP(
+							from[i * 2].data.vstr,
+							from[j * 2].data.vstr) <= 0)) {
+					to[k * 2] = from[i * 2];
+					to[k * 2 + 1] = from[i * 2 + 1];
+					i++;
+				} else {
+					to[k * 2] = from[j * 2];
+					to[k * 2 + 1] = from[j * 2 + 1];
+					j++;
+				}
+			}
+		}
+		swap = from;
+		from = to;
+		to = swap;
+	}
+	if (from != members) {
+		JSISH_MEMCPY(members, from, size * 2 * sizeof(jsish_value_t));
+	}
+}
+
+/* Stores the SIZE keys and values at MEMBERS, one after another, in OBJECT.
+ * Outside the compact layout, each member then gets a JSISH_PAIR value in
+ * front of its key and value, linked to the next one. SIZE may carry
+ * _JSISH_SORTED. */
+void _jsish_link_members(
+		jsish_value_t* object, jsish_value_t* members, unsigned int size) {
+#ifndef JSISH_COMPACT
+	jsish_value_t* pair;
+#endif
+	unsigned int i;
+	JSISH_KV_FIRST(object) = size ? members : NULL;
+#ifdef JSISH_COMPACT
+	object->size = size;
+	size = JSISH_OBJECT_SIZE(object);
+	/* Each key counts the members after it, for JSISH_KV_NEXT(). */
+	for (i = 0; i < size; ++i) {
+		members[i * 2].size = size - 1 - i;
+	}
+#else
+	object->data.vmap.size = size;
+	size = JSISH_OBJECT_SIZE(object);
+	/* Spread the keys and values out from the end to make room for the pairs
+	 * in front of them. */
+	for (i = size; i-- > 0;) {
+		members[i * 3 + 2] = members[i * 2 + 1];
+		members[i * 3 + 1] = members[i * 2];
+		pair = &members[i * 3];
+		pair->type = JSISH_PAIR;
+		pair->data.vobj.key = pair + 1;
+		pair->data.vobj.value = pair + 2;
+		pair->data.vobj.next = i + 1 < size ? pair + 3 : NULL;
+	}
+#endif
+}
+
+/* Moves the SIZE keys and values pushed onto the stack for the innermost frame
+ * into OBJECT, at MEMBERS, so that they are contiguous like the elements of an
+ * array. */
+void _jsish_gather_members(
+		jsish_decoder_t* decoder,
+		jsish_value_t* object,
+		jsish_value_t* members,
+		unsigned int size) {
+	unsigned int i;
+	if (!size) {
+		return;
+	}
+	for (i = 0; i < size * 2; ++i) {
+		members[i] = decoder->values[decoder->frame - 1 - i];
+	}
+
+	/* The stack they were copied from is free to sort with. */
+	if ((decoder->flags & JSISH_SORT_KEYS) && size > 1) {
+		_jsish_sort_members(
+				members, &decoder->values[decoder->stack_cursor + 1], size);
+		size |= _JSISH_SORTED;
+	}
+	_jsish_link_members(object, members, size);
+}
+
+void jsish_init_object(
+		jsish_value_t* object, jsish_value_t* members, unsigned int size) {
+	object->type = JSISH_KEYVAL;
+#ifndef JSISH_COMPACT
+	object->data.vmap.index = NULL;
+#endif
+	_jsish_link_members(object, members, size);
+}
+
+/* 32-bit FNV-1a. */
+#define _JSISH_HASH_BASIS 2166136261u
+#define _JSISH_HASH_STEP(HASH, C) (((HASH) ^ (unsigned char) (C)) * 16777619u)
+
+unsigned int _jsish_hash(const char* key) {
+	unsigned int hash;
+	hash = _JSISH_HASH_BASIS;
+	while (*key) {
+		hash = _JSISH_HASH_STEP(hash, *key++);
+	}
+	/* Zero marks an empty slot. */
+	return hash ? hash : 1;
+}
+
+/* A slot in the hash table of an object: the hash of a key and the distance
+ * from the table back to its key-value pair, in values. */
+typedef struct {
+	unsigned int hash;
+	unsigned int pair;
+} _jsish_index_slot_t;
+
+/* Number of table slots for an object of the given size, a power of two. */
+unsigned int _jsish_index_capacity(unsigned int size) {
+	unsigned int capacity;
+	capacity = 1;
+	while (capacity < size * 2) {
+		capacity <<= 1;
+	}
+	return capacity;
+}
+
+/* Number of values taken up by the hash table of an object of the given size.
+ */
+unsigned int _jsish_index_values(unsigned int size) {
+	return (unsigned int) ((_jsish_index_capacity(size)
+				* sizeof(_jsish_index_slot_t) + sizeof(jsish_value_t) - 1)
+			/ sizeof(jsish_value_t));
+}
+
+/* Builds the hash table of OBJECT in the values at INDEX, which in the compact
+ * layout are right after the last member. */
+void _jsish_index_object(jsish_value_t* object, jsish_value_t* index) {
+	unsigned int capacity;
+	unsigned int hash;
+	unsigned int i;
+	jsish_value_t* pair;
+	_jsish_index_slot_t* table;
+	capacity = _jsish_index_capacity(JSISH_OBJECT_SIZE(object));
+	table = (_jsish_index_slot_t*) index;
+	for (i = 0; i < capacity; ++i) {
+		table[i].hash = 0;
+	}
+
+	/* Open addressing with linear probing. */
+	for (pair = JSISH_KV_FIRST(object); pair; pair = JSISH_KV_NEXT(pair)) {
+		hash = _jsish_hash(JSISH_KV_KEY(pair));
+		i = hash & (capacity - 1);
+		while (table[i].hash) {
+			i = (i + 1) & (capacity - 1);
+		}
+		table[i].hash = hash;
+		table[i].pair = (unsigned int) (index - pair);
+	}
+#ifdef JSISH_COMPACT
+	object->size |= _JSISH_INDEXED;
+#else
+	object->data.vmap.index = index;
+#endif
+}
+
+jsish_result_t _jsish_close_object(jsish_decoder_t* decoder) {
+	jsish_value_t* object;
+	jsish_value_t* members;
+	unsigned int size;
+	unsigned int index;
+	size = (decoder->frame - decoder->stack_cursor - 1) / 2;
+	index = size
+			&& (decoder->flags & JSISH_INDEX_KEYS)
+			&& size >= JSISH_INDEX_MIN_KEYS
+		? _jsish_index_values(size)
+		: 0;
+	members = NULL;
+	if (size) {
+		/* The members and hash table in one go, as they have to be in the
+		 * same block. */
+		members = _jsish_alloc_values(
+				decoder, size * _JSISH_MEMBER_VALUES + index);
+		if (!members) {
+			return JSISH_ERR_MEM_OVERFLOW;
+		}
+	}
+
+	/* Only now, as the object may be on the stack, which the allocation can
+	 * have moved. */
+	object = _JSISH_ELEMENTS(&decoder->values[decoder->frame]);
+	_jsish_gather_members(decoder, object, members, size);
+	if (index) {
+		_jsish_index_object(object, members + size * _JSISH_MEMBER_VALUES);
+	}
+
+	_jsish_pop_frame(decoder);
+
+	return JSISH_OK;
+}
+
+jsish_result_t _jsish_decode_key(jsish_decoder_t* decoder) {
+	jsish_value_t key;
+	jsish_value_t* pair;
+	jsish_result_t result;
+	result = _jsish_decode_string(decoder, &key);
+	if (result != JSISH_OK) {
+		return result;
+	}
+
+	/* The key goes onto the stack, and its value right after it. */
+	pair = _jsish_alloc_fifo(decoder);
+	if (!pair) {
+		return JSISH_ERR_MEM_OVERFLOW;
+	}
+	pair->type = key.type;
+	pair->data.vstr = key.data.vstr;
+	_JSISH_STAT_ADD(decoder, values[JSISH_PAIR], 1);
+
+	decoder->state = _JSISH_EXPECT_COLON;
+
+	return JSISH_OK;
+}
+
+jsish_result_t _jsish_decode_value(jsish_decoder_t* decoder, char c) {
+	jsish_value_t scalar;
+	jsish_value_t* value;
+	jsish_result_t result;
+	switch (c) {
+		case '"':
+			result = _jsish_decode_string(decoder, &scalar);
+			break;
+		case '-': case '0': case '1': case '2': case '3': case '4': case '5':
+		case '6': case '7': case '8': case '9':
+			result = _jsish_decode_number(decoder, &scalar);
+			break;
+		case 't': case 'f':
+			result = _jsish_decode_bool(decoder, &scalar);
+			break;
+		case 'n':
+			result = _jsish_decode_null(decoder, &scalar);
+			break;
+		case '[': case '{':
+			/* Room for the value and its frame, so that the stack cannot
+			 * move to a new block in between. */
+			if (!_jsish_room(decoder, 2)) {
+				return JSISH_ERR_MEM_OVERFLOW;
+			}
+			value = _jsish_next_value(decoder);
+#ifdef JSISH_COMPACT
+			value->type = c == '[' ? JSISH_ARRAY : JSISH_KEYVAL;
+			_JSISH_CLEAR(value);
+#else
+			if (c == '[') {
+				value->type = JSISH_ARRAY;
+				value->data.varr.size = 0;
+				value->data.varr.data = NULL;
+			} else {
+				value->type = JSISH_KEYVAL;
+				value->data.vmap.size = 0;
+				value->data.vmap.pairs = NULL;
+				value->data.vmap.index = NULL;
+			}
+#endif
+			_JSISH_STAT_ADD(decoder, values[value->type], 1);
+			decoder->cursor++;
+			decoder->state = c == '['
+				? _JSISH_EXPECT_ELEMENT
+				: _JSISH_EXPECT_MEMBER;
+			return _jsish_push_frame(decoder, value->type, value);
+		default:
+			return JSISH_ERR_MALFORMED;
+	}
+	if (result != JSISH_OK) {
+		return result;
+	}
+
+	/* Scalars are only given a place once they have been fully read, so that
+	 * an incomplete token can be retried when more input arrives. */
+	value = _jsish_next_value(decoder);
+	if (!value) {
+		return JSISH_ERR_MEM_OVERFLOW;
+	}
+#ifdef JSISH_COMPACT
+	scalar.size = 0;
+#endif
+	*value = scalar;
+	_JSISH_STAT_ADD(decoder, values[scalar.type], 1);
+	_jsish_end_value(decoder);
+
+	return JSISH_OK;
+}
+
+jsish_result_t _jsish_decode_tokens(jsish_decoder_t* decoder) {
+	char c;
+	jsish_result_t result;
+	for (;;) {
+		/* Stop right after the root value, like two-stage decoding. */
+		if (decoder->state == _JSISH_DONE) {
+			return JSISH_OK;
+		}
+		_jsish_skip_whitespace(decoder);
+		c = decoder->source[decoder->cursor];
+		if (c == '\0') {
+			return _JSISH_AWAITS_INPUT(decoder, decoder->cursor)
+				? JSISH_INCOMPLETE
+				: JSISH_ERR_MALFORMED;
+		}
+
+		switch (decoder->state) {
+			case _JSISH_EXPECT_ELEMENT:
+				if (c == ']') {
+					result = _jsish_close_array(decoder);
+					break;
+				}
+				/* Fall through. */
+			case _JSISH_EXPECT_VALUE:
+				result = _jsish_decode_value(decoder, c);
+				break;
+			case _JSISH_EXPECT_MEMBER:
+				if (c == '}') {
+					result = _jsish_close_object(decoder);
+					break;
+				}
+				/* Fall through. */
+			case _JSISH_EXPECT_KEY:
+				result = _jsish_decode_key(decoder);
+				break;
+			case _JSISH_EXPECT_COLON:
+				if (c != ':') {
+					return JSISH_ERR_MALFORMED;
+				}
+				decoder->cursor++;
+				decoder->state = _JSISH_EXPECT_VALUE;
+				result = JSISH_OK;
+				break;
+			case _JSISH_EXPECT_ARRAY_SEP:
+				if (c == ']') {
+					result = _jsish_close_array(decoder);
+				} else if (c == ',') {
+					decoder->cursor++;
+					decoder->state = _JSISH_EXPECT_VALUE;
+					result = JSISH_OK;
+				} else {
+					return JSISH_ERR_MALFORMED;
+				}
+				break;
+			default: /* _JSISH_EXPECT_OBJECT_SEP */
+				if (c == '}') {
+					result = _jsish_close_object(decoder);
+				} else if (c == ',') {
+					decoder->cursor++;
+					decoder->state = _JSISH_EXPECT_KEY;
+					result = JSISH_OK;
+				} else {
+					return JSISH_ERR_MALFORMED;
+				}
+				break;
+		}
+		if (result != JSISH_OK) {
+			return result;
+		}
+	}
+}
+
+void _jsish_begin_decode(jsish_decoder_t* decoder, char* source) {
+	decoder->source = source;
+	decoder->cursor = 0;
+	decoder->source_length = 0;
+	decoder->frame = 0;
+	decoder->depth = 0;
+	decoder->state = _JSISH_EXPECT_VALUE;
+	decoder->resume = 0;
+	decoder->final = 0;
+	decoder->structurals = NULL;
+	decoder->revisit = 0;
+	decoder->root.type = JSISH_NULL;
+	_JSISH_STAT_RESET(decoder);
+}
+
+/* Records how far decoding got from START, and ends the phase with RESULT,
+ * which is returned. */
+jsish_result_t _jsish_end_decode(
+		jsish_decoder_t* decoder, unsigned int start, jsish_result_t result) {
+#ifdef JSISH_STATS
+	decoder->stats.bytes = decoder->cursor - start;
+#else
+	(void) decoder;
+	(void) start;
+#endif
+	JSISH_END_PHASE(JSISH_PHASE_DECODE, result, _JSISH_STATS(decoder));
+	return result;
+}
+
+jsish_result_t jsish_decode(jsish_decoder_t* decoder, char* source) {
+	JSISH_BEGIN_PHASE(JSISH_PHASE_DECODE);
+	_jsish_begin_decode(decoder, source);
+	decoder->final = 1;
+	return _jsish_end_decode(decoder, 0, _jsish_decode_tokens(decoder));
+}
+
+/* Returns the position just past the string starting at POS, checked like
+ * _jsish_decode_string() does with the decoder flags given, or 0 if it is
+ * malformed. */
+unsigned int _jsish_measure_string(
+		const char* s, unsigned int pos, unsigned int flags) {
+	unsigned int start;
+	char c;
+	int i;
+	start = pos;
+	for (;;) {
+#ifdef JSISH_SIMD_WIDTH
+		pos = (unsigned int) (_jsish_scan_string(&s[pos + 1]) - s);
+#else
+		++pos;
+#endif
+		switch (s[pos]) {
+			case '"':
+				if ((flags & JSISH_VALIDATE_UTF8)
+						&& !_jsish_valid_utf8(&s[start + 1], &s[pos])) {
+					return 0;
+				}
+				return pos + 1;
+			case '\\':
+				switch (s[++pos]) {
+					case '\\': case '/': case '"': case 'b': case 'f': case 't':
+					case 'n': case 'r':
+						break;
+					case 'u':
+						for (i = 0; i < 4; ++i) {
+							c = s[++pos];
+							if (!_jsish_is_hex_digit(c)) {
+								return 0;
+							}
+						}
+						break;
+					default:
+						return 0;
+				}
+				break;
+			case '\0': case '\n': case '\r':
+				return 0;
+			default:
+				break;
+		}
+	}
+}
+
+jsish_result_t jsish_measure(
+		const char* source,
+		unsigned int flags,
+		unsigned int* values_needed,
+		unsigned int* max_depth) {
+	unsigned int open[JSISH_MAX_DEPTH];
+	return jsish_measure_ex(
+			source, flags, values_needed, max_depth, open, JSISH_MAX_DEPTH);
+}
+
+/* OPEN holds, for each open container, twice the number of values it has
+ * pushed onto the stack, plus one for an object. */
+jsish_result_t jsish_measure_ex(
+		const char* source,
+		unsigned int flags,
+		unsigned int* values_needed,
+		unsigned int* max_depth,
+		unsigned int* open,
+		unsigned int open_size) {
+	unsigned int depth;
+	unsigned int deepest;
+	unsigned int values;
+	unsigned int stack;
+	unsigned int needed;
+	unsigned int count;
+	unsigned int state;
+	unsigned int pos;
+	unsigned int start;
+	unsigned int i;
+	const char* literal;
+	const char* end;
+	jsish_value_t number;
+	char c;
+	depth = 0;
+	deepest = 0;
+	values = 0;
+	stack = 0;
+	needed = 0;
+	state = _JSISH_EXPECT_VALUE;
+	pos = 0;
+
+	/* Follows _jsish_decode_tokens() through the document, keeping count of
+	 * the values and stack the decoder would use instead of storing anything.
+	 * Whenever _jsish_room() would be asked for N values, it takes a pool of
+	 * at least the values and stack in use plus N plus 2. */
+	while (state != _JSISH_DONE) {
+		pos = _jsish_whitespace_end(source, pos);
+		c = source[pos];
+		if (c == '\0') {
+			return JSISH_ERR_MALFORMED;
+		}
+
+		switch (state) {
+			case _JSISH_EXPECT_COLON:
+				if (c != ':') {
+					return JSISH_ERR_MALFORMED;
+				}
+				pos++;
+				state = _JSISH_EXPECT_VALUE;
+				continue;
+			case _JSISH_EXPECT_ARRAY_SEP:
+			case _JSISH_EXPECT_OBJECT_SEP:
+				if (c == ',') {
+					pos++;
+					state = state == _JSISH_EXPECT_ARRAY_SEP
+						? _JSISH_EXPECT_VALUE
+						: _JSISH_EXPECT_KEY;
+					continue;
+				}
+				/* Fall through. */
+			case _JSISH_EXPECT_ELEMENT:
+			case _JSISH_EXPECT_MEMBER:
+				if (c == (state == _JSISH_EXPECT_ARRAY_SEP
+							|| state == _JSISH_EXPECT_ELEMENT ? ']' : '}')) {
+					count = open[--depth] >> 1;
+					if (open[depth] & 1) {
+						/* Members and hash table, see _jsish_close_object(). */
+						i = (flags & JSISH_INDEX_KEYS)
+								&& count
+								&& count / 2 >= JSISH_INDEX_MIN_KEYS
+							? _jsish_index_values(count / 2)
+							: 0;
+						i += count / 2 * _JSISH_MEMBER_VALUES;
+					} else {
+						i = count;
+					}
+					if (count && values + stack + i + 2 > needed) {
+						needed = values + stack + i + 2;
+					}
+					values += i;
+					stack -= count + 1;
+					pos++;
+					state = !depth ? _JSISH_DONE
+						: open[depth - 1] & 1 ? _JSISH_EXPECT_OBJECT_SEP
+						: _JSISH_EXPECT_ARRAY_SEP;
+					continue;
+				}
+				if (state == _JSISH_EXPECT_ARRAY_SEP
+						|| state == _JSISH_EXPECT_OBJECT_SEP) {
+					return JSISH_ERR_MALFORMED;
+				}
+				if (state == _JSISH_EXPECT_ELEMENT) {
+					break;
+				}
+				/* Fall through. */
+			case _JSISH_EXPECT_KEY:
+				if (c != '"') {
+					return JSISH_ERR_MALFORMED;
+				}
+				start = pos;
+				pos = _jsish_measure_string(source, pos, flags);
+				if (!pos) {
+					return JSISH_ERR_MALFORMED;
+				}
+				if (flags & JSISH_COPY_STRINGS) {
+					i = _jsish_string_values(pos - start - 2);
+					if (values + stack + i + 2 > needed) {
+						needed = values + stack + i + 2;
+					}
+					values += i;
+				}
+				if (values + stack + 3 > needed) {
+					needed = values + stack + 3;
+				}
+				stack++;
+				open[depth - 1] += 2;
+				state = _JSISH_EXPECT_COLON;
+				continue;
+			default: /* _JSISH_EXPECT_VALUE */
+				break;
+		}
+
+		literal = NULL;
+		switch (c) {
+			case '"':
+				start = pos;
+				pos = _jsish_measure_string(source, pos, flags);
+				if (!pos) {
+					return JSISH_ERR_MALFORMED;
+				}
+				if (flags & JSISH_COPY_STRINGS) {
+					i = _jsish_string_values(pos - start - 2);
+					if (values + stack + i + 2 > needed) {
+						needed = values + stack + i + 2;
+					}
+					values += i;
+				}
+				break;
+			case '-': case '0': case '1': case '2': case '3': case '4': case '5':
+			case '6': case '7': case '8': case '9':
+				if (_jsish_parse_number(&source[pos], &end, &number, 0)
+						!= JSISH_OK) {
+					return JSISH_ERR_MALFORMED;
+				}
+				pos = (unsigned int) (end - source);
+				break;
+			case 't':
+				literal = "true";
+				break;
+			case 'f':
+				literal = "false";
+				break;
+			case 'n':
+				literal = "null";
+				break;
+			case '[': case '{':
+				if (depth == open_size) {
+					return JSISH_ERR_DEPTH;
+				}
+				/* The value and its frame. */
+				if (values + stack + 4 > needed) {
+					needed = values + stack + 4;
+				}
+				if (depth) {
+					stack++;
+					open[depth - 1] += 2;
+				}
+				stack++;
+				open[depth++] = c == '{';
+				if (depth > deepest) {
+					deepest = depth;
+				}
+				pos++;
+				state = c == '['
+					? _JSISH_EXPECT_ELEMENT
+					: _JSISH_EXPECT_MEMBER;
+				continue;
+			default:
+				return JSISH_ERR_MALFORMED;
+		}
+		if (literal) {
+			for (i = 0; literal[i] != '\0'; ++i) {
+				if (source[pos + i] != literal[i]) {
+					return JSISH_ERR_MALFORMED;
+				}
+			}
+			pos += i;
+		}
+
+		if (!depth) {
+			state = _JSISH_DONE;
+			continue;
+		}
+		if (values + stack + 3 > needed) {
+			needed = values + stack + 3;
+		}
+		stack++;
+		open[depth - 1] += 2;
+		state = open[depth - 1] & 1
+			? _JSISH_EXPECT_OBJECT_SEP
+			: _JSISH_EXPECT_ARRAY_SEP;
+	}
+
+	*values_needed = needed;
+	*max_depth = deepest;
+
+	return JSISH_OK;
+}
+
+/* Moves the cursor to the next recorded position and returns the character
+ * there, or a zero at the end of the source. */
+char _jsish_next_structural(jsish_decoder_t* decoder) {
+	decoder->cursor = _jsish_peek_structural(decoder);
+	decoder->structural++;
+	return decoder->cursor == decoder->source_length
+		? '\0'
+		: decoder->source[decoder->cursor];
+}
+
+/* Longest number or literal running up to the end of the source that
+ * _jsish_decode_indexed_scalar() copies on the C stack rather than into the
+ * values memory. */
+#define _JSISH_LAST_TOKEN 64
+
+/* Decodes the number or literal at the cursor for two-stage decoding. One that
+ * runs up to the end of the source is read from a terminated copy, as the
+ * source need not be terminated, see jsish_decode_const(). */
+jsish_result_t _jsish_decode_indexed_scalar(
+		jsish_decoder_t* decoder, char c, jsish_value_t* value) {
+	char last[_JSISH_LAST_TOKEN];
+	char* source;
+	char* copy;
+	unsigned int start;
+	unsigned int length;
+	unsigned int count;
+	jsish_result_t result;
+	source = decoder->source;
+	copy = NULL;
+	start = 0;
+	count = 0;
+	if (_jsish_peek_structural(decoder) == decoder->source_length) {
+		start = decoder->cursor;
+		length = decoder->source_length - start;
+		copy = last;
+		if (length >= _JSISH_LAST_TOKEN) {
+			/* Only for a long number, and given back right after. */
+			count = _jsish_string_values(length);
+			copy = (char*) _jsish_alloc_values(decoder, count);
+			if (!copy) {
+				return JSISH_ERR_MEM_OVERFLOW;
+			}
+		}
+		JSISH_MEMCPY(copy, &source[start], length);
+		copy[length] = '\0';
+		decoder->source = copy;
+		decoder->cursor = 0;
+	}
+
+	switch (c) {
+		case 't': case 'f':
+			result = _jsish_decode_bool(decoder, value);
+			break;
+		case 'n':
+			result = _jsish_decode_null(decoder, value);
+			break;
+		default:
+			result = _jsish_decode_number(decoder, value);
+			break;
+	}
+
+	if (copy) {
+		decoder->source = source;
+		decoder->cursor += start;
+		decoder->values_cursor -= count;
+	}
+
+	return result;
+}
+
+/* Second stage of jsish_decode_indexed(), building the tree from the recorded
+ * positions. Rather than dispatching on decoder->state for each token as
+ * _jsish_decode_tokens() does, the position in the grammar is kept by where
+ * in the code the loop is, which makes for far more predictable branches.
+ * Open containers are tracked by frames on the values stack all the same. */
+jsish_result_t _jsish_build_indexed(jsish_decoder_t* decoder) {
+	jsish_value_t scalar;
+	jsish_value_t* value;
+	jsish_result_t result;
+	char c;
+	c = _jsish_next_structural(decoder);
+
+value:
+	switch (c) {
+		case '"':
+			result = _jsish_decode_indexed_string(decoder, &scalar);
+			break;
+		case '-': case '0': case '1': case '2': case '3': case '4': case '5':
+		case '6': case '7': case '8': case '9': case 't': case 'f': case 'n':
+			result = _jsish_decode_indexed_scalar(decoder, c, &scalar);
+			break;
+		case '[': case '{':
+			result = _jsish_decode_value(decoder, c);
+			if (result != JSISH_OK) {
+				return result;
+			}
+			c = _jsish_next_structural(decoder);
+			if (decoder->values[decoder->frame].type == JSISH_ARRAY) {
+				if (c == ']') {
+					goto array_end;
+				}
+				goto value;
+			}
+			if (c == '}') {
+				goto object_end;
+			}
+			goto key;
+		default:
+			return JSISH_ERR_MALFORMED;
+	}
+	if (result != JSISH_OK) {
+		return result;
+	}
+	value = _jsish_next_value(decoder);
+	if (!value) {
+		return JSISH_ERR_MEM_OVERFLOW;
+	}
+#ifdef JSISH_COMPACT
+	scalar.size = 0;
+#endif
+	*value = scalar;
+	_JSISH_STAT_ADD(decoder, values[scalar.type], 1);
+	if (!decoder->frame) {
+		/* Like jsish_decode(), ignore whatever follows the root value. */
+		return JSISH_OK;
+	}
+	/* Numbers and literals end where a string or structural character, which
+	 * would have been recorded, or whitespace follows. */
+	if (decoder->cursor != _jsish_peek_structural(decoder)
+			&& !_jsish_is_whitespace(decoder->source[decoder->cursor])) {
+		return JSISH_ERR_MALFORMED;
+	}
+
+next:
+	c = _jsish_next_structural(decoder);
+	if (decoder->values[decoder->frame].type == JSISH_ARRAY) {
+		if (c == ',') {
+			c = _jsish_next_structural(decoder);
+			goto value;
+		}
+		if (c == ']') {
+			goto array_end;
+		}
+		return JSISH_ERR_MALFORMED;
+	}
+	if (c == '}') {
+		goto object_end;
+	}
+	if (c != ',') {
+		return JSISH_ERR_MALFORMED;
+	}
+	c = _jsish_next_structural(decoder);
+
+key:
+	if (c != '"') {
+		return JSISH_ERR_MALFORMED;
+	}
+	result = _jsish_decode_key(decoder);
+	if (result != JSISH_OK) {
+		return result;
+	}
+	if (_jsish_next_structural(decoder) != ':') {
+		return JSISH_ERR_MALFORMED;
+	}
+	c = _jsish_next_structural(decoder);
+	goto value;
+
+array_end:
+	result = _jsish_close_array(decoder);
+	goto end;
+
+object_end:
+	result = _jsish_close_object(decoder);
+
+end:
+	if (result != JSISH_OK || !decoder->frame) {
+		return result;
+	}
+	goto next;
+}
+
+jsish_result_t _jsish_decode_indexed(
+		jsish_decoder_t* decoder,
+		char* source,
+		unsigned int length,
+		unsigned int* structurals,
+		unsigned int structurals_size) {
+	jsish_result_t result;
+	if (structurals_size <= 64) {
+		return JSISH_ERR_MEM_OVERFLOW;
+	}
+	JSISH_BEGIN_PHASE(JSISH_PHASE_DECODE);
+	_jsish_begin_decode(decoder, source);
+	decoder->final = 1;
+	decoder->source_length = length;
+	decoder->structurals = structurals;
+	decoder->structurals_size = structurals_size;
+	decoder->structurals_count = 0;
+	decoder->structural = 0;
+	decoder->indexed = 0;
+	decoder->index_carry[0] = 0;
+	decoder->index_carry[1] = 0;
+	decoder->index_carry[2] = 0;
+	result = _jsish_build_indexed(decoder);
+	decoder->structurals = NULL;
+
+	return _jsish_end_decode(decoder, 0, result);
+}
+
+jsish_result_t jsish_decode_indexed(
+		jsish_decoder_t* decoder,
+		char* source,
+		unsigned int* structurals,
+		unsigned int structurals_size) {
+	return _jsish_decode_indexed(decoder, source, JSISH_STRLEN(source),
+			structurals, structurals_size);
+}
+
+jsish_result_t jsish_decode_const(
+		jsish_decoder_t* decoder,
+		const char* source,
+		unsigned int length,
+		unsigned int* structurals,
+		unsigned int structurals_size) {
+	unsigned int flags;
+	jsish_result_t result;
+	flags = decoder->flags;
+	decoder->flags |= JSISH_COPY_STRINGS;
+	/* Only read from, with the strings copied. */
+	result = _jsish_decode_indexed(decoder, (char*) source, length,
+			structurals, structurals_size);
+	decoder->flags = flags;
+
+	return result;
+}
+
+/* Returns the position just past the string starting at POS, or 0 if it is
+ * not terminated. A zero before LENGTH is the end quote of a string that has
+ * been decoded already. */
+unsigned int
+_jsish_skip_string(const char* s, unsigned int length, unsigned int pos) {
+	char c;
+	for (;;) {
+#ifdef JSISH_SIMD_WIDTH
+		pos = (unsigned int) (_jsish_scan_string(&s[pos + 1]) - s);
+#else
+		++pos;
+#endif
+		c = s[pos];
+		if (c == '"') {
+			return pos + 1;
+		} else if (c == '\\') {
+			if (s[++pos] == '\0') {
+				return 0;
+			}
+		} else if (c == '\0') {
+			return pos < length ? pos + 1 : 0;
+		}
+	}
+}
+
+/* Returns the position just past the array or object starting at POS, or 0 if
+ * it is not closed. Only brackets and strings are looked at. */
+unsigned int
+_jsish_skip_container(const char* s, unsigned int length, unsigned int pos) {
+	unsigned int depth;
+#ifdef JSISH_SIMD_WIDTH
+	const char* p;
+	char tail[64];
+	unsigned int block;
+	unsigned int i;
+	unsigned int masks[4];
+	_jsish_uint_t quote, backslash, open, close;
+	_jsish_uint_t bits, bit, escaped, in_string, carry[2];
+	/* Work out the extent of strings 64 bytes at a time like the first stage
+	 * of jsish_decode_indexed() does, treating zeros as quotation marks, and
+	 * only look at the brackets of blocks where the depth can reach zero. */
+	depth = 0;
+	carry[0] = carry[1] = 0;
+	for (block = pos; block < length; block += 64) {
+		p = &s[block];
+		if (length - block < 64) {
+			JSISH_MEMCPY(tail, p, length - block);
+			for (i = length - block; i < 64; ++i) {
+				tail[i] = ' ';
+			}
+			p = tail;
+		}
+
+		quote = backslash = open = close = 0;
+		for (i = 0; i < 64; i += JSISH_SIMD_WIDTH) {
+			_jsish_classify_brackets(&p[i], masks);
+			quote |= (_jsish_uint_t) masks[0] << i;
+			backslash |= (_jsish_uint_t) masks[1] << i;
+			open |= (_jsish_uint_t) masks[2] << i;
+			close |= (_jsish_uint_t) masks[3] << i;
+		}
+
+		escaped = carry[0];
+		carry[0] = 0;
+		bits = backslash & ~escaped;
+		while (bits) {
+			bit = bits & (~bits + 1);
+			escaped |= bit << 1;
+			carry[0] = bit >> 63;
+			bits &= ~(bit | bit << 1);
+		}
+		quote &= ~escaped;
+
+		in_string = quote ^ quote << 1;
+		in_string ^= in_string << 2;
+		in_string ^= in_string << 4;
+		in_string ^= in_string << 8;
+		in_string ^= in_string << 16;
+		in_string ^= in_string << 32;
+		in_string ^= carry[1];
+		carry[1] = (_jsish_uint_t) 0 - (in_string >> 63);
+		open &= ~in_string;
+		close &= ~in_string;
+
+		if (_jsish_popcount(close) < depth) {
+			depth += _jsish_popcount(open);
+			depth -= _jsish_popcount(close);
+			continue;
+		}
+		for (bits = open | close; bits; bits &= bits - 1) {
+			if (open & bits & (~bits + 1)) {
+				depth++;
+			} else if (--depth == 0) {
+				return block + _jsish_trailing_zeros(bits) + 1;
+			}
+		}
+	}
+
+	return 0;
+#else
+	depth = 0;
+	for (;;) {
+		switch (s[pos]) {
+			case '[': case '{':
+				depth++;
+				pos++;
+				break;
+			case ']': case '}':
+				pos++;
+				if (--depth == 0) {
+					return pos;
+				}
+				break;
+			case '"':
+				pos = _jsish_skip_string(s, length, pos);
+				if (!pos) {
+					return 0;
+				}
+				break;
+			case '\0':
+				return 0;
+			default:
+				pos++;
+				break;
+		}
+	}
+#endif
+}
+
+/* Returns the position just past the value starting at POS, or 0 if there is
+ * no value there. */
+unsigned int
+_jsish_skip_value(const char* s, unsigned int length, unsigned int pos) {
+	switch (s[pos]) {
+		case '"':
+			return _jsish_skip_string(s, length, pos);
+		case '[': case '{':
+			return _jsish_skip_container(s, length, pos);
+		case ',': case ':': case ']': case '}': case '\0':
+			return 0;
+		default:
+			while (!_jsish_is_whitespace(s[pos])) {
+				switch (s[++pos]) {
+					case ',': case ']': case '}': case '\0':
+						return pos;
+					default:
+						break;
+				}
+			}
+			return pos;
+	}
+}
+
+/* Points CURSOR at the element or member starting at POS in a container opened
+ * with the bracket OPEN. */
+jsish_result_t
+_jsish_cursor_enter(jsish_cursor_t* cursor, char open, unsigned int pos) {
+	const char* s;
+	unsigned int key;
+	s = cursor->source;
+	key = 0;
+	if (open == '{') {
+		if (s[pos] != '"') {
+			return JSISH_ERR_MALFORMED;
+		}
+		key = pos;
+		pos = _jsish_skip_string(s, cursor->length, pos);
+		if (!pos) {
+			return JSISH_ERR_MALFORMED;
+		}
+		pos = _jsish_whitespace_end(s, pos);
+		if (s[pos] != ':') {
+			return JSISH_ERR_MALFORMED;
+		}
+		pos = _jsish_whitespace_end(s, pos + 1);
+	}
+	switch (s[pos]) {
+		case ',': case ':': case ']': case '}': case '\0':
+			return JSISH_ERR_MALFORMED;
+		default:
+			break;
+	}
+	cursor->position = pos;
+	cursor->key = key;
+
+	return JSISH_OK;
+}
+
+jsish_result_t jsish_cursor_init(jsish_cursor_t* cursor, char* source) {
+	cursor->source = source;
+	cursor->length = JSISH_STRLEN(source);
+	cursor->key = 0;
+	cursor->position = _jsish_whitespace_end(source, 0);
+	switch (source[cursor->position]) {
+		case ',': case ':': case ']': case '}': case '\0':
+			return JSISH_ERR_MALFORMED;
+		default:
+			return JSISH_OK;
+	}
+}
+
+jsish_type_t jsish_cursor_type(const jsish_cursor_t* cursor) {
+	switch (cursor->source[cursor->position]) {
+		case '"':
+			return JSISH_STRING;
+		case '[':
+			return JSISH_ARRAY;
+		case '{':
+			return JSISH_KEYVAL;
+		case 't': case 'f':
+			return JSISH_BOOL;
+		case 'n':
+			return JSISH_NULL;
+		default:
+			return JSISH_NUMBER;
+	}
+}
+
+jsish_result_t
+jsish_cursor_first(const jsish_cursor_t* container, jsish_cursor_t* child) {
+	const char* s;
+	unsigned int pos;
+	char open;
+	s = container->source;
+	open = s[container->position];
+	if (open != '[' && open != '{') {
+		return JSISH_NOT_FOUND;
+	}
+	pos = _jsish_whitespace_end(s, container->position + 1);
+	/* The closing bracket comes two characters after the opening one. */
+	if (s[pos] == open + 2) {
+		return JSISH_NOT_FOUND;
+	}
+	child->source = container->source;
+	child->length = container->length;
+
+	return _jsish_cursor_enter(child, open, pos);
+}
+
+jsish_result_t jsish_cursor_next(jsish_cursor_t* child) {
+	const char* s;
+	unsigned int pos;
+	char open;
+	s = child->source;
+	open = child->key ? '{' : '[';
+	pos = _jsish_skip_value(s, child->length, child->position);
+	if (!pos) {
+		return JSISH_ERR_MALFORMED;
+	}
+	pos = _jsish_whitespace_end(s, pos);
+	if (s[pos] == ',') {
+		return _jsish_cursor_enter(
+				child, open, _jsish_whitespace_end(s, pos + 1));
+	} else if (s[pos] == open + 2) {
+		return JSISH_NOT_FOUND;
+	}
+
+	return JSISH_ERR_MALFORMED;
+}
+
+const char* jsish_cursor_key(const jsish_cursor_t* cursor) {
+	unsigned int end;
+	if (!cursor->key) {
+		return NULL;
+	}
+	end = _jsish_skip_string(cursor->source, cursor->length, cursor->key);
+	cursor->source[end - 1] = '\0';
+
+	return &cursor->source[cursor->key + 1];
+}
+
+jsish_result_t jsish_cursor_find(
+		const jsish_cursor_t* object, const char* key, jsish_cursor_t* value) {
+	jsish_result_t result;
+	const char* k;
+	unsigned int length;
+	unsigned int i;
+	if (object->source[object->position] != '{') {
+		return JSISH_NOT_FOUND;
+	}
+	for (result = jsish_cursor_first(object, value);
+			result == JSISH_OK;
+			result = jsish_cursor_next(value)) {
+		/* Keys are compared as they are written in the source. */
+		k = &value->source[value->key + 1];
+		length = _jsish_skip_string(
+				value->source, value->length, value->key) - value->key - 2;
+		for (i = 0; i < length && key[i] == k[i]; ++i);
+		if (i == length && !key[i]) {
+			return JSISH_OK;
+		}
+	}
+
+	return result;
+}
+
+jsish_result_t jsish_cursor_at(
+		const jsish_cursor_t* array, unsigned int index, jsish_cursor_t* element) {
+	jsish_result_t result;
+	if (array->source[array->position] != '[') {
+		return JSISH_NOT_FOUND;
+	}
+	result = jsish_cursor_first(array, element);
+	for (; result == JSISH_OK && index > 0; --index) {
+		result = jsish_cursor_next(element);
+	}
+
+	return result;
+}
+
+jsish_result_t jsish_cursor_decode(
+		const jsish_cursor_t* cursor,
+		jsish_decoder_t* decoder,
+		jsish_value_t** value) {
+	jsish_result_t result;
+	jsish_value_t* decoded;
+	JSISH_BEGIN_PHASE(JSISH_PHASE_DECODE);
+	_jsish_begin_decode(decoder, cursor->source);
+	decoder->cursor = cursor->position;
+	decoder->source_length = cursor->length;
+	decoder->final = 1;
+	decoder->revisit = 1;
+	result = _jsish_end_decode(
+			decoder, cursor->position, _jsish_decode_tokens(decoder));
+	if (result != JSISH_OK) {
+		return result;
+	}
+	/* The root is reset by the next decode, so give the value a place of its
+	 * own. */
+	decoded = _jsish_alloc_value(decoder);
+	if (!decoded) {
+		return JSISH_ERR_MEM_OVERFLOW;
+	}
+	*decoded = decoder->root;
+	*value = decoded;
+
+	return JSISH_OK;
+}
+
+/* Reports the scalar VALUE to the matching callback in EVENTS, returning what
+ * it does. */
+int _jsish_emit_scalar(
+		const jsish_events_t* events, void* user, const jsish_value_t* value) {
+	switch (value->type) {
+		case JSISH_NULL:
+			return events->on_null ? events->on_null(user) : JSISH_CONTINUE;
+		case JSISH_BOOL:
+			return events->on_bool
+				? events->on_bool(user, value->data.vbool)
+				: JSISH_CONTINUE;
+		case JSISH_NUMBER:
+			return events->on_number
+				? events->on_number(user, value->data.vnum)
+				: JSISH_CONTINUE;
+		case JSISH_INTEGER:
+			return events->on_integer
+				? events->on_integer(user, value->data.vint)
+				: JSISH_CONTINUE;
+		default: /* JSISH_STRING, JSISH_RAW_STRING */
+			return events->on_string
+				? events->on_string(user, value->data.vstr,
+						value->type == JSISH_RAW_STRING)
+				: JSISH_CONTINUE;
+	}
+}
+
+/* Follows the same states as _jsish_decode_tokens(), reading scalars with the
+ * decoder's functions for them, but with each open container only kept as its
+ * opening bracket in OPEN, and values reported rather than stored. */
+jsish_result_t _jsish_parse_events(
+		jsish_decoder_t* decoder, const jsish_events_t* events, void* user) {
+	char open[JSISH_MAX_DEPTH];
+	jsish_value_t scalar;
+	jsish_result_t result;
+	unsigned int depth;
+	unsigned int end;
+	int action;
+	int skip;
+	char c;
+	depth = 0;
+	skip = 0;
+	for (;;) {
+		_jsish_skip_whitespace(decoder);
+		c = decoder->source[decoder->cursor];
+		if (c == '\0') {
+			return JSISH_ERR_MALFORMED;
+		}
+
+		switch (decoder->state) {
+			case _JSISH_EXPECT_COLON:
+				if (c != ':') {
+					return JSISH_ERR_MALFORMED;
+				}
+				decoder->cursor++;
+				decoder->state = _JSISH_EXPECT_VALUE;
+				continue;
+			case _JSISH_EXPECT_ARRAY_SEP: case _JSISH_EXPECT_OBJECT_SEP:
+				if (c == ',') {
+					decoder->cursor++;
+					decoder->state =
+						decoder->state == _JSISH_EXPECT_ARRAY_SEP
+							? _JSISH_EXPECT_VALUE
+							: _JSISH_EXPECT_KEY;
+					continue;
+				}
+				/* Fall through. */
+			case _JSISH_EXPECT_ELEMENT: case _JSISH_EXPECT_MEMBER:
+				if (c == (open[depth - 1] == '[' ? ']' : '}')) {
+					depth--;
+					decoder->cursor++;
+					if (c == ']') {
+						action = events->on_array_end
+							? events->on_array_end(user)
+							: JSISH_CONTINUE;
+					} else {
+						action = events->on_object_end
+							? events->on_object_end(user)
+							: JSISH_CONTINUE;
+					}
+					if (action == JSISH_STOP) {
+						return JSISH_STOPPED;
+					}
+					goto end;
+				}
+				if (decoder->state == _JSISH_EXPECT_ARRAY_SEP
+						|| decoder->state == _JSISH_EXPECT_OBJECT_SEP) {
+					return JSISH_ERR_MALFORMED;
+				}
+				if (decoder->state == _JSISH_EXPECT_ELEMENT) {
+					break;
+				}
+				/* Fall through. */
+			case _JSISH_EXPECT_KEY:
+				result = _jsish_decode_string(decoder, &scalar);
+				if (result != JSISH_OK) {
+					return result;
+				}
+				_JSISH_STAT_ADD(decoder, values[JSISH_PAIR], 1);
+				action = events->on_key
+					? events->on_key(user, scalar.data.vstr,
+							scalar.type == JSISH_RAW_STRING)
+					: JSISH_CONTINUE;
+				if (action == JSISH_STOP) {
+					return JSISH_STOPPED;
+				}
+				skip = action == JSISH_SKIP;
+				decoder->state = _JSISH_EXPECT_COLON;
+				continue;
+			default: /* _JSISH_EXPECT_VALUE */
+				break;
+		}
+
+		switch (c) {
+			case '"':
+				result = _jsish_decode_string(decoder, &scalar);
+				break;
+			case '-': case '0': case '1': case '2': case '3': case '4': case '5':
+			case '6': case '7': case '8': case '9':
+				result = _jsish_decode_number(decoder, &scalar);
+				break;
+			case 't': case 'f':
+				result = _jsish_decode_bool(decoder, &scalar);
+				break;
+			case 'n':
+				result = _jsish_decode_null(decoder, &scalar);
+				break;
+			case '[': case '{':
+				if (skip) {
+					action = JSISH_SKIP;
+				} else if (c == '[') {
+					action = events->on_array_begin
+						? events->on_array_begin(user)
+						: JSISH_CONTINUE;
+				} else {
+					action = events->on_object_begin
+						? events->on_object_begin(user)
+						: JSISH_CONTINUE;
+				}
+				if (action == JSISH_STOP) {
+					return JSISH_STOPPED;
+				}
+				if (action == JSISH_SKIP) {
+					/* Only now is the length of the source needed. */
+					if (!decoder->source_length) {
+						decoder->source_length = decoder->cursor + (unsigned int)
+							JSISH_STRLEN(&decoder->source[decoder->cursor]);
+					}
+					end = _jsish_skip_container(decoder->source,
+							decoder->source_length, decoder->cursor);
+					if (!end) {
+						return JSISH_ERR_MALFORMED;
+					}
+					decoder->cursor = end;
+					goto end;
+				}
+				if (depth == JSISH_MAX_DEPTH) {
+					return JSISH_ERR_DEPTH;
+				}
+				_JSISH_STAT_ADD(decoder,
+						values[c == '[' ? JSISH_ARRAY : JSISH_KEYVAL], 1);
+				open[depth++] = c;
+				_JSISH_STAT_MAX(decoder, max_depth, depth);
+				decoder->cursor++;
+				decoder->state = c == '['
+					? _JSISH_EXPECT_ELEMENT
+					: _JSISH_EXPECT_MEMBER;
+				continue;
+			default:
+				return JSISH_ERR_MALFORMED;
+		}
+		if (result != JSISH_OK) {
+			return result;
+		}
+		_JSISH_STAT_ADD(decoder, values[scalar.type], 1);
+		if (!skip && _jsish_emit_scalar(events, user, &scalar) == JSISH_STOP) {
+			return JSISH_STOPPED;
+		}
+
+end:
+		skip = 0;
+		if (!depth) {
+			return JSISH_OK;
+		}
+		decoder->state = open[depth - 1] == '['
+			? _JSISH_EXPECT_ARRAY_SEP
+			: _JSISH_EXPECT_OBJECT_SEP;
+	}
+}
+
+jsish_result_t jsish_parse(
+		char* source,
+		unsigned int flags,
+		const jsish_events_t* events,
+		void* user) {
+	jsish_decoder_t decoder;
+	JSISH_BEGIN_PHASE(JSISH_PHASE_DECODE);
+	/* Only for reading strings and numbers, which takes no values. */
+	jsish_init_decoder(&decoder, NULL, 0);
+	_jsish_begin_decode(&decoder, source);
+	decoder.final = 1;
+	decoder.flags = flags
+		& (JSISH_INTEGERS | JSISH_UNESCAPE | JSISH_VALIDATE_UTF8);
+	return _jsish_end_decode(
+			&decoder, 0, _jsish_parse_events(&decoder, events, user));
+}
+
+void jsish_decode_begin(
+		jsish_decoder_t* decoder, char* buffer, unsigned int buffer_size) {
+	_jsish_begin_decode(decoder, buffer);
+	decoder->source_size = buffer_size;
+	if (buffer_size > 0) {
+		buffer[0] = '\0';
+	}
+}
+
+jsish_result_t jsish_decode_feed(
+		jsish_decoder_t* decoder, const char* chunk, unsigned int length) {
+	char* end;
+	if (decoder->state == _JSISH_DONE) {
+		return JSISH_OK;
+	}
+	/* Leave room for the zero terminator. */
+	if (length >= decoder->source_size - decoder->source_length) {
+		return JSISH_ERR_MEM_OVERFLOW;
+	}
+
+	end = &decoder->source[decoder->source_length];
+	if (chunk != end) {
+		JSISH_MEMCPY(end, chunk, length);
+	}
+	decoder->source_length += length;
+	decoder->source[decoder->source_length] = '\0';
+
+	JSISH_BEGIN_PHASE(JSISH_PHASE_DECODE);
+	return _jsish_end_decode(decoder, 0, _jsish_decode_tokens(decoder));
+}
+
+jsish_result_t jsish_decode_finish(jsish_decoder_t* decoder) {
+	JSISH_BEGIN_PHASE(JSISH_PHASE_DECODE);
+	decoder->final = 1;
+	return _jsish_end_decode(decoder, 0, _jsish_decode_tokens(decoder));
+}
+
+jsish_result_t jsish_batch_init(
+		jsish_batch_t* batch,
+		char* source,
+		jsish_record_t* records,
+		unsigned int records_size,
+		jsish_value_t* values,
+		unsigned int values_size,
+		unsigned int workers) {
+	const char* line_end;
+	unsigned int start;
+	unsigned int end;
+	unsigned int count;
+	unsigned int i;
+	batch->source = source;
+	batch->source_length = JSISH_STRLEN(source);
+	batch->records = records;
+	batch->records_count = 0;
+	batch->values = values;
+	batch->values_size = values_size;
+	batch->workers = workers;
+	batch->flags = 0;
+	/* Every part needs room for at least a root and a frame. */
+	if (workers == 0 || workers > JSISH_MAX_WORKERS
+			|| values_size / workers < 2) {
+		return JSISH_ERR_MEM_OVERFLOW;
+	}
+	for (i = 0; i < workers; ++i) {
+		batch->used[i] = 0;
+	}
+
+	count = 0;
+	for (start = 0; start < batch->source_length; start = end + 1) {
+		line_end = (const char*) JSISH_MEMCHR(
+				&source[start], '\n', batch->source_length - start);
+		end = line_end
+			? (unsigned int) (line_end - source) : batch->source_length;
+		for (i = start; i < end && _jsish_is_whitespace(source[i]); ++i);
+		if (i == end) {
+			continue;
+		}
+		if (count < records_size) {
+			records[count].offset = start;
+			records[count].length = end - start;
+			records[count].result = JSISH_INCOMPLETE;
+			records[count].root.type = JSISH_NULL;
+		}
+		count++;
+	}
+	batch->records_count = count;
+	if (count > records_size) {
+		return JSISH_ERR_MEM_OVERFLOW;
+	}
+
+	for (i = 0; i < count; ++i) {
+		source[records[i].offset + records[i].length] = '\0';
+	}
+
+	return JSISH_OK;
+}
+
+/* Index of the first record of the part decoded by WORKER, the first to start
+ * in its share of the source. */
+unsigned int _jsish_batch_first(const jsish_batch_t* batch, unsigned int worker) {
+	unsigned int offset;
+	unsigned int low;
+	unsigned int high;
+	unsigned int middle;
+	if (worker == 0) {
+		return 0;
+	} else if (worker >= batch->workers) {
+		return batch->records_count;
+	}
+	offset = batch->source_length / batch->workers * worker;
+	low = 0;
+	high = batch->records_count;
+	while (low < high) {
+		middle = low + (high - low) / 2;
+		if (batch->records[middle].offset < offset) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	return low;
+}
+
+/* How far the vector scans may read beyond the bytes they look at, since they
+ * read whole aligned blocks. Parts decoded at the same time must not write
+ * that close to each other. */
+#ifdef JSISH_SIMD_WIDTH
+#define _JSISH_SCAN_REACH JSISH_SIMD_WIDTH
+#else
+#define _JSISH_SCAN_REACH 0
+#endif
+
+/* Index of the first record of the part decoded by WORKER that no other part
+ * can read while decoding. Not beyond the part, or the records of the next
+ * one would be decoded twice. */
+unsigned int _jsish_batch_shared(const jsish_batch_t* batch, unsigned int worker) {
+	unsigned int first;
+	unsigned int last;
+	unsigned int i;
+	first = _jsish_batch_first(batch, worker);
+	last = _jsish_batch_first(batch, worker + 1);
+	for (i = first;
+			worker > 0 && i < last
+				&& batch->records[i].offset
+					< batch->records[first].offset + _JSISH_SCAN_REACH;
+			++i);
+	return i;
+}
+
+/* Decodes records FROM up to TO in the slice of values of WORKER. */
+void _jsish_batch_run(
+		jsish_batch_t* batch,
+		unsigned int worker,
+		unsigned int from,
+		unsigned int to) {
+	jsish_decoder_t decoder;
+	jsish_record_t* record;
+	unsigned int slice;
+	unsigned int values_cursor;
+	unsigned int stack_cursor;
+	unsigned int i;
+	slice = batch->values_size / batch->workers;
+	jsish_init_decoder(&decoder, &batch->values[slice * worker],
+			worker + 1 == batch->workers
+				? batch->values_size - slice * worker : slice);
+	decoder.values_cursor = batch->used[worker];
+	decoder.flags = batch->flags;
+
+	for (i = from; i < to; ++i) {
+		record = &batch->records[i];
+		values_cursor = decoder.values_cursor;
+		stack_cursor = decoder.stack_cursor;
+		record->result = jsish_decode(
+				&decoder, &batch->source[record->offset]);
+		if (record->result == JSISH_OK) {
+			record->root = decoder.root;
+			continue;
+		}
+		/* Give the values of a failed record back to the next ones. */
+		decoder.values_cursor = values_cursor;
+		decoder.stack_cursor = stack_cursor;
+	}
+	batch->used[worker] = decoder.values_cursor;
+}
+
+void jsish_batch_decode(jsish_batch_t* batch, unsigned int worker) {
+	_jsish_batch_run(batch, worker, _jsish_batch_shared(batch, worker),
+			_jsish_batch_first(batch, worker + 1));
+}
+
+jsish_result_t jsish_batch_finish(jsish_batch_t* batch) {
+	unsigned int i;
+	for (i = 1; i < batch->workers; ++i) {
+		_jsish_batch_run(batch, i,
+				_jsish_batch_first(batch, i), _jsish_batch_shared(batch, i));
+	}
+	for (i = 0; i < batch->records_count; ++i) {
+		if (batch->records[i].result != JSISH_OK) {
+			return batch->records[i].result;
+		}
+	}
+
+	return JSISH_OK;
+}
+
+jsish_result_t jsish_split_init(
+		jsish_split_t* split,
+		char* source,
+		jsish_value_t* values,
+		unsigned int values_size,
+		unsigned int workers) {
+	jsish_part_t* part;
+	unsigned int length;
+	unsigned int pos;
+	unsigned int next;
+	unsigned int count;
+	unsigned int w;
+	length = JSISH_STRLEN(source);
+	split->source = source;
+	split->source_length = length;
+	split->values = values;
+	split->values_size = values_size;
+	split->workers = workers;
+	split->flags = 0;
+	split->root.type = JSISH_NULL;
+	if (workers == 0 || workers > JSISH_MAX_WORKERS) {
+		return JSISH_ERR_MEM_OVERFLOW;
+	}
+	pos = _jsish_whitespace_end(source, 0);
+	if (source[pos] != '[') {
+		return JSISH_ERR_MALFORMED;
+	}
+	pos = _jsish_whitespace_end(source, pos + 1);
+
+	/* Skip from element to element, starting a new part at the first element
+	 * past each share of the source. */
+	part = &split->parts[0];
+	part->start = pos;
+	part->first = 0;
+	part->own_start = pos;
+	part->own_first = 0;
+	w = 0;
+	count = 0;
+	while (source[pos] != ']') {
+		while (w + 1 < workers && pos >= length / workers * (w + 1)) {
+			part = &split->parts[++w];
+			part->start = pos;
+			part->first = count;
+			part->own_start = pos;
+			part->own_first = count;
+		}
+		next = _jsish_skip_value(source, length, pos);
+		if (!next) {
+			return JSISH_ERR_MALFORMED;
+		}
+		next = _jsish_whitespace_end(source, next);
+		if (source[next] == ',') {
+			next = _jsish_whitespace_end(source, next + 1);
+			if (source[next] == ']') {
+				return JSISH_ERR_MALFORMED;
+			}
+		} else if (source[next] != ']') {
+			return JSISH_ERR_MALFORMED;
+		}
+		count++;
+		if (w > 0 && part->own_first + 1 == count
+				&& pos < part->start + _JSISH_SCAN_REACH) {
+			part->own_start = next;
+			part->own_first = count;
+		}
+		pos = next;
+	}
+	while (w < workers) {
+		part = &split->parts[++w];
+		part->start = pos;
+		part->first = count;
+		part->own_start = pos;
+		part->own_first = count;
+	}
+
+	/* Every part needs room for at least a root and a frame. */
+	if (values_size < count || (values_size - count) / workers < 2) {
+		return JSISH_ERR_MEM_OVERFLOW;
+	}
+	for (w = 0; w < workers; ++w) {
+		split->parts[w].used = 0;
+		split->parts[w].result = JSISH_INCOMPLETE;
+	}
+	split->root.type = JSISH_ARRAY;
+	JSISH_ARRAY_SIZE(&split->root) = count;
+	_JSISH_ELEMENTS(&split->root) = count ? values : NULL;
+
+	return JSISH_OK;
+}
+
+/* Decodes elements FIRST up to LAST, starting at POS, in the slice of values
+ * of WORKER. */
+jsish_result_t _jsish_split_run(
+		jsish_split_t* split,
+		unsigned int worker,
+		unsigned int pos,
+		unsigned int first,
+		unsigned int last) {
+	jsish_decoder_t decoder;
+	jsish_part_t* part;
+	jsish_result_t result;
+	unsigned int offset;
+	unsigned int slice;
+	unsigned int i;
+	char c;
+	part = &split->parts[worker];
+	offset = split->parts[split->workers].first;
+	slice = (split->values_size - offset) / split->workers;
+	jsish_init_decoder(&decoder, &split->values[offset + slice * worker],
+			worker + 1 == split->workers
+				? split->values_size - offset - slice * worker : slice);
+	decoder.values_cursor = part->used;
+	decoder.flags = split->flags;
+
+	result = JSISH_OK;
+	for (i = first; i < last; ++i) {
+		_jsish_begin_decode(&decoder, split->source);
+		decoder.cursor = pos;
+		decoder.source_length = split->source_length;
+		decoder.final = 1;
+		result = _jsish_decode_tokens(&decoder);
+		if (result != JSISH_OK) {
+			break;
+		}
+		/* The element must end where jsish_split_init() found it to. */
+		decoder.cursor = _jsish_whitespace_end(split->source, decoder.cursor);
+		c = split->source[decoder.cursor];
+		if (c != ',' && c != ']') {
+			result = JSISH_ERR_MALFORMED;
+			break;
+		}
+		split->values[i] = decoder.root;
+		pos = _jsish_whitespace_end(split->source, decoder.cursor + 1);
+	}
+	part->used = decoder.values_cursor;
+
+	return result;
+}
+
+void jsish_split_decode(jsish_split_t* split, unsigned int worker) {
+	jsish_part_t* part;
+	part = &split->parts[worker];
+	part->result = _jsish_split_run(split, worker,
+			part->own_start, part->own_first, split->parts[worker + 1].first);
+}
+
+jsish_result_t jsish_split_finish(jsish_split_t* split) {
+	jsish_part_t* part;
+	unsigned int i;
+	for (i = 0; i < split->workers; ++i) {
+		part = &split->parts[i];
+		if (part->result == JSISH_OK) {
+			part->result = _jsish_split_run(
+					split, i, part->start, part->first, part->own_first);
+		}
+	}
+	for (i = 0; i < split->workers; ++i) {
+		if (split->parts[i].result != JSISH_OK) {
+			return split->parts[i].result;
+		}
+	}
+
+	return JSISH_OK;
+}
+
+#ifdef JSISH_THREADS
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+/* Decodes part WORKER of a batch or split. */
+typedef void (*_jsish_part_decode_t)(void* batch, unsigned int worker);
+
+typedef struct {
+	_jsish_part_decode_t decode;
+	void* batch;
+	unsigned int worker;
+} _jsish_job_t;
+
+#ifdef _WIN32
+DWORD WINAPI _jsish_job_thread(LPVOID argument) {
+	_jsish_job_t* job;
+	job = (_jsish_job_t*) argument;
+	job->decode(job->batch, job->worker);
+	return 0;
+}
+#else
+void* _jsish_job_thread(void* argument) {
+	_jsish_job_t* job;
+	job = (_jsish_job_t*) argument;
+	job->decode(job->batch, job->worker);
+	return NULL;
+}
+#endif
+
+/* Decodes every part, starting a thread for each part but the first. */
+void _jsish_decode_parts(
+		_jsish_part_decode_t decode, void* batch, unsigned int workers) {
+	_jsish_job_t jobs[JSISH_MAX_WORKERS];
+	int started[JSISH_MAX_WORKERS];
+#ifdef _WIN32
+	HANDLE threads[JSISH_MAX_WORKERS];
+#else
+	pthread_t threads[JSISH_MAX_WORKERS];
+#endif
+	unsigned int i;
+	for (i = 0; i < workers; ++i) {
+		jobs[i].decode = decode;
+		jobs[i].batch = batch;
+		jobs[i].worker = i;
+		started[i] = 0;
+	}
+	for (i = 1; i < workers; ++i) {
+#ifdef _WIN32
+		threads[i] = CreateThread(
+				NULL, 0, _jsish_job_thread, &jobs[i], 0, NULL);
+		started[i] = threads[i] != NULL;
+#else
+		started[i] = pthread_create(
+				&threads[i], NULL, _jsish_job_thread, &jobs[i]) == 0;
+#endif
+	}
+
+	/* Parts that could not be given a thread are decoded here as well. */
+	for (i = 0; i < workers; ++i) {
+		if (!started[i]) {
+			_jsish_job_thread(&jobs[i]);
+		}
+	}
+	for (i = 0; i < workers; ++i) {
+		if (started[i]) {
+#ifdef _WIN32
+			WaitForSingleObject(threads[i], INFINITE);
+			CloseHandle(threads[i]);
+#else
+			pthread_join(threads[i], NULL);
+#endif
+		}
+	}
+}
+
+void _jsish_batch_part(void* batch, unsigned int worker) {
+	jsish_batch_decode((jsish_batch_t*) batch, worker);
+}
+
+jsish_result_t jsish_batch_decode_parallel(jsish_batch_t* batch) {
+	_jsish_decode_parts(_jsish_batch_part, batch, batch->workers);
+	return jsish_batch_finish(batch);
+}
+
+void _jsish_split_part(void* split, unsigned int worker) {
+	jsish_split_decode((jsish_split_t*) split, worker);
+}
+
+jsish_result_t jsish_split_decode_parallel(jsish_split_t* split) {
+	_jsish_decode_parts(_jsish_split_part, split, split->workers);
+	return jsish_split_finish(split);
+}
+#endif
+
+/* Encoder output. Bytes are gathered in BUFFER; when it fills up they are
+ * passed to WRITE if there is one, or else only counted so that the required
+ * buffer size can be reported. */
+typedef struct {
+	char* buffer;
+	unsigned int size;
+	unsigned int length;
+	jsish_write_t write;
+	void* user;
+	int failed;
+#ifdef JSISH_STATS
+	jsish_stats_t stats;
+#endif
+} _jsish_writer_t;
+
+void _jsish_flush(_jsish_writer_t* out) {
+	_JSISH_STAT_ADD(out, bytes, out->length);
+	if (out->length && !out->failed
+			&& out->write(out->user, out->buffer, out->length)) {
+		out->failed = 1;
+	}
+	out->length = 0;
+}
+
+void _jsish_write(_jsish_writer_t* out, const char* chars, unsigned int length) {
+	if (out->write && out->length + length > out->size) {
+		_jsish_flush(out);
+		/* Pass runs that would not fit in the scratch buffer straight on. */
+		if (length > out->size) {
+			_JSISH_STAT_ADD(out, bytes, length);
+			if (!out->failed && out->write(out->user, chars, length)) {
+				out->failed = 1;
+			}
+			return;
+		}
+	}
+	if (out->length + length <= out->size) {
+		JSISH_MEMCPY(&out->buffer[out->length], chars, length);
+	}
+	out->length += length;
+}
+
+void _jsish_append(_jsish_writer_t* out, char c) {
+	if (out->length < out->size) {
+		out->buffer[out->length++] = c;
+		return;
+	}
+	_jsish_write(out, &c, 1);
+}
+
+/* Writes the decimal digits of MAGNITUDE to OUT and returns their count. */
+unsigned int _jsish_format_integer(_jsish_uint_t magnitude, char* out) {
+	char digits[20];
+	unsigned int length, i;
+	length = 0;
+	do {
+		digits[length++] = (char) ('0' + magnitude % 10);
+		magnitude /= 10;
+	} while (magnitude);
+	for (i = 0; i < length; i++) {
+		out[i] = digits[length - 1 - i];
+	}
+	return length;
+}
+
+/* Shortest round-trip formatting of doubles with Florian Loitsch's Grisu2,
+ * after the implementation in RapidJSON. Its output always reads back as the
+ * same double, but as it only knows the rounding interval to within the error
+ * of its 64-bit arithmetic, it can miss shorter digits that lie at the very
+ * edge of the interval, such as 1e23. Where that is possible, they are looked
+ * for with exact arithmetic, see _jsish_shortest(). */
+typedef struct {
+	_jsish_uint_t f;
+	int e;
+} _jsish_diyfp_t;
+
+/* Normalized 10^-348, 10^-340, ..., 10^340 as the high and low halves of a
+ * 64-bit significand and a binary exponent. */
+static const struct {
+	unsigned int hi;
+	unsigned int lo;
+	int e;
+} _jsish_cached_powers[87] = {
+	{ 0xfa8fd5a0u, 0x081c0288u, -1220 },
+	{ 0xbaaee17fu, 0xa23ebf76u, -1193 },
+	{ 0x8b16fb20u, 0x3055ac76u, -1166 },
+	{ 0xcf42894au, 0x5dce35eau, -1140 },
+	{ 0x9a6bb0aau, 0x55653b2du, -1113 },
+	{ 0xe61acf03u, 0x3d1a45dfu, -1087 },
+	{ 0xab70fe17u, 0xc79ac6cau, -1060 },
+	{ 0xff77b1fcu, 0xbebcdc4fu, -1034 },
+	{ 0xbe5691efu, 0x416bd60cu, -1007 },
+	{ 0x8dd01fadu, 0x907ffc3cu, -980 },
+	{ 0xd3515c28u, 0x31559a83u, -954 },
+	{ 0x9d71ac8fu, 0xada6c9b5u, -927 },
+	{ 0xea9c2277u, 0x23ee8bcbu, -901 },
+	{ 0xaecc4991u, 0x4078536du, -874 },
+	{ 0x823c1279u, 0x5db6ce57u, -847 },
+	{ 0xc2109436u, 0x4dfb5637u, -821 },
+	{ 0x9096ea6fu, 0x3848984fu, -794 },
+	{ 0xd77485cbu, 0x25823ac7u, -768 },
+	{ 0xa086cfcdu, 0x97bf97f4u, -741 },
+	{ 0xef340a98u, 0x172aace5u, -715 },
+	{ 0xb23867fbu, 0x2a35b28eu, -688 },
+	{ 0x84c8d4dfu, 0xd2c63f3bu, -661 },
+	{ 0xc5dd4427u, 0x1ad3cdbau, -635 },
+	{ 0x936b9fceu, 0xbb25c996u, -608 },
+	{ 0xdbac6c24u, 0x7d62a584u, -582 },
+	{ 0xa3ab6658u, 0x0d5fdaf6u, -555 },
+	{ 0xf3e2f893u, 0xdec3f126u, -529 },
+	{ 0xb5b5ada8u, 0xaaff80b8u, -502 },
+	{ 0x87625f05u, 0x6c7c4a8bu, -475 },
+	{ 0xc9bcff60u, 0x34c13053u, -449 },
+	{ 0x964e858cu, 0x91ba2655u, -422 },
+	{ 0xdff97724u, 0x70297ebdu, -396 },
+	{ 0xa6dfbd9fu, 0xb8e5b88fu, -369 },
+	{ 0xf8a95fcfu, 0x88747d94u, -343 },
+	{ 0xb9447093u, 0x8fa89bcfu, -316 },
+	{ 0x8a08f0f8u, 0xbf0f156bu, -289 },
+	{ 0xcdb02555u, 0x653131b6u, -263 },
+	{ 0x993fe2c6u, 0xd07b7facu, -236 },
+	{ 0xe45c10c4u, 0x2a2b3b06u, -210 },
+	{ 0xaa242499u, 0x697392d3u, -183 },
+	{ 0xfd87b5f2u, 0x8300ca0eu, -157 },
+	{ 0xbce50864u, 0x92111aebu, -130 },
+	{ 0x8cbccc09u, 0x6f5088ccu, -103 },
+	{ 0xd1b71758u, 0xe219652cu, -77 },
+	{ 0x9c400000u, 0x00000000u, -50 },
+	{ 0xe8d4a510u, 0x00000000u, -24 },
+	{ 0xad78ebc5u, 0xac620000u, 3 },
+	{ 0x813f3978u, 0xf8940984u, 30 },
+	{ 0xc097ce7bu, 0xc90715b3u, 56 },
+	{ 0x8f7e32ceu, 0x7bea5c70u, 83 },
+	{ 0xd5d238a4u, 0xabe98068u, 109 },
+	{ 0x9f4f2726u, 0x179a2245u, 136 },
+	{ 0xed63a231u, 0xd4c4fb27u, 162 },
+	{ 0xb0de6538u, 0x8cc8ada8u, 189 },
+	{ 0x83c7088eu, 0x1aab65dbu, 216 },
+	{ 0xc45d1df9u, 0x42711d9au, 242 },
+	{ 0x924d692cu, 0xa61be758u, 269 },
+	{ 0xda01ee64u, 0x1a708deau, 295 },
+	{ 0xa26da399u, 0x9aef774au, 322 },
+	{ 0xf209787bu, 0xb47d6b85u, 348 },
+	{ 0xb454e4a1u, 0x79dd1877u, 375 },
+	{ 0x865b8692u, 0x5b9bc5c2u, 402 },
+	{ 0xc83553c5u, 0xc8965d3du, 428 },
+	{ 0x952ab45cu, 0xfa97a0b3u, 455 },
+	{ 0xde469fbdu, 0x99a05fe3u, 481 },
+	{ 0xa59bc234u, 0xdb398c25u, 508 },
+	{ 0xf6c69a72u, 0xa3989f5cu, 534 },
+	{ 0xb7dcbf53u, 0x54e9beceu, 561 },
+	{ 0x88fcf317u, 0xf22241e2u, 588 },
+	{ 0xcc20ce9bu, 0xd35c78a5u, 614 },
+	{ 0x98165af3u, 0x7b2153dfu, 641 },
+	{ 0xe2a0b5dcu, 0x971f303au, 667 },
+	{ 0xa8d9d153u, 0x5ce3b396u, 694 },
+	{ 0xfb9b7cd9u, 0xa4a7443cu, 720 },
+	{ 0xbb764c4cu, 0xa7a44410u, 747 },
+	{ 0x8bab8eefu, 0xb6409c1au, 774 },
+	{ 0xd01fef10u, 0xa657842cu, 800 },
+	{ 0x9b10a4e5u, 0xe9913129u, 827 },
+	{ 0xe7109bfbu, 0xa19c0c9du, 853 },
+	{ 0xac2820d9u, 0x623bf429u, 880 },
+	{ 0x80444b5eu, 0x7aa7cf85u, 907 },
+	{ 0xbf21e440u, 0x03acdd2du, 933 },
+	{ 0x8e679c2fu, 0x5e44ff8fu, 960 },
+	{ 0xd433179du, 0x9c8cb841u, 986 },
+	{ 0x9e19db92u, 0xb4e31ba9u, 1013 },
+	{ 0xeb96bf6eu, 0xbadf77d9u, 1039 },
+	{ 0xaf87023bu, 0x9bf0ee6bu, 1066 }
+};
+
+static const unsigned int _jsish_small_pow10[10] = {
+	1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+_jsish_diyfp_t _jsish_diyfp_multiply(_jsish_diyfp_t x, _jsish_diyfp_t y) {
+	_jsish_uint_t a, b, c, d, t;
+	_jsish_diyfp_t r;
+	a = x.f >> 32;
+	b = x.f & 0xffffffffu;
+	c = y.f >> 32;
+	d = y.f & 0xffffffffu;
+	/* Upper half of the 128-bit product, rounded. */
+	t = (b * d >> 32) + (a * d & 0xffffffffu) + (b * c & 0xffffffffu)
+		+ 0x80000000u;
+	r.f = a * c + (a * d >> 32) + (b * c >> 32) + (t >> 32);
+	r.e = x.e + y.e + 64;
+	return r;
+}
+
+void _jsish_grisu_round(
+		char* digits,
+		int length,
+		_jsish_uint_t delta,
+		_jsish_uint_t rest,
+		_jsish_uint_t ten_kappa,
+		_jsish_uint_t distance) {
+	while (rest < distance && delta - rest >= ten_kappa
+			&& (rest + ten_kappa < distance
+				|| distance - rest > rest + ten_kappa - distance)) {
+		digits[length - 1]--;
+		rest += ten_kappa;
+	}
+}
+
+/* Writes the digits of the positive, finite double with the IEEE-754 encoding
+ * BITS to DIGITS and returns their count. The value is the digits times
+ * 10^*K. FIRST is set to the fewest digits that might also read back as the
+ * double, which is the count returned unless the boundaries of the interval,
+ * each known to within a unit, leave room for fewer. */
+int _jsish_grisu2(_jsish_uint_t bits, char* digits, int* k, int* first) {
+	const _jsish_uint_t hidden = (_jsish_uint_t) 1 << 52;
+	_jsish_diyfp_t w, plus, minus, c;
+	_jsish_uint_t one, delta, distance, p2, rest, ten_kappa, error;
+	unsigned int p1, d;
+	int shift, kappa, length;
+	double dk;
+	w.f = bits & (hidden - 1);
+	w.e = (int) (bits >> 52);
+	if (w.e) {
+		w.f += hidden;
+		w.e -= 1075;
+	} else {
+		w.e = -1074;
+	}
+
+	/* Boundaries halfway to the neighbouring doubles, normalized together. */
+	plus.f = (w.f << 1) + 1;
+	plus.e = w.e - 1;
+	while (!(plus.f & (hidden << 1))) {
+		plus.f <<= 1;
+		plus.e--;
+	}
+	plus.f <<= 10;
+	plus.e -= 10;
+	if (w.f == hidden) {
+		minus.f = (w.f << 2) - 1;
+		minus.e = w.e - 2;
+	} else {
+		minus.f = (w.f << 1) - 1;
+		minus.e = w.e - 1;
+	}
+	minus.f <<= minus.e - plus.e;
+	minus.e = plus.e;
+	while (!(w.f & hidden)) {
+		w.f <<= 1;
+		w.e--;
+	}
+	w.f <<= 11;
+	w.e -= 11;
+
+	/* Scale by a cached power of ten that brings the upper boundary's exponent
+	 * into [-60, -32]. */
+	dk = (-61 - plus.e) * 0.30102999566398114 + 347;
+	kappa = (int) dk;
+	if (dk - kappa > 0.0) {
+		kappa++;
+	}
+	kappa = (kappa >> 3) + 1;
+	*k = 348 - kappa * 8;
+	c.f = (_jsish_uint_t) _jsish_cached_powers[kappa].hi << 32
+		| _jsish_cached_powers[kappa].lo;
+	c.e = _jsish_cached_powers[kappa].e;
+	w = _jsish_diyfp_multiply(w, c);
+	plus = _jsish_diyfp_multiply(plus, c);
+	minus = _jsish_diyfp_multiply(minus, c);
+	plus.f--;
+	minus.f++;
+
+	/* Generate digits of the upper boundary until they fall within the
+	 * rounding interval, first from the integral and then the fractional
+	 * part. Where they do not, but would within an interval wider by the
+	 * ERROR of each boundary, note that fewer digits may do. */
+	shift = -plus.e;
+	one = (_jsish_uint_t) 1 << shift;
+	delta = plus.f - minus.f;
+	distance = plus.f - w.f;
+	error = 2;
+	p1 = (unsigned int) (plus.f >> shift);
+	p2 = plus.f & (one - 1);
+	kappa = 1;
+	while (kappa < 10 && p1 >= _jsish_small_pow10[kappa]) {
+		kappa++;
+	}
+	length = 0;
+	*first = -1;
+	while (kappa > 0) {
+		kappa--;
+		d = p1 / _jsish_small_pow10[kappa];
+		p1 %= _jsish_small_pow10[kappa];
+		if (d || length) {
+			digits[length++] = (char) ('0' + d);
+		}
+		rest = ((_jsish_uint_t) p1 << shift) + p2;
+		ten_kappa = (_jsish_uint_t) _jsish_small_pow10[kappa] << shift;
+		if (rest <= delta) {
+			*k += kappa;
+			_jsish_grisu_round(
+					digits, length, delta, rest, ten_kappa, distance);
+			if (*first < 0) {
+				*first = length;
+			}
+			return length;
+		}
+		if (*first < 0
+				&& (rest - delta <= error || ten_kappa - rest <= error)) {
+			*first = length;
+		}
+	}
+	for (;;) {
+		p2 *= 10;
+		delta *= 10;
+		error *= 10;
+		d = (unsigned int) (p2 >> shift);
+		if (d || length) {
+			digits[length++] = (char) ('0' + d);
+		}
+		p2 &= one - 1;
+		kappa--;
+		if (p2 < delta) {
+			*k += kappa;
+			_jsish_grisu_round(
+					digits,
+					length,
+					delta,
+					p2,
+					one,
+					-kappa < 10 ? distance * _jsish_small_pow10[-kappa] : 0);
+			if (*first < 0) {
+				*first = length;
+			}
+			return length;
+		}
+		if (*first < 0 && (p2 - delta <= error || one - p2 <= error)) {
+			*first = length;
+		}
+	}
+}
+
+/* Looks for fewer than LENGTH digits that read back as the positive double V,
+ * given the DIGITS times 10^*K that Grisu2 found for it and the fewest that
+ * might do, FIRST. As the numbers that read back as V form an interval around
+ * DIGITS, there is one of a given length only if DIGITS rounded down or up to
+ * that length is one, so only those two are read back, with the exact
+ * conversion of the parser, keeping the nearer if both are. Returns the new
+ * count. */
+int _jsish_shortest(char* digits, int length, int* k, int first, double v) {
+	_jsish_uint_t n, scale, below, found;
+	int exponent, i;
+	n = 0;
+	for (i = 0; i < length; ++i) {
+		n = n * 10 + (unsigned int) (digits[i] - '0');
+	}
+	for (; first < length; ++first) {
+		scale = 1;
+		for (i = first; i < length; ++i) {
+			scale *= 10;
+		}
+		below = n / scale;
+		exponent = *k + length - first;
+		if (below && _jsish_exact_to_double(below, exponent) == v) {
+			found = below;
+			if (_jsish_exact_to_double(below + 1, exponent) == v
+					&& n - below * scale > (below + 1) * scale - n) {
+				found = below + 1;
+			}
+		} else if (_jsish_exact_to_double(below + 1, exponent) == v) {
+			found = below + 1;
+		} else {
+			continue;
+		}
+		while (found % 10 == 0) {
+			found /= 10;
+			exponent++;
+		}
+		length = (int) _jsish_format_integer(found, digits);
+		*k = exponent;
+		return length;
+	}
+	return length;
+}
+
+/* Writes the shortest JSON number that reads back as V to OUT, which must have
+ * room for 32 characters, and returns its length. Integral values are written
+ * without fraction or exponent, and infinities and NaN, which JSON cannot
+ * represent, as null. */
+unsigned int _jsish_format_number(double v, char* out) {
+	union {
+		double d;
+		_jsish_uint_t u;
+	} bits;
+	char digits[20];
+	unsigned int n;
+	int length, k, first, point, i;
+	bits.d = v;
+	if ((bits.u >> 52 & 0x7ff) == 0x7ff) {
+		JSISH_MEMCPY(out, "null", 4);
+		return 4;
+	}
+	n = 0;
+	if (bits.u >> 63) {
+		out[n++] = '-';
+		v = -v;
+		bits.u &= ~((_jsish_uint_t) 1 << 63);
+	}
+	if (v < 9007199254740992.0 && (double) (_jsish_uint_t) v == v) {
+		return n + _jsish_format_integer((_jsish_uint_t) v, &out[n]);
+	}
+
+	length = _jsish_grisu2(bits.u, digits, &k, &first);
+	if (first < length) {
+		length = _jsish_shortest(digits, length, &k, first, v);
+	}
+	point = length + k;
+	if (length <= point && point <= 21) {
+		/* 1234e7 -> 12340000000 */
+		for (i = 0; i < point; i++) {
+			out[n++] = i < length ? digits[i] : '0';
+		}
+	} else if (0 < point && point <= 21) {
+		/* 1234e-2 -> 12.34 */
+		for (i = 0; i < length; i++) {
+			if (i == point) {
+				out[n++] = '.';
+			}
+			out[n++] = digits[i];
+		}
+	} else if (-6 < point && point <= 0) {
+		/* 1234e-6 -> 0.001234 */
+		out[n++] = '0';
+		out[n++] = '.';
+		for (i = point; i < 0; i++) {
+			out[n++] = '0';
+		}
+		for (i = 0; i < length; i++) {
+			out[n++] = digits[i];
+		}
+	} else {
+		/* 1234e30 -> 1.234e33 */
+		out[n++] = digits[0];
+		if (length > 1) {
+			out[n++] = '.';
+			for (i = 1; i < length; i++) {
+				out[n++] = digits[i];
+			}
+		}
+		out[n++] = 'e';
+		if (--point < 0) {
+			out[n++] = '-';
+			point = -point;
+		}
+		n += _jsish_format_integer((_jsish_uint_t) point, &out[n]);
+	}
+	return n;
+}
+
+void _jsish_encode_number(const jsish_value_t* value, _jsish_writer_t* out) {
+	char text[32];
+	_jsish_write(out, text, _jsish_format_number(JSISH_GET_NUMBER(value), text));
+}
+
+void _jsish_encode_integer(const jsish_value_t* value, _jsish_writer_t* out) {
+	char text[21];
+	unsigned int length;
+	_jsish_uint_t magnitude;
+	magnitude = (_jsish_uint_t) JSISH_GET_INTEGER(value);
+	length = 0;
+	if (JSISH_GET_INTEGER(value) < 0) {
+		text[length++] = '-';
+		magnitude = ~magnitude + 1;
+	}
+	length += _jsish_format_integer(magnitude, &text[length]);
+	_jsish_write(out, text, length);
+}
+
+void _jsish_encode_bool(const jsish_value_t* value, _jsish_writer_t* out) {
+	if (JSISH_GET_BOOL(value)) {
+		_jsish_write(out, "true", 4);
+		return;
+	}
+	_jsish_write(out, "false", 5);
+}
+
+/* Writes the string S with quotation marks, backslashes and control characters
+ * escaped. Only backslashes and quotation marks are left alone if RAW is set,
+ * as S then holds escaped text already. Runs of characters that need no
+ * escaping are found with the vector scan and copied as a whole. */
+void _jsish_write_string(_jsish_writer_t* out, const char* s, int raw) {
+	static const char hex[16] = {
+		'0', '1', '2', '3', '4', '5', '6', '7',
+		'8', '9', 'a', 'b', 'c', 'd', 'e', 'f'
+	};
+	const char* run;
+	char escape[6];
+	unsigned char c;
+#ifdef JSISH_STATS
+	const char* start;
+	start = s;
+#endif
+	_jsish_append(out, '"');
+	for (;;) {
+#ifdef JSISH_SIMD_WIDTH
+		run = _jsish_scan_string(s);
+#else
+		run = s;
+		while ((unsigned char) *run >= 0x20 && *run != '"' && *run != '\\') {
+			++run;
+		}
+#endif
+		_jsish_write(out, s, (unsigned int) (run - s));
+		c = (unsigned char) *run;
+		if (c == '\0') {
+			break;
+		}
+		s = run + 1;
+		if (c == '"' || c == '\\') {
+			if (!raw) {
+				_jsish_append(out, '\\');
+				_JSISH_STAT_ADD(out, escapes, 1);
+			}
+			_jsish_append(out, (char) c);
+			continue;
+		}
+		_JSISH_STAT_ADD(out, escapes, 1);
+		escape[0] = '\\';
+		switch (c) {
+			case '\b': escape[1] = 'b'; break;
+			case '\f': escape[1] = 'f'; break;
+			case '\n': escape[1] = 'n'; break;
+			case '\r': escape[1] = 'r'; break;
+			case '\t': escape[1] = 't'; break;
+			default:
+				escape[1] = 'u';
+				escape[2] = '0';
+				escape[3] = '0';
+				escape[4] = hex[c >> 4];
+				escape[5] = hex[c & 15];
+				_jsish_write(out, escape, 6);
+				continue;
+		}
+		_jsish_write(out, escape, 2);
+	}
+#ifdef JSISH_STATS
+	if (raw) {
+		/* Those written back as they were read. */
+		out->stats.escapes += _jsish_count_escapes(start, run);
+	}
+#endif
+	_JSISH_STAT_MAX(out, longest_string, (unsigned int) (run - start));
+	_jsish_append(out, '"');
+}
+
+void _jsish_encode_string(const jsish_value_t* value, _jsish_writer_t* out) {
+	_jsish_write_string(
+			out, JSISH_GET_STRING(value), value->type == JSISH_RAW_STRING);
+}
+
+/* Encodes VALUE without recursing. The innermost array or object is tracked by
+ * NEXT, the next element or member pair to write, and END, where the elements
+ * of an array end; objects have no end, their last pair links to NULL. The
+ * ones enclosing it are kept in STACK, of at most STACK_SIZE frames. */
+jsish_result_t _jsish_encode_value(
+		const jsish_value_t* value,
+		_jsish_writer_t* out,
+		jsish_encode_frame_t* stack,
+		unsigned int stack_size) {
+	const jsish_value_t* next;
+	const jsish_value_t* end;
+	unsigned int depth;
+	depth = 0;
+	next = NULL;
+	end = NULL;
+	for (;;) {
+		_JSISH_STAT_ADD(out, values[value->type], 1);
+		switch (value->type) {
+			case JSISH_NULL:
+				_jsish_write(out, "null", 4);
+				break;
+			case JSISH_NUMBER:
+				_jsish_encode_number(value, out);
+				break;
+			case JSISH_INTEGER:
+				_jsish_encode_integer(value, out);
+				break;
+			case JSISH_BOOL:
+				_jsish_encode_bool(value, out);
+				break;
+			case JSISH_STRING: case JSISH_RAW_STRING:
+				_jsish_encode_string(value, out);
+				break;
+			case JSISH_ARRAY:
+				if (!JSISH_ARRAY_SIZE(value)) {
+					_JSISH_STAT_MAX(out, max_depth, depth + 1);
+					_jsish_write(out, "[]", 2);
+					break;
+				}
+				if (depth == stack_size) {
+					return JSISH_ERR_DEPTH;
+				}
+				_jsish_append(out, '[');
+				stack[depth].next = next;
+				stack[depth].end = end;
+				depth++;
+				_JSISH_STAT_MAX(out, max_depth, depth);
+				next = JSISH_ARRAY_INDEX(value, 0);
+				end = next + JSISH_ARRAY_SIZE(value);
+				value = next++;
+				continue;
+			case JSISH_KEYVAL: case JSISH_PAIR:
+				if (!JSISH_KV_PAIR(value)) {
+					_JSISH_STAT_MAX(out, max_depth, depth + 1);
+					_jsish_write(out, "{}", 2);
+					break;
+				}
+				if (depth == stack_size) {
+					return JSISH_ERR_DEPTH;
+				}
+				_jsish_append(out, '{');
+				stack[depth].next = next;
+				stack[depth].end = end;
+				depth++;
+				_JSISH_STAT_MAX(out, max_depth, depth);
+				next = JSISH_KV_PAIR(value);
+				end = NULL;
+				goto member;
+			default:
+				break;
+		}
+
+		/* Close the arrays and objects that have nothing left, then move on
+		 * to the next element or member. Both NEXT and END are NULL outside
+		 * of any. */
+		while (next == end) {
+			if (!depth) {
+				return JSISH_OK;
+			}
+			_jsish_append(out, end ? ']' : '}');
+			depth--;
+			next = stack[depth].next;
+			end = stack[depth].end;
+		}
+		_jsish_append(out, ',');
+		if (end) {
+			value = next++;
+			continue;
+		}
+
+member:
+		_JSISH_STAT_ADD(out, values[JSISH_PAIR], 1);
+		_jsish_encode_string(_JSISH_KEY_VALUE(next), out);
+		_jsish_append(out, ':');
+		value = JSISH_KV_VALUE(next);
+		next = JSISH_KV_NEXT(next);
+	}
+}
+
+jsish_result_t jsish_encode(
+		const jsish_value_t* value,
+		char* buffer,
+		unsigned int buffer_size,
+		unsigned int* encoded_bytes) {
+	jsish_encode_frame_t frames[JSISH_ENCODE_DEPTH];
+	return jsish_encode_ex(value, buffer, buffer_size, encoded_bytes,
+			frames, JSISH_ENCODE_DEPTH);
+}
+
+jsish_result_t jsish_encode_ex(
+		const jsish_value_t* value,
+		char* buffer,
+		unsigned int buffer_size,
+		unsigned int* encoded_bytes,
+		jsish_encode_frame_t* frames,
+		unsigned int frames_size) {
+	_jsish_writer_t out;
+	jsish_result_t result;
+	out.buffer = buffer;
+	out.size = buffer_size;
+	out.length = 0;
+	out.write = NULL;
+	out.user = NULL;
+	out.failed = 0;
+	_JSISH_STAT_RESET(&out);
+	JSISH_BEGIN_PHASE(JSISH_PHASE_ENCODE);
+	result = _jsish_encode_value(value, &out, frames, frames_size);
+	_JSISH_STAT_ADD(&out, bytes, out.length);
+	_jsish_append(&out, '\0');
+	*encoded_bytes = out.length;
+	if (result == JSISH_OK && out.length > buffer_size) {
+		result = JSISH_ERR_MEM_OVERFLOW;
+	}
+	JSISH_END_PHASE(JSISH_PHASE_ENCODE, result, _JSISH_STATS(&out));
+
+	return result;
+}
+
+jsish_result_t jsish_encode_to(
+		const jsish_value_t* value,
+		jsish_write_t write,
+		void* user,
+		char* scratch,
+		unsigned int scratch_size) {
+	jsish_encode_frame_t frames[JSISH_ENCODE_DEPTH];
+	return jsish_encode_to_ex(value, write, user, scratch, scratch_size,
+			frames, JSISH_ENCODE_DEPTH);
+}
+
+jsish_result_t jsish_encode_to_ex(
 		const jsish_value_t* value,
+		jsish_write_t write,
+		void* user,
+		char* scratch,
+		unsigned int scratch_size,
+		jsish_encode_frame_t* frames,
+		unsigned int frames_size) {
+	_jsish_writer_t out;
+	jsish_result_t result;
+	out.buffer = scratch;
+	out.size = scratch_size;
+	out.length = 0;
+	out.write = write;
+	out.user = user;
+	out.failed = 0;
+	_JSISH_STAT_RESET(&out);
+	JSISH_BEGIN_PHASE(JSISH_PHASE_ENCODE);
+	result = _jsish_encode_value(value, &out, frames, frames_size);
+	_jsish_flush(&out);
+	if (result == JSISH_OK && out.failed) {
+		result = JSISH_ERR_WRITE;
+	}
+	JSISH_END_PHASE(JSISH_PHASE_ENCODE, result, _JSISH_STATS(&out));
+
+	return result;
+}
+
+/* A member of an object that jsish_minify() puts in order: where it starts in
+ * the output, the length of its key between the quotation marks, and its
+ * length up to the comma or brace after it. */
+typedef struct {
+	unsigned int start;
+	unsigned int key;
+	unsigned int length;
+} _jsish_span_t;
+
+/* Set in the key length of a span whose key the decoder would unescape. */
+#define _JSISH_SPAN_UNESCAPE 0x80000000u
+
+/* Reads a key as the decoder stores it, a byte at a time, unescaping it on the
+ * way if asked to. */
+typedef struct {
+	const char* next;
+	const char* end;
+	int unescape;
+	char bytes[4];
+	unsigned int count;
+	unsigned int at;
+} _jsish_key_reader_t;
+
+void _jsish_key_reader_init(
+		_jsish_key_reader_t* reader,
+		const char* text,
+		const _jsish_span_t* span) {
+	reader->next = &text[span->start + 1];
+	reader->end = reader->next + (span->key & ~_JSISH_SPAN_UNESCAPE);
+	reader->unescape = (span->key & _JSISH_SPAN_UNESCAPE) != 0;
+	reader->count = 0;
+	reader->at = 0;
+}
+
+/* Returns the next byte of the key, or -1 at its end. */
+int _jsish_key_byte(_jsish_key_reader_t* reader) {
+	unsigned int length;
+	if (reader->at < reader->count) {
+		return (unsigned char) reader->bytes[reader->at++];
+	}
+	if (reader->next == reader->end) {
+		return -1;
+	}
+	if (*reader->next != '\\' || !reader->unescape) {
+		return (unsigned char) *reader->next++;
+	}
+	reader->count = _jsish_unescape_char(reader->next, reader->bytes, &length);
+	reader->next += length;
+	reader->at = 1;
+	return (unsigned char) reader->bytes[0];
+}
+
+/* Output of jsish_minify() with JSISH_SORT_KEYS. While any object is open, the
+ * output is held back in the scratch buffer instead of being written, so that
+ * the members of each can be put in order once it closes. Their spans are kept
+ * at the end of the scratch buffer, below TOP, newest first, and the output
+ * is only stored below them. */
+typedef struct {
+	_jsish_writer_t* out;
+	jsish_write_t write;
+	unsigned int size;
+	_jsish_span_t* top;
+	unsigned int count;
+	unsigned int objects;
+} _jsish_sorter_t;
+
+/* Compares the keys of two members in TEXT like JSISH_STRCMP() would once
+ * decoded. */
+int _jsish_compare_spans(
+		const char* text, const _jsish_span_t* a, const _jsish_span_t* b) {
+	_jsish_key_reader_t ka;
+	_jsish_key_reader_t kb;
+	const unsigned char* x;
+	const unsigned char* y;
+	unsigned int shorter;
+	unsigned int i;
+	int ca;
+	int cb;
+	if ((a->key | b->key) & _JSISH_SPAN_UNESCAPE) {
+		_jsish_key_reader_init(&ka, text, a);
+		_jsish_key_reader_init(&kb, text, b);
+		do {
+			ca = _jsish_key_byte(&ka);
+			cb = _jsish_key_byte(&kb);
+		} while (ca == cb && ca >= 0);
+		return ca < cb ? -1 : ca > cb;
+	}
+	x = (const unsigned char*) &text[a->start + 1];
+	y = (const unsigned char*) &text[b->start + 1];
+	shorter = a->key < b->key ? a->key : b->key;
+	for (i = 0; i < shorter; ++i) {
+		if (x[i] != y[i]) {
+			return x[i] < y[i] ? -1 : 1;
+		}
+	}
+	return a->key < b->key ? -1 : a->key > b->key;
+}
+
+/* Sorts SIZE member spans by key like _jsish_sort_members() does, with
+ * SCRATCH room for as many, keeping equal keys in order. */
+void _jsish_sort_spans(
+		const char* text,
+		_jsish_span_t* spans,
+		_jsish_span_t* scratch,
+		unsigned int size) {
+	_jsish_span_t* from;
+	_jsish_span_t* to;
+	_jsish_span_t* swap;
+	_jsish_span_t span;
+	unsigned int width;
+	unsigned int start;
+	unsigned int middle;
+	unsigned int end;
+	unsigned int i;
+	unsigned int j;
+	unsigned int k;
+	for (start = 0; start < size; start += 8) {
+		end = start + 8 < size ? start + 8 : size;
+		for (i = start + 1; i < end; ++i) {
+			span = spans[i];
+			for (j = i; j > start
+					&& _jsish_compare_spans(text, &spans[j - 1], &span) > 0; --j) {
+				spans[j] = spans[j - 1];
+			}
+			spans[j] = span;
+		}
+	}
+
+	from = spans;
+	to = scratch;
+	for (width = 8; width < size; width *= 2) {
+		for (start = 0; start < size; start += width * 2) {
+			middle = start + width < size ? start + width : size;
+			end = middle + width < size ? middle + width : size;
+			i = start;
+			j = middle;
+			for (k = start; k < end; ++k) {
+				if (j == end || (i < middle && _jsish_compare_spans(
+							text, &from[i], &from[j]) <= 0)) {
+					to[k] = from[i++];
+				} else {
+					to[k] = from[j++];
+				}
+			}
+		}
+		swap = from;
+		from = to;
+		to = swap;
+	}
+	if (from != spans) {
+		JSISH_MEMCPY(spans, from, size * sizeof(_jsish_span_t));
+	}
+}
+
+/* Where the output has to stop while objects are held back: below the spans,
+ * or the whole scratch buffer once there are none. */
+void _jsish_sorter_limit(_jsish_sorter_t* sorter) {
+	sorter->out->size = sorter->objects
+		? (unsigned int) ((char*) (sorter->top - sorter->count)
+			- sorter->out->buffer)
+		: sorter->size;
+}
+
+/* Starts holding back the output for an object. */
+void _jsish_sorter_open(_jsish_sorter_t* sorter) {
+	if (!sorter->objects++) {
+		_jsish_flush(sorter->out);
+		sorter->out->write = NULL;
+		_jsish_sorter_limit(sorter);
+	}
+}
+
+/* Records a member whose key of KEY characters starts at the end of the
+ * output. Returns 0 if the scratch buffer is too small. */
+int _jsish_sorter_member(_jsish_sorter_t* sorter, unsigned int key) {
+	_jsish_writer_t* out;
+	_jsish_span_t* span;
+	out = sorter->out;
+	span = sorter->top - sorter->count - 1;
+	if (out->length > out->size
+			|| (char*) span < out->buffer + out->length) {
+		return 0;
+	}
+	span->start = out->length;
+	span->key = key;
+	sorter->count++;
+	_jsish_sorter_limit(sorter);
+
+	return 1;
+}
+
+/* Puts the members of the object that ends at the end of the output in order
+ * by key, given the number of spans recorded before it. The spans are moved
+ * into the free space between the output and the spans to be sorted, and then
+ * the members are copied there in order and back. Returns 0 if the scratch
+ * buffer is too small. */
+int _jsish_sorter_close(_jsish_sorter_t* sorter, unsigned int first) {
+	_jsish_writer_t* out;
+	_jsish_span_t* spans;
+	_jsish_span_t* scratch;
+	_jsish_span_t span;
+	char* text;
+	char* gap;
+	unsigned int size;
+	unsigned int begin;
+	unsigned int length;
+	unsigned int i;
+	out = sorter->out;
+	if (out->length > out->size) {
+		return 0;
+	}
+	size = sorter->count - first;
+	spans = sorter->top - sorter->count;
+	text = out->buffer;
+	gap = &text[out->length];
+	if (size > 1) {
+		/* Recorded newest first. */
+		for (i = 0; i < size / 2; ++i) {
+			span = spans[i];
+			spans[i] = spans[size - 1 - i];
+			spans[size - 1 - i] = span;
+		}
+		for (i = 0; i + 1 < size; ++i) {
+			spans[i].length = spans[i + 1].start - 1 - spans[i].start;
+		}
+		spans[size - 1].length = out->length - spans[size - 1].start;
+
+		scratch = (_jsish_span_t*) (void*) (gap + (sizeof(unsigned int)
+				- (size_t) gap % sizeof(unsigned int)) % sizeof(unsigned int));
+		begin = spans[0].start;
+		length = out->length - begin;
+		if ((char*) (scratch + size) > (char*) spans
+				|| gap + length > (char*) spans) {
+			return 0;
+		}
+		_jsish_sort_spans(text, spans, scratch, size);
+
+		length = 0;
+		for (i = 0; i < size; ++i) {
+			if (i) {
+				gap[length++] = ',';
+			}
+			JSISH_MEMCPY(&gap[length], &text[spans[i].start], spans[i].length);
+			length += spans[i].length;
+		}
+		JSISH_MEMCPY(&text[begin], gap, length);
+	}
+
+	sorter->count = first;
+	if (!--sorter->objects) {
+		out->write = sorter->write;
+	}
+	_jsish_sorter_limit(sorter);
+
+	return 1;
+}
+
+jsish_result_t jsish_minify(
+		const char* source,
+		unsigned int flags,
+		jsish_write_t write,
+		void* user,
+		char* scratch,
+		unsigned int scratch_size) {
+	unsigned int open[JSISH_MAX_DEPTH];
+	return jsish_minify_ex(source, flags, write, user, scratch, scratch_size,
+			open, JSISH_MAX_DEPTH);
+}
+
+/* OPEN holds, for each open container, the number of spans recorded before
+ * it, times two, plus one for an object. */
+jsish_result_t jsish_minify_ex(
+		const char* source,
+		unsigned int flags,
+		jsish_write_t write,
+		void* user,
+		char* scratch,
+		unsigned int scratch_size,
+		unsigned int* open,
+		unsigned int open_size) {
+	_jsish_writer_t out;
+	_jsish_sorter_t sorter;
+	_jsish_sorter_t* sort;
+	unsigned int depth;
+	unsigned int state;
+	unsigned int pos;
+	unsigned int run;
+	unsigned int next;
+	unsigned int i;
+	const char* literal;
+	const char* end;
+	jsish_value_t number;
+	char c;
+	out.buffer = scratch;
+	out.size = scratch_size;
+	out.length = 0;
+	out.write = write;
+	out.user = user;
+	out.failed = 0;
+	_JSISH_STAT_RESET(&out);
+	sort = NULL;
+	if (flags & JSISH_SORT_KEYS) {
+		sort = &sorter;
+		sorter.out = &out;
+		sorter.write = write;
+		sorter.size = scratch_size;
+		/* The spans are aligned for unsigned int. */
+		end = &scratch[scratch_size];
+		i = (unsigned int) ((size_t) end % sizeof(unsigned int));
+		sorter.top = (_jsish_span_t*) (void*) (i < scratch_size
+			? &scratch[scratch_size - i]
+			: scratch);
+		sorter.count = 0;
+		sorter.objects = 0;
+	}
+	depth = 0;
+	state = _JSISH_EXPECT_VALUE;
+	pos = 0;
+	/* Where the source that is yet to be written, as it is, starts. */
+	run = 0;
+
+	/* Follows _jsish_decode_tokens() through the document like
+	 * jsish_measure() does. The source is written out in runs between
+	 * whitespace, and whatever is written differently. */
+	while (state != _JSISH_DONE) {
+		next = _jsish_whitespace_end(source, pos);
+		if (next != pos) {
+			_jsish_write(&out, &source[run], pos - run);
+			pos = run = next;
+		}
+		c = source[pos];
+		if (c == '\0') {
+			return JSISH_ERR_MALFORMED;
+		}
+
+		switch (state) {
+			case _JSISH_EXPECT_COLON:
+				if (c != ':') {
+					return JSISH_ERR_MALFORMED;
+				}
+				pos++;
+				state = _JSISH_EXPECT_VALUE;
+				continue;
+			case _JSISH_EXPECT_ARRAY_SEP:
+			case _JSISH_EXPECT_OBJECT_SEP:
+				if (c == ',') {
+					pos++;
+					state = state == _JSISH_EXPECT_ARRAY_SEP
+						? _JSISH_EXPECT_VALUE
+						: _JSISH_EXPECT_KEY;
+					continue;
+				}
+				/* Fall through. */
+			case _JSISH_EXPECT_ELEMENT:
+			case _JSISH_EXPECT_MEMBER:
+				if (c == (open[depth - 1] & 1 ? '}' : ']')) {
+					depth--;
+					if (sort && c == '}') {
+						_jsish_write(&out, &source[run], pos - run);
+						run = pos;
+						if (!_jsish_sorter_close(sort, open[depth] >> 1)) {
+							return JSISH_ERR_MEM_OVERFLOW;
+						}
+					}
+					pos++;
+					state = !depth ? _JSISH_DONE
+						: open[depth - 1] & 1 ? _JSISH_EXPECT_OBJECT_SEP
+						: _JSISH_EXPECT_ARRAY_SEP;
+					continue;
+				}
+				if (state == _JSISH_EXPECT_ARRAY_SEP
+						|| state == _JSISH_EXPECT_OBJECT_SEP) {
+					return JSISH_ERR_MALFORMED;
+				}
+				if (state == _JSISH_EXPECT_ELEMENT) {
+					break;
+				}
+				/* Fall through. */
+			case _JSISH_EXPECT_KEY:
+				if (c != '"') {
+					return JSISH_ERR_MALFORMED;
+				}
+				next = _jsish_measure_string(source, pos, flags);
+				if (!next) {
+					return JSISH_ERR_MALFORMED;
+				}
+				if (sort) {
+					_jsish_write(&out, &source[run], pos - run);
+					run = pos;
+					/* Compared unescaped, as the decoder would store it. */
+					i = next - pos - 2;
+					if ((flags & JSISH_UNESCAPE)
+							&& JSISH_MEMCHR(&source[pos + 1], '\\', i)
+							&& _jsish_can_unescape(
+								&source[pos + 1], &source[next - 1])) {
+						i |= _JSISH_SPAN_UNESCAPE;
+					}
+					if (!_jsish_sorter_member(sort, i)) {
+						return JSISH_ERR_MEM_OVERFLOW;
+					}
+				}
+				pos = next;
+				state = _JSISH_EXPECT_COLON;
+				continue;
+			default: /* _JSISH_EXPECT_VALUE */
+				break;
+		}
+
+		literal = NULL;
+		switch (c) {
+			case '"':
+				pos = _jsish_measure_string(source, pos, flags);
+				if (!pos) {
+					return JSISH_ERR_MALFORMED;
+				}
+				break;
+			case '-': case '0': case '1': case '2': case '3': case '4': case '5':
+			case '6': case '7': case '8': case '9':
+				if (!(flags & JSISH_NORMALIZE_NUMBERS)) {
+					end = _jsish_skip_number(&source[pos]);
+					if (!end) {
+						return JSISH_ERR_MALFORMED;
+					}
+					pos = (unsigned int) (end - source);
+					break;
+				}
+				if (_jsish_parse_number(&source[pos], &end, &number,
+							flags & JSISH_INTEGERS) != JSISH_OK) {
+					return JSISH_ERR_MALFORMED;
+				}
+				_jsish_write(&out, &source[run], pos - run);
+				if (number.type == JSISH_INTEGER) {
+					_jsish_encode_integer(&number, &out);
+				} else {
+					_jsish_encode_number(&number, &out);
+				}
+				pos = run = (unsigned int) (end - source);
+				break;
+			case 't':
+				literal = "true";
+				break;
+			case 'f':
+				literal = "false";
+				break;
+			case 'n':
+				literal = "null";
+				break;
+			case '[': case '{':
+				if (depth == open_size) {
+					return JSISH_ERR_DEPTH;
+				}
+				open[depth] = c == '{';
+				if (sort && c == '{') {
+					_jsish_write(&out, &source[run], pos - run);
+					run = pos;
+					_jsish_sorter_open(sort);
+					open[depth] |= sort->count << 1;
+				}
+				depth++;
+				pos++;
+				state = c == '['
+					? _JSISH_EXPECT_ELEMENT
+					: _JSISH_EXPECT_MEMBER;
+				continue;
+			default:
+				return JSISH_ERR_MALFORMED;
+		}
+		if (literal) {
+			for (i = 0; literal[i] != '\0'; ++i) {
+				if (source[pos + i] != literal[i]) {
+					return JSISH_ERR_MALFORMED;
+				}
+			}
+			pos += i;
+		}
+
+		state = !depth ? _JSISH_DONE
+			: open[depth - 1] & 1 ? _JSISH_EXPECT_OBJECT_SEP
+			: _JSISH_EXPECT_ARRAY_SEP;
+	}
+
+	_jsish_write(&out, &source[run], pos - run);
+	_jsish_flush(&out);
+
+	return out.failed ? JSISH_ERR_WRITE : JSISH_OK;
+}
+
+/* An object or array being decoded by jsish_struct_decode(): its field and
+ * where it is stored, and for an object, the field of the member being
+ * decoded and the number of the one after it, or for an array, the number of
+ * elements so far. */
+typedef struct {
+	const jsish_field_t* field;
+	char* base;
+	const jsish_field_t* member;
+	unsigned int next;
+} _jsish_struct_frame_t;
+
+typedef struct {
+	_jsish_struct_frame_t stack[JSISH_MAX_STRUCT_DEPTH];
+	unsigned int depth;
+	/* The top struct, as a field of nothing. */
+	jsish_field_t root;
+	char* data;
+	jsish_result_t result;
+} _jsish_struct_reader_t;
+
+/* Describes the top struct with FIELDS as a field, for ROOT. */
+void _jsish_struct_root(
+		jsish_field_t* root, const jsish_field_t* fields, unsigned int count) {
+	root->name = NULL;
+	root->type = JSISH_FIELD_OBJECT;
+	root->offset = 0;
+	root->fields = (jsish_field_t*) fields;
+	root->fields_count = count;
+	root->capacity = 0;
+	root->stride = 0;
+	root->count_offset = 0;
+	root->hash = 0;
+}
+
+jsish_result_t _jsish_struct_compile(
+		jsish_field_t* fields, unsigned int count, unsigned int depth) {
+	jsish_result_t result;
+	unsigned int i;
+	if (depth > JSISH_MAX_STRUCT_DEPTH) {
+		return JSISH_ERR_DEPTH;
+	}
+	for (i = 0; i < count; ++i) {
+		fields[i].hash = fields[i].name ? _jsish_hash(fields[i].name) : 0;
+		switch (fields[i].type) {
+			case JSISH_FIELD_BOOL: case JSISH_FIELD_INT:
+			case JSISH_FIELD_INTEGER: case JSISH_FIELD_NUMBER:
+			case JSISH_FIELD_STRING:
+				continue;
+			case JSISH_FIELD_ARRAY:
+				if (!fields[i].fields || fields[i].fields_count != 1
+						|| !fields[i].stride) {
+					return JSISH_ERR_MALFORMED;
+				}
+				/* Fall through. */
+			case JSISH_FIELD_OBJECT:
+				if (!fields[i].fields && fields[i].fields_count) {
+					return JSISH_ERR_MALFORMED;
+				}
+				result = _jsish_struct_compile(
+						fields[i].fields, fields[i].fields_count, depth + 1);
+				if (result != JSISH_OK) {
+					return result;
+				}
+				continue;
+			default:
+				return JSISH_ERR_MALFORMED;
+		}
+	}
+	return JSISH_OK;
+}
+
+jsish_result_t jsish_struct_compile(jsish_field_t* fields, unsigned int count) {
+	/* The top struct is the first level. */
+	return _jsish_struct_compile(fields, count, 1);
+}
+
+/* Finds the field of the object in FRAME named KEY, starting after the last
+ * one found and wrapping around, or returns NULL. */
+const jsish_field_t*
+_jsish_struct_field(_jsish_struct_frame_t* frame, const char* key) {
+	const jsish_field_t* fields;
+	unsigned int count;
+	unsigned int hash;
+	unsigned int i;
+	unsigned int n;
+	fields = frame->field->fields;
+	count = frame->field->fields_count;
+	hash = _jsish_hash(key);
+	i = frame->next;
+	for (n = 0; n < count; ++n) {
+		if (fields[i].hash == hash && !JSISH_STRCMP(fields[i].name, key)) {
+			frame->next = i + 1 < count ? i + 1 : 0;
+			return &fields[i];
+		}
+		if (++i == count) {
+			i = 0;
+		}
+	}
+	return NULL;
+}
+
+/* Returns the field that the value just begun is decoded into and sets
+ * ADDRESS to where it goes, or sets the result and returns NULL if there is
+ * no room for it, or no field as it is the root. */
+const jsish_field_t*
+_jsish_struct_target(_jsish_struct_reader_t* reader, char** address) {
+	_jsish_struct_frame_t* frame;
+	const jsish_field_t* element;
+	if (!reader->depth) {
+		reader->result = JSISH_ERR_TYPE;
+		return NULL;
+	}
+	frame = &reader->stack[reader->depth - 1];
+	if (frame->field->type == JSISH_FIELD_OBJECT) {
+		*address = frame->base + frame->member->offset;
+		return frame->member;
+	}
+	if (frame->next == frame->field->capacity) {
+		reader->result = JSISH_ERR_MEM_OVERFLOW;
+		return NULL;
+	}
+	element = frame->field->fields;
+	*address = frame->base + frame->next++ * frame->field->stride
+		+ element->offset;
+	return element;
+}
+
+int _jsish_struct_mismatch(_jsish_struct_reader_t* reader) {
+	reader->result = JSISH_ERR_TYPE;
+	return JSISH_STOP;
+}
+
+int _jsish_struct_push(
+		_jsish_struct_reader_t* reader,
+		const jsish_field_t* field,
+		char* base) {
+	_jsish_struct_frame_t* frame;
+	if (reader->depth == JSISH_MAX_STRUCT_DEPTH) {
+		reader->result = JSISH_ERR_DEPTH;
+		return JSISH_STOP;
+	}
+	frame = &reader->stack[reader->depth++];
+	frame->field = field;
+	frame->base = base;
+	frame->member = NULL;
+	frame->next = 0;
+	return JSISH_CONTINUE;
+}
+
+int _jsish_struct_store_integer(
+		_jsish_struct_reader_t* reader,
+		const jsish_field_t* field,
+		char* address,
+		jsish_int_t value) {
+	switch (field->type) {
+		case JSISH_FIELD_INT:
+			if ((jsish_int_t) (int) value != value) {
+				return _jsish_struct_mismatch(reader);
+			}
+			*(int*) address = (int) value;
+			return JSISH_CONTINUE;
+		case JSISH_FIELD_INTEGER:
+			*(jsish_int_t*) address = value;
+			return JSISH_CONTINUE;
+		case JSISH_FIELD_NUMBER:
+			*(double*) address = (double) value;
+			return JSISH_CONTINUE;
+		default:
+			return _jsish_struct_mismatch(reader);
+	}
+}
+
+int _jsish_struct_on_null(void* user) {
+	const jsish_field_t* field;
+	char* address;
+	field = _jsish_struct_target((_jsish_struct_reader_t*) user, &address);
+	if (!field) {
+		return JSISH_STOP;
+	}
+	if (field->type == JSISH_FIELD_STRING) {
+		*(char**) address = NULL;
+	}
+	return JSISH_CONTINUE;
+}
+
+int _jsish_struct_on_bool(void* user, int value) {
+	_jsish_struct_reader_t* reader;
+	const jsish_field_t* field;
+	char* address;
+	reader = (_jsish_struct_reader_t*) user;
+	field = _jsish_struct_target(reader, &address);
+	if (!field) {
+		return JSISH_STOP;
+	}
+	if (field->type != JSISH_FIELD_BOOL) {
+		return _jsish_struct_mismatch(reader);
+	}
+	*(int*) address = value;
+	return JSISH_CONTINUE;
+}
+
+int _jsish_struct_on_number(void* user, double value) {
+	_jsish_struct_reader_t* reader;
+	const jsish_field_t* field;
+	char* address;
+	reader = (_jsish_struct_reader_t*) user;
+	field = _jsish_struct_target(reader, &address);
+	if (!field) {
+		return JSISH_STOP;
+	}
+	if (field->type == JSISH_FIELD_NUMBER) {
+		*(double*) address = value;
+		return JSISH_CONTINUE;
+	}
+	/* Such as 1e3, or 1.0, which are integers as well. */
+	if (value >= -9223372036854775808.0 && value < 9223372036854775808.0
+			&& (double) (jsish_int_t) value == value) {
+		return _jsish_struct_store_integer(
+				reader, field, address, (jsish_int_t) value);
+	}
+	return _jsish_struct_mismatch(reader);
+}
+
+int _jsish_struct_on_integer(void* user, jsish_int_t value) {
+	_jsish_struct_reader_t* reader;
+	const jsish_field_t* field;
+	char* address;
+	reader = (_jsish_struct_reader_t*) user;
+	field = _jsish_struct_target(reader, &address);
+	if (!field) {
+		return JSISH_STOP;
+	}
+	return _jsish_struct_store_integer(reader, field, address, value);
+}
+
+int _jsish_struct_on_string(void* user, const char* value, int raw) {
+	_jsish_struct_reader_t* reader;
+	const jsish_field_t* field;
+	char* address;
+	reader = (_jsish_struct_reader_t*) user;
+	field = _jsish_struct_target(reader, &address);
+	if (!field) {
+		return JSISH_STOP;
+	}
+	if (field->type != JSISH_FIELD_STRING || raw) {
+		return _jsish_struct_mismatch(reader);
+	}
+	/* In the source, which is writable. */
+	*(char**) address = (char*) value;
+	return JSISH_CONTINUE;
+}
+
+int _jsish_struct_on_key(void* user, const char* key, int raw) {
+	_jsish_struct_frame_t* frame;
+	_jsish_struct_reader_t* reader;
+	reader = (_jsish_struct_reader_t*) user;
+	if (raw) {
+		/* Still escaped, so it cannot equal a name. */
+		return JSISH_SKIP;
+	}
+	frame = &reader->stack[reader->depth - 1];
+	frame->member = _jsish_struct_field(frame, key);
+	return frame->member ? JSISH_CONTINUE : JSISH_SKIP;
+}
+
+int _jsish_struct_on_array_begin(void* user) {
+	_jsish_struct_reader_t* reader;
+	const jsish_field_t* field;
+	char* address;
+	reader = (_jsish_struct_reader_t*) user;
+	field = _jsish_struct_target(reader, &address);
+	if (!field) {
+		return JSISH_STOP;
+	}
+	if (field->type != JSISH_FIELD_ARRAY) {
+		return _jsish_struct_mismatch(reader);
+	}
+	return _jsish_struct_push(reader, field, address);
+}
+
+int _jsish_struct_on_array_end(void* user) {
+	_jsish_struct_frame_t* frame;
+	_jsish_struct_reader_t* reader;
+	reader = (_jsish_struct_reader_t*) user;
+	frame = &reader->stack[--reader->depth];
+	/* The count is in the struct holding the array. */
+	*(unsigned int*) (frame->base - frame->field->offset
+			+ frame->field->count_offset) = frame->next;
+	return JSISH_CONTINUE;
+}
+
+int _jsish_struct_on_object_begin(void* user) {
+	_jsish_struct_reader_t* reader;
+	const jsish_field_t* field;
+	char* address;
+	reader = (_jsish_struct_reader_t*) user;
+	if (!reader->depth) {
+		return _jsish_struct_push(reader, &reader->root, reader->data);
+	}
+	field = _jsish_struct_target(reader, &address);
+	if (!field) {
+		return JSISH_STOP;
+	}
+	if (field->type != JSISH_FIELD_OBJECT) {
+		return _jsish_struct_mismatch(reader);
+	}
+	return _jsish_struct_push(reader, field, address);
+}
+
+int _jsish_struct_on_object_end(void* user) {
+	((_jsish_struct_reader_t*) user)->depth--;
+	return JSISH_CONTINUE;
+}
+
+static const jsish_events_t _jsish_struct_events = {
+	_jsish_struct_on_null,
+	_jsish_struct_on_bool,
+	_jsish_struct_on_number,
+	_jsish_struct_on_integer,
+	_jsish_struct_on_string,
+	_jsish_struct_on_key,
+	_jsish_struct_on_array_begin,
+	_jsish_struct_on_array_end,
+	_jsish_struct_on_object_begin,
+	_jsish_struct_on_object_end
+};
+
+jsish_result_t jsish_struct_decode(
+		char* source,
+		unsigned int flags,
+		const jsish_field_t* fields,
+		unsigned int fields_count,
+		void* data) {
+	_jsish_struct_reader_t reader;
+	jsish_result_t result;
+	reader.depth = 0;
+	_jsish_struct_root(&reader.root, fields, fields_count);
+	reader.data = (char*) data;
+	reader.result = JSISH_OK;
+	result = jsish_parse(source,
+			(flags & JSISH_VALIDATE_UTF8) | JSISH_INTEGERS | JSISH_UNESCAPE,
+			&_jsish_struct_events, &reader);
+	return result == JSISH_STOPPED ? reader.result : result;
+}
+
+/* Writes the field at ADDRESS, at nesting level DEPTH. Recurses for each
+ * object and array, which jsish_struct_compile() limits to
+ * JSISH_MAX_STRUCT_DEPTH levels. */
+void _jsish_struct_write(
+		_jsish_writer_t* out,
+		const jsish_field_t* field,
+		const char* address,
+		unsigned int depth) {
+	const jsish_field_t* element;
+	jsish_value_t value;
+	unsigned int count;
+	unsigned int i;
+	switch (field->type) {
+		case JSISH_FIELD_BOOL:
+			_JSISH_STAT_ADD(out, values[JSISH_BOOL], 1);
+			value.data.vbool = *(const int*) address;
+			_jsish_encode_bool(&value, out);
+			break;
+		case JSISH_FIELD_INT: case JSISH_FIELD_INTEGER:
+			_JSISH_STAT_ADD(out, values[JSISH_INTEGER], 1);
+			value.data.vint = field->type == JSISH_FIELD_INT
+				? *(const int*) address
+				: *(const jsish_int_t*) address;
+			_jsish_encode_integer(&value, out);
+			break;
+		case JSISH_FIELD_NUMBER:
+			_JSISH_STAT_ADD(out, values[JSISH_NUMBER], 1);
+			value.data.vnum = *(const double*) address;
+			_jsish_encode_number(&value, out);
+			break;
+		case JSISH_FIELD_STRING:
+			if (!*(char* const*) address) {
+				_JSISH_STAT_ADD(out, values[JSISH_NULL], 1);
+				_jsish_write(out, "null", 4);
+				break;
+			}
+			_JSISH_STAT_ADD(out, values[JSISH_STRING], 1);
+			_jsish_write_string(out, *(char* const*) address, 0);
+			break;
+		case JSISH_FIELD_OBJECT:
+			_JSISH_STAT_ADD(out, values[JSISH_KEYVAL], 1);
+			_JSISH_STAT_MAX(out, max_depth, depth + 1);
+			_jsish_append(out, '{');
+			for (i = 0; i < field->fields_count; ++i) {
+				if (i) {
+					_jsish_append(out, ',');
+				}
+				element = &field->fields[i];
+				_JSISH_STAT_ADD(out, values[JSISH_PAIR], 1);
+				_jsish_write_string(out, element->name, 0);
+				_jsish_append(out, ':');
+				_jsish_struct_write(
+						out, element, address + element->offset, depth + 1);
+			}
+			_jsish_append(out, '}');
+			break;
+		case JSISH_FIELD_ARRAY:
+			_JSISH_STAT_ADD(out, values[JSISH_ARRAY], 1);
+			_JSISH_STAT_MAX(out, max_depth, depth + 1);
+			count = *(const unsigned int*) (address - field->offset
+					+ field->count_offset);
+			if (count > field->capacity) {
+				count = field->capacity;
+			}
+			element = field->fields;
+			_jsish_append(out, '[');
+			for (i = 0; i < count; ++i) {
+				if (i) {
+					_jsish_append(out, ',');
+				}
+				_jsish_struct_write(out, element,
+						address + i * field->stride + element->offset,
+						depth + 1);
+			}
+			_jsish_append(out, ']');
+			break;
+		default:
+			break;
+	}
+}
+
+jsish_result_t jsish_struct_encode(
+		const void* data,
+		const jsish_field_t* fields,
+		unsigned int fields_count,
 		char* buffer,
 		unsigned int buffer_size,
 		unsigned int* encoded_bytes) {
-	int sep;
-	_jsish_append(buffer, '{', buffer_size, encoded_bytes);
-	sep = 0;
-	while (value != NULL) {
-		/* Write the field separator. */
-		if (sep) {
-			_jsish_append(buffer, ',', buffer_size, encoded_bytes); 
+	_jsish_writer_t out;
+	jsish_field_t root;
+	jsish_result_t result;
+	out.buffer = buffer;
+	out.size = buffer_size;
+	out.length = 0;
+	out.write = NULL;
+	out.user = NULL;
+	out.failed = 0;
+	_JSISH_STAT_RESET(&out);
+	JSISH_BEGIN_PHASE(JSISH_PHASE_ENCODE);
+	_jsish_struct_root(&root, fields, fields_count);
+	_jsish_struct_write(&out, &root, (const char*) data, 0);
+	_JSISH_STAT_ADD(&out, bytes, out.length);
+	_jsish_append(&out, '\0');
+	*encoded_bytes = out.length;
+	result = out.length > buffer_size ? JSISH_ERR_MEM_OVERFLOW : JSISH_OK;
+	JSISH_END_PHASE(JSISH_PHASE_ENCODE, result, _JSISH_STATS(&out));
+
+	return result;
+}
+
+jsish_value_t* jsish_get_property(const jsish_value_t* value, const char* key) {
+	const _jsish_index_slot_t* table;
+	const jsish_value_t* pair;
+	unsigned int capacity;
+	unsigned int hash;
+	unsigned int low;
+	unsigned int high;
+	unsigned int i;
+	table = value->type == JSISH_KEYVAL
+		? (const _jsish_index_slot_t*) _JSISH_INDEX(value) : NULL;
+	if (table) {
+		capacity = _jsish_index_capacity(JSISH_OBJECT_SIZE(value));
+		hash = _jsish_hash(key);
+		for (i = hash & (capacity - 1);
+				table[i].hash;
+				i = (i + 1) & (capacity - 1)) {
+			pair = (const jsish_value_t*) table - table[i].pair;
+			if (table[i].hash == hash
+					&& JSISH_STRCMP(JSISH_KV_KEY(pair), key) == 0) {
+				return JSISH_KV_VALUE(pair);
+			}
+		}
+		return NULL;
+	}
+
+	if (value->type == JSISH_KEYVAL && _JSISH_IS_SORTED(value)) {
+		/* Find the first member with the key, as the scan below would. */
+		low = 0;
+		high = JSISH_OBJECT_SIZE(value);
+		while (low < high) {
+			i = low + (high - low) / 2;
+			if (JSISH_STRCMP(JSISH_KV_KEY(JSISH_KV_INDEX(value, i)), key) < 0) {
+				low = i + 1;
+			} else {
+				high = i;
+			}
 		}
+		if (low < JSISH_OBJECT_SIZE(value)) {
+			pair = JSISH_KV_INDEX(value, low);
+			if (JSISH_STRCMP(JSISH_KV_KEY(pair), key) == 0) {
+				return JSISH_KV_VALUE(pair);
+			}
+		}
+		return NULL;
+	}
+
+	for (value = JSISH_KV_PAIR(value); value; value = JSISH_KV_NEXT(value)) {
+		if (JSISH_STRCMP(JSISH_KV_KEY(value), key) == 0) {
+			return JSISH_KV_VALUE(value);
+		}
+	}
+
+	return NULL;
+}
+
+jsish_result_t jsish_path_compile(
+		jsish_path_t* query,
+		const char* const* paths,
+		unsigned int count,
+		jsish_path_node_t* nodes,
+		unsigned int nodes_size) {
+	const char* s;
+	const char* end;
+	jsish_path_node_t* segment;
+	unsigned int node;
+	unsigned int child;
+	unsigned int last;
+	unsigned int length;
+	unsigned int hash;
+	unsigned int index;
+	unsigned int i;
+	unsigned int p;
+	char c;
+	if (nodes_size == 0) {
+		return JSISH_ERR_MEM_OVERFLOW;
+	}
+	query->nodes = nodes;
+	query->nodes_count = 1;
+	query->targets = 0;
+	query->wildcards = 0;
+	nodes[0].segment = "";
+	nodes[0].length = 0;
+	nodes[0].hash = 0;
+	nodes[0].index = JSISH_PATH_NONE;
+	nodes[0].child = 0;
+	nodes[0].sibling = 0;
+	nodes[0].path = JSISH_PATH_NONE;
+
+	for (p = 0; p < count; ++p) {
+		s = paths[p];
+		if (*s != '/' && *s != '\0') {
+			return JSISH_ERR_MALFORMED;
+		}
+		node = 0;
+		while (*s == '/') {
+			++s;
+			/* Unescape the segment to hash it, and see whether it is an array
+			 * index: digits without leading zeros. */
+			hash = _JSISH_HASH_BASIS;
+			index = *s >= '0' && *s <= '9' ? 0 : JSISH_PATH_NONE;
+			for (end = s; *end != '\0' && *end != '/'; ++end) {
+				c = *end;
+				if (c == '~') {
+					if (end[1] != '0' && end[1] != '1') {
+						return JSISH_ERR_MALFORMED;
+					}
+					c = *++end == '0' ? '~' : '/';
+				}
+				hash = _JSISH_HASH_STEP(hash, c);
+				if (index == JSISH_PATH_NONE) {
+					continue;
+				} else if (c < '0' || c > '9' || (index == 0 && end > s)
+						|| index > (JSISH_PATH_ANY - 1 - (c - '0')) / 10) {
+					index = JSISH_PATH_NONE;
+				} else {
+					index = index * 10 + (c - '0');
+				}
+			}
+			length = (unsigned int) (end - s);
+			if (length == 1 && *s == '*') {
+				index = JSISH_PATH_ANY;
+				query->wildcards = 1;
+			}
+
+			/* Share the node of an equal segment under the same parent. */
+			last = 0;
+			for (child = nodes[node].child; child; child = nodes[child].sibling) {
+				if (nodes[child].length == length) {
+					for (i = 0; i < length && nodes[child].segment[i] == s[i]; ++i);
+					if (i == length) {
+						break;
+					}
+				}
+				last = child;
+			}
+			if (!child) {
+				if (query->nodes_count == nodes_size) {
+					return JSISH_ERR_MEM_OVERFLOW;
+				}
+				child = query->nodes_count++;
+				segment = &nodes[child];
+				segment->segment = s;
+				segment->length = length;
+				segment->hash = hash ? hash : 1;
+				segment->index = index;
+				segment->child = 0;
+				segment->sibling = 0;
+				segment->path = JSISH_PATH_NONE;
+				if (last) {
+					nodes[last].sibling = child;
+				} else {
+					nodes[node].child = child;
+				}
+			}
+			node = child;
+			s = end;
+		}
+		if (nodes[node].path == JSISH_PATH_NONE) {
+			nodes[node].path = p;
+			query->targets++;
+		}
+	}
+
+	return JSISH_OK;
+}
+
+typedef struct {
+	const jsish_path_node_t* nodes;
+	jsish_decoder_t* decoder;
+	jsish_match_t* matches;
+	unsigned int matches_size;
+	unsigned int count;
+	/* Paths still to be found, or JSISH_PATH_NONE if there are wildcards and
+	 * everything has to be looked at. */
+	unsigned int remaining;
+} _jsish_path_context_t;
+
+void _jsish_path_begin(
+		_jsish_path_context_t* context,
+		const jsish_path_t* query,
+		jsish_match_t* matches,
+		unsigned int matches_size) {
+	context->nodes = query->nodes;
+	context->decoder = NULL;
+	context->matches = matches;
+	context->matches_size = matches_size;
+	context->count = 0;
+	context->remaining = query->wildcards ? JSISH_PATH_NONE : query->targets;
+}
+
+jsish_result_t _jsish_path_found(
+		_jsish_path_context_t* context, unsigned int path, jsish_value_t* value) {
+	if (context->count == context->matches_size) {
+		return JSISH_ERR_MEM_OVERFLOW;
+	}
+	context->matches[context->count].path = path;
+	context->matches[context->count].value = value;
+	context->count++;
+	if (context->remaining != JSISH_PATH_NONE) {
+		context->remaining--;
+	}
+
+	return JSISH_OK;
+}
+
+/* Whether the segment of NODE, unescaped, is the LENGTH characters at KEY, or
+ * all of KEY if LENGTH is JSISH_PATH_NONE. */
+int _jsish_segment_equals(
+		const jsish_path_node_t* node, const char* key, unsigned int length) {
+	unsigned int i;
+	unsigned int j;
+	char c;
+	for (i = 0, j = 0; i < node->length; ++i, ++j) {
+		c = node->segment[i];
+		if (c == '~') {
+			c = node->segment[++i] == '0' ? '~' : '/';
+		}
+		if (j == length || key[j] != c) {
+			return 0;
+		}
+	}
+
+	return length == JSISH_PATH_NONE ? key[j] == '\0' : j == length;
+}
+
+/* Same as _jsish_hash(), of the LENGTH characters at S. */
+unsigned int _jsish_hash_chars(const char* s, unsigned int length) {
+	unsigned int hash;
+	unsigned int i;
+	hash = _JSISH_HASH_BASIS;
+	for (i = 0; i < length; ++i) {
+		hash = _JSISH_HASH_STEP(hash, s[i]);
+	}
+	return hash ? hash : 1;
+}
+
+/* Whether any of the children of NODE is a wildcard. */
+int _jsish_path_wildcard(const jsish_path_node_t* nodes, unsigned int node) {
+	unsigned int child;
+	for (child = nodes[node].child; child; child = nodes[child].sibling) {
+		if (nodes[child].index == JSISH_PATH_ANY) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Collects up to 32 of the children that are not wildcards, from *CHILD on,
+ * into CANDIDATES and moves *CHILD past them. Returns how many there are. The
+ * candidates are put in the hash table SLOTS for looking up keys, which even
+ * for a single candidate is quicker than comparing each key with it. */
+unsigned int _jsish_path_candidates(
+		const jsish_path_node_t* nodes,
+		unsigned int* child,
+		unsigned int* candidates,
+		unsigned char* slots) {
+	unsigned int count;
+	unsigned int i;
+	for (i = 0; i < 64; ++i) {
+		slots[i] = 0;
+	}
+	for (count = 0; *child && count < 32; *child = nodes[*child].sibling) {
+		if (nodes[*child].index != JSISH_PATH_ANY) {
+			for (i = nodes[*child].hash & 63; slots[i]; i = (i + 1) & 63);
+			slots[i] = (unsigned char) (count + 1);
+			candidates[count++] = *child;
+		}
+	}
+	return count;
+}
+
+/* Returns which of the COUNT CANDIDATES equals the LENGTH characters at KEY,
+ * or all of KEY if LENGTH is JSISH_PATH_NONE, or COUNT if none does. */
+unsigned int _jsish_path_lookup(
+		const jsish_path_node_t* nodes,
+		const unsigned int* candidates,
+		unsigned int count,
+		const unsigned char* slots,
+		const char* key,
+		unsigned int length) {
+	unsigned int hash;
+	unsigned int i;
+	unsigned int j;
+	hash = length == JSISH_PATH_NONE
+		? _jsish_hash(key) : _jsish_hash_chars(key, length);
+	for (i = hash & 63; slots[i]; i = (i + 1) & 63) {
+		j = slots[i] - 1;
+		if (nodes[candidates[j]].hash == hash
+				&& _jsish_segment_equals(&nodes[candidates[j]], key, length)) {
+			return j;
+		}
+	}
+	return count;
+}
+
+jsish_result_t _jsish_path_match_value(
+		_jsish_path_context_t* context,
+		unsigned int node,
+		const jsish_value_t* value);
+
+/* Matches the children of NODE against the members of an object. With a hash
+ * table each segment is looked up directly. Otherwise the members are gone
+ * through once for up to 32 segments at a time, remembering which have been
+ * found so that only the first of equal keys counts. */
+jsish_result_t _jsish_path_match_members(
+		_jsish_path_context_t* context,
+		unsigned int node,
+		const jsish_value_t* object) {
+	const jsish_path_node_t* nodes;
+	const _jsish_index_slot_t* table;
+	const jsish_value_t* pair;
+	const char* key;
+	jsish_result_t result;
+	unsigned int candidates[32];
+	unsigned char slots[64];
+	unsigned int capacity;
+	unsigned int child;
+	unsigned int count;
+	unsigned int hash;
+	unsigned int i;
+	unsigned long wanted;
+	unsigned long seen;
+	int wildcard;
+	nodes = context->nodes;
+	table = (const _jsish_index_slot_t*) _JSISH_INDEX(object);
+	if (table) {
+		capacity = _jsish_index_capacity(JSISH_OBJECT_SIZE(object));
+		for (child = nodes[node].child; child; child = nodes[child].sibling) {
+			if (nodes[child].index == JSISH_PATH_ANY) {
+				for (pair = JSISH_KV_FIRST(object);
+						pair && context->remaining;
+						pair = JSISH_KV_NEXT(pair)) {
+					result = _jsish_path_match_value(
+							context, child, JSISH_KV_VALUE(pair));
+					if (result != JSISH_OK) {
+						return result;
+					}
+				}
+				continue;
+			}
+			hash = nodes[child].hash;
+			for (i = hash & (capacity - 1);
+					table[i].hash;
+					i = (i + 1) & (capacity - 1)) {
+				pair = (const jsish_value_t*) table - table[i].pair;
+				key = JSISH_KV_KEY(pair);
+				if (table[i].hash == hash && _jsish_segment_equals(
+						&nodes[child], key, JSISH_PATH_NONE)) {
+					result = _jsish_path_match_value(
+							context, child, JSISH_KV_VALUE(pair));
+					if (result != JSISH_OK) {
+						return result;
+					}
+					break;
+				}
+			}
+			if (!context->remaining) {
+				break;
+			}
+		}
+		return JSISH_OK;
+	}
 
-		/* Encode the property name/key. */
-		_jsish_encode_string(
-				value->data.vobj.key,
-				buffer,
-				buffer_size,
-				encoded_bytes);
-		_jsish_append(buffer, ':', buffer_size, encoded_bytes);
+	wildcard = _jsish_path_wildcard(nodes, node);
+	child = nodes[node].child;
+	do {
+		count = _jsish_path_candidates(nodes, &child, candidates, slots);
+		wanted = count < 32 ? ((unsigned long) 1 << count) - 1 : 0xFFFFFFFFul;
+		seen = 0;
+		for (pair = JSISH_KV_FIRST(object);
+				pair && (wildcard || seen != wanted) && context->remaining;
+				pair = JSISH_KV_NEXT(pair)) {
+			i = _jsish_path_lookup(nodes, candidates, count, slots,
+					JSISH_KV_KEY(pair), JSISH_PATH_NONE);
+			if (i < count && !(seen >> i & 1)) {
+				seen |= (unsigned long) 1 << i;
+				result = _jsish_path_match_value(
+						context, candidates[i], JSISH_KV_VALUE(pair));
+				if (result != JSISH_OK) {
+					return result;
+				}
+			}
+			for (i = nodes[node].child; wildcard && i; i = nodes[i].sibling) {
+				if (nodes[i].index == JSISH_PATH_ANY) {
+					result = _jsish_path_match_value(
+							context, i, JSISH_KV_VALUE(pair));
+					if (result != JSISH_OK) {
+						return result;
+					}
+				}
+			}
+		}
+		/* Wildcards are done with in the first pass. */
+		wildcard = 0;
+	} while (child && context->remaining);
+
+	return JSISH_OK;
+}
 
-		/* Encode the value. */
-		_jsish_encode_value(
-				JSISH_KV_VALUE(value),
-				buffer,
-				buffer_size,
-				encoded_bytes);
+jsish_result_t _jsish_path_match_value(
+		_jsish_path_context_t* context,
+		unsigned int node,
+		const jsish_value_t* value) {
+	const jsish_path_node_t* nodes;
+	jsish_result_t result;
+	unsigned int child;
+	unsigned int i;
+	nodes = context->nodes;
+	if (nodes[node].path != JSISH_PATH_NONE) {
+		result = _jsish_path_found(
+				context, nodes[node].path, (jsish_value_t*) value);
+		if (result != JSISH_OK) {
+			return result;
+		}
+	}
+	if (value->type == JSISH_KEYVAL && nodes[node].child) {
+		return _jsish_path_match_members(context, node, value);
+	} else if (value->type != JSISH_ARRAY) {
+		return JSISH_OK;
+	}
 
-		sep = 1;
-		value = JSISH_KV_NEXT(value);
+	for (child = nodes[node].child;
+			child && context->remaining;
+			child = nodes[child].sibling) {
+		if (nodes[child].index == JSISH_PATH_ANY) {
+			for (i = 0; i < JSISH_ARRAY_SIZE(value) && context->remaining;
+					++i) {
+				result = _jsish_path_match_value(
+						context, child, JSISH_ARRAY_INDEX(value, i));
+				if (result != JSISH_OK) {
+					return result;
+				}
+			}
+		} else if (nodes[child].index < JSISH_ARRAY_SIZE(value)) {
+			result = _jsish_path_match_value(context, child,
+					JSISH_ARRAY_INDEX(value, nodes[child].index));
+			if (result != JSISH_OK) {
+				return result;
+			}
+		}
 	}
-	_jsish_append(buffer, '}', buffer_size, encoded_bytes);
+
+	return JSISH_OK;
 }
 
-void _jsish_encode_value(
+jsish_result_t jsish_path_match(
+		const jsish_path_t* query,
 		const jsish_value_t* value,
-		char* buffer,
-		unsigned int buffer_size,
-		unsigned int* encoded_bytes) {
-	switch (value->type) {
-		case JSISH_NULL:
-			_jsish_encode_null(buffer, buffer_size, encoded_bytes);
-			return;
-		case JSISH_NUMBER:
-			_jsish_encode_number(value, buffer, buffer_size, encoded_bytes);
-			return;
-		case JSISH_BOOL:
-			_jsish_encode_bool(value, buffer, buffer_size, encoded_bytes);
-			return;
-		case JSISH_STRING:
-			_jsish_encode_string(value, buffer, buffer_size, encoded_bytes);
-			return;
-		case JSISH_ARRAY:
-			_jsish_encode_array(value, buffer, buffer_size, encoded_bytes);
-			return;
-		case JSISH_KEYVAL:
-			_jsish_encode_object(value, buffer, buffer_size, encoded_bytes);
-			return;
+		jsish_match_t* matches,
+		unsigned int matches_size,
+		unsigned int* match_count) {
+	_jsish_path_context_t context;
+	jsish_result_t result;
+	_jsish_path_begin(&context, query, matches, matches_size);
+	result = _jsish_path_match_value(&context, 0, value);
+	if (match_count) {
+		*match_count = context.count;
+	}
+
+	return result;
+}
+
+jsish_result_t _jsish_path_match_text(
+		_jsish_path_context_t* context,
+		unsigned int node,
+		const jsish_cursor_t* cursor);
+
+/* Like _jsish_path_match_members(), for an object in the source. */
+jsish_result_t _jsish_path_match_text_members(
+		_jsish_path_context_t* context,
+		unsigned int node,
+		const jsish_cursor_t* object) {
+	const jsish_path_node_t* nodes;
+	jsish_cursor_t member;
+	jsish_result_t result;
+	unsigned int candidates[32];
+	unsigned char slots[64];
+	unsigned int child;
+	unsigned int count;
+	unsigned int length;
+	unsigned int i;
+	unsigned long wanted;
+	unsigned long seen;
+	int wildcard;
+	nodes = context->nodes;
+	wildcard = _jsish_path_wildcard(nodes, node);
+	child = nodes[node].child;
+	do {
+		count = _jsish_path_candidates(nodes, &child, candidates, slots);
+		wanted = count < 32 ? ((unsigned long) 1 << count) - 1 : 0xFFFFFFFFul;
+		seen = 0;
+		for (result = jsish_cursor_first(object, &member);
+				result == JSISH_OK && (wildcard || seen != wanted)
+					&& context->remaining;
+				result = jsish_cursor_next(&member)) {
+			length = _jsish_skip_string(
+					member.source, member.length, member.key) - member.key - 2;
+			i = _jsish_path_lookup(nodes, candidates, count, slots,
+					&member.source[member.key + 1], length);
+			if (i < count && !(seen >> i & 1)) {
+				seen |= (unsigned long) 1 << i;
+				result = _jsish_path_match_text(context, candidates[i], &member);
+				if (result != JSISH_OK) {
+					return result;
+				}
+			}
+			for (i = nodes[node].child; wildcard && i; i = nodes[i].sibling) {
+				if (nodes[i].index == JSISH_PATH_ANY) {
+					result = _jsish_path_match_text(context, i, &member);
+					if (result != JSISH_OK) {
+						return result;
+					}
+				}
+			}
+		}
+		if (result != JSISH_OK && result != JSISH_NOT_FOUND) {
+			return result;
+		}
+		wildcard = 0;
+	} while (child && context->remaining);
+
+	return JSISH_OK;
+}
+
+/* Matches the children of NODE against the elements of an array in the source,
+ * which are only gone through up to the highest index looked for unless there
+ * is a wildcard. */
+jsish_result_t _jsish_path_match_text_elements(
+		_jsish_path_context_t* context,
+		unsigned int node,
+		const jsish_cursor_t* array) {
+	const jsish_path_node_t* nodes;
+	jsish_cursor_t element;
+	jsish_result_t result;
+	unsigned int child;
+	unsigned int end;
+	unsigned int i;
+	nodes = context->nodes;
+	end = 0;
+	for (child = nodes[node].child; child; child = nodes[child].sibling) {
+		if (nodes[child].index == JSISH_PATH_ANY) {
+			end = JSISH_PATH_NONE;
+		} else if (nodes[child].index != JSISH_PATH_NONE
+				&& nodes[child].index >= end) {
+			end = nodes[child].index + 1;
+		}
+	}
+
+	for (i = 0, result = jsish_cursor_first(array, &element);
+			result == JSISH_OK && i < end && context->remaining;
+			++i, result = jsish_cursor_next(&element)) {
+		for (child = nodes[node].child; child; child = nodes[child].sibling) {
+			if (nodes[child].index == JSISH_PATH_ANY
+					|| nodes[child].index == i) {
+				result = _jsish_path_match_text(context, child, &element);
+				if (result != JSISH_OK) {
+					return result;
+				}
+			}
+		}
+	}
+
+	return result == JSISH_NOT_FOUND ? JSISH_OK : result;
+}
+
+jsish_result_t _jsish_path_match_text(
+		_jsish_path_context_t* context,
+		unsigned int node,
+		const jsish_cursor_t* cursor) {
+	const jsish_path_node_t* nodes;
+	jsish_value_t* value;
+	jsish_result_t result;
+	nodes = context->nodes;
+	if (nodes[node].path != JSISH_PATH_NONE) {
+		result = jsish_cursor_decode(cursor, context->decoder, &value);
+		if (result == JSISH_OK) {
+			result = _jsish_path_found(context, nodes[node].path, value);
+		}
+		if (result != JSISH_OK) {
+			return result;
+		}
+	}
+	if (!nodes[node].child) {
+		return JSISH_OK;
+	}
+
+	switch (cursor->source[cursor->position]) {
+		case '{':
+			return _jsish_path_match_text_members(context, node, cursor);
+		case '[':
+			return _jsish_path_match_text_elements(context, node, cursor);
 		default:
-			return;
+			return JSISH_OK;
 	}
 }
 
-jsish_result_t jsish_encode(
+jsish_result_t jsish_path_match_cursor(
+		const jsish_path_t* query,
+		const jsish_cursor_t* cursor,
+		jsish_decoder_t* decoder,
+		jsish_match_t* matches,
+		unsigned int matches_size,
+		unsigned int* match_count) {
+	_jsish_path_context_t context;
+	jsish_result_t result;
+	_jsish_path_begin(&context, query, matches, matches_size);
+	context.decoder = decoder;
+	result = _jsish_path_match_text(&context, 0, cursor);
+	if (match_count) {
+		*match_count = context.count;
+	}
+
+	return result;
+}
+
+/* Snapshots. Pointers are stored as offsets from the start of the snapshot, as
+ * if it were at address zero, and the header records the address they are
+ * currently relative to, so that opening a snapshot again, wherever it is,
+ * only has to add the difference. */
+
+#define _JSISH_SNAPSHOT_MAGIC 0x4A534E31u
+
+typedef struct {
+	/* Also tells whether the byte order matches. */
+	unsigned int magic;
+	unsigned int value_size;
+	unsigned int pointer_size;
+	unsigned int compact;
+	unsigned int size;
+	unsigned int values_count;
+	size_t base;
+} _jsish_snapshot_header_t;
+
+/* Number of values taken up by the header, which the tree follows. */
+#define _JSISH_SNAPSHOT_HEADER_VALUES \
+	((sizeof(_jsish_snapshot_header_t) + sizeof(jsish_value_t) - 1) \
+		/ sizeof(jsish_value_t))
+
+#define _JSISH_SNAPSHOT_POINTER(TYPE, INDEX) \
+	((TYPE) (size_t) ((INDEX) * sizeof(jsish_value_t)))
+
+#define _JSISH_RELOCATE(TYPE, POINTER, DELTA) \
+	((TYPE) ((size_t) (POINTER) + (DELTA)))
+
+/* Copies the members of OBJECT, and its hash table if it has one, to the
+ * values at INDEX, which has room for COUNT values, making the pointers to
+ * them offsets. Returns the number of values used, or 0 if there is no room.
+ */
+unsigned int _jsish_snapshot_members(
+		jsish_value_t* values,
+		jsish_value_t* object,
+		unsigned int index,
+		unsigned int count) {
+	unsigned int size;
+	unsigned int used;
+#ifdef JSISH_COMPACT
+	size = JSISH_OBJECT_SIZE(object);
+	used = size * 2
+		+ (object->size & _JSISH_INDEXED ? _jsish_index_values(size) : 0);
+	if (used > count) {
+		return 0;
+	}
+	if (used) {
+		JSISH_MEMCPY(
+				&values[index],
+				object->data.vmap,
+				used * sizeof(jsish_value_t));
+	}
+	object->data.vmap = _JSISH_SNAPSHOT_POINTER(jsish_value_t*, index);
+#else
+	const jsish_value_t* from;
+	jsish_value_t* pair;
+	unsigned int i;
+	size = JSISH_OBJECT_SIZE(object);
+	used = size * 3
+		+ (object->data.vmap.index ? _jsish_index_values(size) : 0);
+	if (used > count) {
+		return 0;
+	}
+	/* The pairs are laid out afresh, as the hash table expects. */
+	from = JSISH_KV_FIRST(object);
+	for (i = 0; i < size; ++i) {
+		pair = &values[index + i * 3];
+		pair->type = JSISH_PAIR;
+		pair->data.vobj.key =
+			_JSISH_SNAPSHOT_POINTER(jsish_value_t*, index + i * 3 + 1);
+		pair->data.vobj.value =
+			_JSISH_SNAPSHOT_POINTER(jsish_value_t*, index + i * 3 + 2);
+		pair->data.vobj.next = i + 1 < size
+			? _JSISH_SNAPSHOT_POINTER(jsish_value_t*, index + i * 3 + 3)
+			: NULL;
+		pair[1] = *from->data.vobj.key;
+		pair[2] = *from->data.vobj.value;
+		from = from->data.vobj.next;
+	}
+	if (object->data.vmap.index) {
+		JSISH_MEMCPY(
+				&values[index + size * 3],
+				object->data.vmap.index,
+				(used - size * 3) * sizeof(jsish_value_t));
+		object->data.vmap.index =
+			_JSISH_SNAPSHOT_POINTER(jsish_value_t*, index + size * 3);
+	}
+	object->data.vmap.pairs = _JSISH_SNAPSHOT_POINTER(jsish_value_t*, index);
+#endif
+	if (!size) {
+		JSISH_KV_FIRST(object) = NULL;
+	}
+
+	return used;
+}
+
+jsish_result_t jsish_snapshot_write(
 		const jsish_value_t* value,
-		char* buffer,
+		void* buffer,
 		unsigned int buffer_size,
-		unsigned int* encoded_bytes) {
-	*encoded_bytes = 0;
-	_jsish_encode_value(value, buffer, buffer_size, encoded_bytes);
-	_jsish_append(buffer, '\0', buffer_size, encoded_bytes);
+		unsigned int* snapshot_size) {
+	_jsish_snapshot_header_t* header;
+	jsish_value_t* values;
+	jsish_value_t* copy;
+	char* bytes;
+	unsigned int count;
+	unsigned int scan;
+	unsigned int strings;
+	unsigned int length;
+	unsigned int size;
+	unsigned int i;
+	values = (jsish_value_t*) buffer;
+	bytes = (char*) buffer;
+	count = _JSISH_SNAPSHOT_HEADER_VALUES;
+	if (buffer_size / sizeof(jsish_value_t) <= count) {
+		return JSISH_ERR_MEM_OVERFLOW;
+	}
+	values[count++] = *value;
+
+	/* Copied breadth first, with the values copied so far serving as the
+	 * queue: each array and object still points at its elements or members in
+	 * the tree until it is reached, and they are then appended. The strings
+	 * are collected from the end of the buffer down. */
+	strings = buffer_size;
+	for (scan = _JSISH_SNAPSHOT_HEADER_VALUES; scan < count; ++scan) {
+		copy = &values[scan];
+		switch (copy->type) {
+			case JSISH_STRING: case JSISH_RAW_STRING:
+				length = (unsigned int) JSISH_STRLEN(copy->data.vstr) + 1;
+				if (length > strings - count * sizeof(jsish_value_t)) {
+					return JSISH_ERR_MEM_OVERFLOW;
+				}
+				strings -= length;
+				JSISH_MEMCPY(&bytes[strings], copy->data.vstr, length);
+				copy->data.vstr = (const char*) (size_t) strings;
+				break;
+			case JSISH_ARRAY:
+				size = JSISH_ARRAY_SIZE(copy);
+				if (size > strings / sizeof(jsish_value_t) - count) {
+					return JSISH_ERR_MEM_OVERFLOW;
+				}
+				if (size) {
+					JSISH_MEMCPY(
+							&values[count],
+							JSISH_ARRAY_INDEX(copy, 0),
+							size * sizeof(jsish_value_t));
+				}
+#ifdef JSISH_COMPACT
+				copy->data.varr = _JSISH_SNAPSHOT_POINTER(jsish_value_t*, count);
+#else
+				copy->data.varr.data =
+					_JSISH_SNAPSHOT_POINTER(jsish_value_t*, count);
+#endif
+				count += size;
+				break;
+			case JSISH_KEYVAL:
+				size = _jsish_snapshot_members(
+						values,
+						copy,
+						count,
+						(unsigned int) (strings / sizeof(jsish_value_t) - count));
+				if (!size && JSISH_OBJECT_SIZE(copy)) {
+					return JSISH_ERR_MEM_OVERFLOW;
+				}
+				count += size;
+				break;
+			default:
+				break;
+		}
+	}
+
+	/* Move the strings down to right after the values. */
+	size = buffer_size - strings;
+	length = strings - count * (unsigned int) sizeof(jsish_value_t);
+	for (i = 0; i < size; ++i) {
+		bytes[count * sizeof(jsish_value_t) + i] = bytes[strings + i];
+	}
+	if (length) {
+		for (scan = _JSISH_SNAPSHOT_HEADER_VALUES; scan < count; ++scan) {
+			copy = &values[scan];
+			if (JSISH_IS_STRING(copy)) {
+				copy->data.vstr = _JSISH_RELOCATE(
+						const char*, copy->data.vstr, (size_t) 0 - length);
+			}
+		}
+	}
 
-	return *encoded_bytes <= buffer_size ? JSISH_OK : JSISH_ERR_MEM_OVERFLOW;
+	header = (_jsish_snapshot_header_t*) buffer;
+	header->magic = _JSISH_SNAPSHOT_MAGIC;
+	header->value_size = (unsigned int) sizeof(jsish_value_t);
+	header->pointer_size = (unsigned int) sizeof(void*);
+#ifdef JSISH_COMPACT
+	header->compact = 1;
+#else
+	header->compact = 0;
+#endif
+	header->size = buffer_size - length;
+	header->values_count = count;
+	header->base = 0;
+	*snapshot_size = header->size;
+
+	return JSISH_OK;
 }
 
-jsish_value_t* jsish_get_property(const jsish_value_t* value, const char* key) {
-	do {
-		if (JSISH_STRCMP(JSISH_KV_KEY(value), key) == 0) {
-			return JSISH_KV_VALUE(value);
+jsish_result_t jsish_snapshot_open(
+		void* snapshot,
+		unsigned int snapshot_size,
+		jsish_value_t** root) {
+	_jsish_snapshot_header_t* header;
+	jsish_value_t* values;
+	jsish_value_t* value;
+	jsish_value_t* end;
+	size_t delta;
+	header = (_jsish_snapshot_header_t*) snapshot;
+	values = (jsish_value_t*) snapshot;
+	if (snapshot_size < sizeof(_jsish_snapshot_header_t)
+			|| header->magic != _JSISH_SNAPSHOT_MAGIC
+			|| header->value_size != sizeof(jsish_value_t)
+			|| header->pointer_size != sizeof(void*)
+#ifdef JSISH_COMPACT
+			|| !header->compact
+#else
+			|| header->compact
+#endif
+			|| header->size > snapshot_size
+			|| header->values_count <= _JSISH_SNAPSHOT_HEADER_VALUES
+			|| header->values_count
+				> header->size / sizeof(jsish_value_t)) {
+		return JSISH_ERR_MALFORMED;
+	}
+	*root = &values[_JSISH_SNAPSHOT_HEADER_VALUES];
+
+	/* Nothing to write if it is where it was last opened, so that the pages
+	 * of a mapped snapshot stay shared. */
+	delta = (size_t) snapshot - header->base;
+	if (!delta) {
+		return JSISH_OK;
+	}
+	end = &values[header->values_count];
+	for (value = *root; value != end; ++value) {
+		switch (value->type) {
+			case JSISH_STRING: case JSISH_RAW_STRING:
+				value->data.vstr =
+					_JSISH_RELOCATE(const char*, value->data.vstr, delta);
+				break;
+			case JSISH_ARRAY:
+#ifdef JSISH_COMPACT
+				value->data.varr =
+					_JSISH_RELOCATE(jsish_value_t*, value->data.varr, delta);
+#else
+				value->data.varr.data = _JSISH_RELOCATE(
+						jsish_value_t*, value->data.varr.data, delta);
+#endif
+				break;
+			case JSISH_KEYVAL:
+				if (JSISH_KV_FIRST(value)) {
+					JSISH_KV_FIRST(value) = _JSISH_RELOCATE(
+							jsish_value_t*, JSISH_KV_FIRST(value), delta);
+				}
+#ifndef JSISH_COMPACT
+				if (value->data.vmap.index) {
+					value->data.vmap.index = _JSISH_RELOCATE(
+							jsish_value_t*, value->data.vmap.index, delta);
+				}
+#endif
+				break;
+#ifndef JSISH_COMPACT
+			case JSISH_PAIR:
+				value->data.vobj.key = _JSISH_RELOCATE(
+						jsish_value_t*, value->data.vobj.key, delta);
+				value->data.vobj.value = _JSISH_RELOCATE(
+						jsish_value_t*, value->data.vobj.value, delta);
+				if (value->data.vobj.next) {
+					value->data.vobj.next = _JSISH_RELOCATE(
+							jsish_value_t*, value->data.vobj.next, delta);
+				}
+				break;
+#endif
+			default:
+				break;
 		}
-	} while ((value = JSISH_KV_NEXT(value)) != NULL);
+	}
+	header->base = (size_t) snapshot;
 
-	return NULL;
+	return JSISH_OK;
 }
 
 #endif
@@ -0,0 +1,160 @@
+/* Checks decoding with an allocate hook, starting from a few values so that
+ * it moves on to new blocks many times within a document: plain, incremental
+ * and two-stage decoding must give the same result and tree as jsish_decode()
+ * with all the values it needs, also when the hook fails, and every block
+ * must be handed back by jsish_free_blocks(). */
+#define JSISH_MAIN
+#include <jsish.h>
+
+#include "check.h"
+
+#define DOCUMENTS 6000
+#define VALUES_SIZE 65536
+#define MAX_STRUCTURALS 200
+
+static jsish_value_t values[VALUES_SIZE];
+static unsigned int structurals[MAX_STRUCTURALS];
+
+/* Counts the blocks allocated and freed, and fails once LIMIT have been
+ * allocated. */
+typedef struct {
+	unsigned int allocated;
+	unsigned int freed;
+	unsigned int limit;
+} counter_t;
+
+static void* allocate(void* user, unsigned int bytes) {
+	counter_t* counter;
+	counter = (counter_t*) user;
+	if (counter->allocated == counter->limit) {
+		return NULL;
+	}
+	counter->allocated++;
+	return malloc(bytes);
+}
+
+static void deallocate(void* user, void* block) {
+	((counter_t*) user)->freed++;
+	free(block);
+}
+
+typedef enum { PLAIN, FEED, INDEXED } method_t;
+
+/* Decodes TEXT with METHOD, from SIZE values on the stack and then blocks
+ * from COUNTER, and checks the result and tree against EXPECTED and ENCODED.
+ * Returns the number of blocks used. */
+static unsigned int check_decode(
+		const text_t* text,
+		method_t method,
+		unsigned int flags,
+		unsigned int size,
+		counter_t* counter,
+		jsish_result_t expected,
+		const char* encoded) {
+	jsish_value_t small[32];
+	jsish_decoder_t decoder;
+	jsish_result_t result;
+	char* source;
+	char* actual;
+	unsigned int offset;
+	unsigned int length;
+	source = copy(text->data);
+	jsish_init_decoder(&decoder, small, size);
+	decoder.flags = flags;
+	decoder.allocate = allocate;
+	decoder.deallocate = deallocate;
+	decoder.user = counter;
+	counter->allocated = 0;
+	counter->freed = 0;
+	switch (method) {
+		case PLAIN:
+			result = jsish_decode(&decoder, source);
+			break;
+		case FEED:
+			jsish_decode_begin(&decoder, source, text->length + 1);
+			result = JSISH_INCOMPLETE;
+			for (offset = 0; offset < text->length; offset += length) {
+				length = 1 + next_random(16);
+				if (length > text->length - offset) {
+					length = text->length - offset;
+				}
+				result = jsish_decode_feed(
+						&decoder, &text->data[offset], length);
+				if (result != JSISH_INCOMPLETE) {
+					break;
+				}
+			}
+			if (result == JSISH_INCOMPLETE) {
+				result = jsish_decode_finish(&decoder);
+			}
+			break;
+		default:
+			result = jsish_decode_indexed(
+					&decoder, source, structurals, MAX_STRUCTURALS);
+			break;
+	}
+
+	/* Running out of blocks is the only other way it can end. */
+	if (counter->allocated == counter->limit && result != expected) {
+		CHECK(result == JSISH_ERR_MEM_OVERFLOW);
+	} else {
+		CHECK(result == expected);
+		if (result == JSISH_OK) {
+			actual = encode(&decoder.root);
+			CHECK(strcmp(actual, encoded) == 0);
+			free(actual);
+		}
+	}
+	jsish_free_blocks(&decoder);
+	CHECK(decoder.blocks == NULL);
+	CHECK(counter->freed == counter->allocated);
+	free(source);
+	return counter->allocated;
+}
+
+int main(void) {
+	static const unsigned int flags[] = {
+		0, JSISH_INDEX_KEYS, JSISH_COPY_STRINGS | JSISH_UNESCAPE,
+		JSISH_SORT_KEYS | JSISH_INTEGERS
+	};
+	static const unsigned int sizes[] = { 1, 2, 3, 8, 32 };
+	static const method_t methods[] = { PLAIN, FEED, INDEXED };
+	jsish_decoder_t decoder;
+	jsish_result_t expected;
+	counter_t counter;
+	text_t text;
+	char* source;
+	char* encoded;
+	unsigned int blocks;
+	unsigned int i;
+	unsigned int j;
+	text.data = NULL;
+	text.size = 0;
+	for (i = 0; i < DOCUMENTS; ++i) {
+		generate(&text, 4, 8);
+		if (i % 4 == 3) {
+			damage(&text);
+		}
+		source = copy(text.data);
+		jsish_init_decoder(&decoder, values, VALUES_SIZE);
+		decoder.flags = flags[i % 4];
+		expected = jsish_decode(&decoder, source);
+		encoded = expected == JSISH_OK ? encode(&decoder.root) : NULL;
+
+		for (j = 0; j < 3; ++j) {
+			counter.limit = 0xFFFFFFFFu;
+			blocks = check_decode(&text, methods[j], flags[i % 4],
+					sizes[(i + j) % 5], &counter, expected, encoded);
+			/* With fewer blocks, down to none at all. */
+			if (blocks) {
+				counter.limit = next_random(blocks);
+				check_decode(&text, methods[j], flags[i % 4],
+						sizes[(i + j) % 5], &counter, expected, encoded);
+			}
+		}
+		free(encoded);
+		free(source);
+	}
+	free(text.data);
+	return 0;
+}
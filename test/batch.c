@@ -0,0 +1,146 @@
+/* Checks batch decoding of newline-delimited JSON against decoding each
+ * record on its own with jsish_decode(), with blank lines, CRLF line endings,
+ * malformed records among well-formed ones, and more records than there is
+ * room for. With JSISH_THREADS the parts are decoded by
+ * jsish_batch_decode_parallel(). */
+#define JSISH_MAIN
+#include <jsish.h>
+
+#include "check.h"
+
+#define BATCHES 400
+#define MAX_RECORDS 64
+#define VALUES_SIZE 262144
+
+static jsish_value_t values[VALUES_SIZE];
+static jsish_value_t reference_values[VALUES_SIZE];
+static jsish_record_t records[MAX_RECORDS];
+
+/* Appends a random record to LINES, without line breaks outside of strings,
+ * which only ever have them escaped, and never blank even if damaged. */
+static void append_record(text_t* lines, int malformed) {
+	static text_t record;
+	unsigned int i;
+	do {
+		generate(&record, 3, 6);
+		if (malformed) {
+			damage(&record);
+		}
+	} while (strspn(record.data, " \t\r\n") == record.length);
+	for (i = 0; i < record.length; ++i) {
+		if (record.data[i] == '\n' || record.data[i] == '\r') {
+			record.data[i] = ' ';
+		}
+	}
+	append(lines, record.data);
+}
+
+/* Decodes each record of SOURCE with jsish_decode(), splitting it at line
+ * breaks and skipping blank lines, and checks the results and trees of
+ * RECORDS against them. Returns the first error. */
+static jsish_result_t check_records(
+		const char* source, unsigned int flags, const jsish_record_t* records) {
+	jsish_decoder_t decoder;
+	jsish_result_t first;
+	jsish_result_t result;
+	const char* line;
+	const char* end;
+	char* text;
+	char* expected;
+	char* actual;
+	unsigned int count;
+	count = 0;
+	first = JSISH_OK;
+	for (line = source; *line; line = *end ? end + 1 : end) {
+		end = strchr(line, '\n');
+		if (!end) {
+			end = line + strlen(line);
+		}
+		if (line + strspn(line, " \t\r") >= end) {
+			continue;
+		}
+		text = (char*) malloc(end - line + 1);
+		CHECK(text != NULL);
+		memcpy(text, line, end - line);
+		text[end - line] = '\0';
+		jsish_init_decoder(&decoder, reference_values, VALUES_SIZE);
+		decoder.flags = flags;
+		result = jsish_decode(&decoder, text);
+		CHECK(records[count].result == result);
+		if (result == JSISH_OK) {
+			expected = encode(&decoder.root);
+			actual = encode(&records[count].root);
+			CHECK(strcmp(expected, actual) == 0);
+			free(expected);
+			free(actual);
+		} else if (first == JSISH_OK) {
+			first = result;
+		}
+		free(text);
+		count++;
+	}
+	return first;
+}
+
+int main(void) {
+	static const char* const blanks[] = { "", " ", "\t", " \r" };
+	jsish_batch_t batch;
+	text_t lines;
+	char* source;
+	char* original;
+	unsigned int count;
+	unsigned int workers;
+	unsigned int i;
+	unsigned int j;
+	const char* newline;
+	lines.data = NULL;
+	lines.size = 0;
+	for (i = 0; i < BATCHES; ++i) {
+		lines.length = 0;
+		append(&lines, "");
+		newline = next_random(2) ? "\r\n" : "\n";
+		count = 1 + next_random(MAX_RECORDS);
+		for (j = 0; j < count; ++j) {
+			if (!next_random(6)) {
+				append(&lines, blanks[next_random(4)]);
+				append(&lines, newline);
+			}
+			append_record(&lines, i % 3 == 0 && j == count / 2);
+			if (j + 1 < count || next_random(2)) {
+				append(&lines, newline);
+			}
+		}
+
+		/* More records than there is room for changes nothing. */
+		source = copy(lines.data);
+		original = copy(lines.data);
+		workers = 1 + next_random(8);
+		if (count > 1) {
+			CHECK(jsish_batch_init(&batch, source, records, count - 1,
+						values, VALUES_SIZE, workers)
+					== JSISH_ERR_MEM_OVERFLOW);
+			CHECK(batch.records_count == count);
+			CHECK(strcmp(source, original) == 0);
+		}
+
+		CHECK(jsish_batch_init(&batch, source, records, MAX_RECORDS,
+					values, VALUES_SIZE, workers) == JSISH_OK);
+		CHECK(batch.records_count == count);
+		batch.flags = i % 2 ? JSISH_INDEX_KEYS | JSISH_INTEGERS : 0;
+#ifdef JSISH_THREADS
+		CHECK(jsish_batch_decode_parallel(&batch)
+				== check_records(original, batch.flags, records));
+#else
+		/* The parts in any order, as threads would finish them. */
+		for (j = workers; j > 0; --j) {
+			jsish_batch_decode(&batch, (j + i) % workers);
+		}
+		CHECK(jsish_batch_finish(&batch)
+				== check_records(original, batch.flags, records));
+#endif
+		free(original);
+		free(source);
+	}
+	free(lines.data);
+	return 0;
+}
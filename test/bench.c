@@ -0,0 +1,484 @@
+/* Throughput benchmarks over generated corpora.
+ *
+ * Usage: bench [megabytes [repetitions]]
+ *
+ * Each corpus is generated deterministically, about the given size (8 MB by
+ * default), and every operation is timed the given number of times (5 by
+ * default), keeping the best. Results are printed as CSV, one line per corpus
+ * and operation, after comment lines starting with '#':
+ *
+ *   corpus,operation,bytes,values,seconds,mb_per_s,values_per_s,pool_per_byte
+ *
+ * bytes is the input for decode, roundtrip and minify (jsish_minify() without
+ * flags, into memory), the output for encode, and 0 for lookup, where values
+ * counts calls to jsish_get_property() on a tree decoded with
+ * JSISH_INDEX_KEYS. pool_per_byte is the values memory the decoded tree takes
+ * up per input byte. */
+#define JSISH_MAIN
+#include <jsish.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_MEGABYTES 8
+#define DEFAULT_REPETITIONS 5
+#define MAX_RECORDS 1000000
+
+typedef struct {
+	char* data;
+	unsigned int length;
+	unsigned int size;
+} text_t;
+
+static unsigned long seed;
+
+static unsigned int next_random(unsigned int range) {
+	seed = (seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+	return (unsigned int) (seed >> 8) % range;
+}
+
+static void append(text_t* text, const char* chars) {
+	unsigned int length;
+	length = (unsigned int) strlen(chars);
+	if (text->length + length + 1 > text->size) {
+		text->size = (text->length + length + 1) * 2;
+		text->data = (char*) realloc(text->data, text->size);
+		if (!text->data) {
+			fputs("Out of memory\n", stderr);
+			exit(1);
+		}
+	}
+	memcpy(&text->data[text->length], chars, length + 1);
+	text->length += length;
+}
+
+static const char* const words[] = {
+	"alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel",
+	"india", "juliett", "kilo", "lima", "mike", "november", "oscar", "papa"
+};
+
+static void generate_numbers(text_t* text, unsigned int target) {
+	char chunk[64];
+	unsigned int i;
+	append(text, "[");
+	while (text->length < target) {
+		append(text, text->data[text->length - 1] == '[' ? "[" : ",\n[");
+		for (i = 0; i < 16; ++i) {
+			switch (next_random(3)) {
+				case 0:
+					sprintf(chunk, "%s%u", i ? "," : "", next_random(100000));
+					break;
+				case 1:
+					sprintf(chunk, "%s-%u.%03u", i ? "," : "",
+							next_random(1000), next_random(1000));
+					break;
+				default:
+					sprintf(chunk, "%s%u.%ue-%u", i ? "," : "",
+							next_random(10), next_random(100000),
+							next_random(30));
+					break;
+			}
+			append(text, chunk);
+		}
+		append(text, "]");
+	}
+	append(text, "]");
+}
+
+static void append_log(text_t* text, unsigned int i) {
+	char chunk[256];
+	sprintf(chunk, "{\"ts\":%u%06u,\"level\":\"%s\",\"host\":\"web-%u\","
+			"\"msg\":\"GET /api/v1/%s/%u took %u ms%s\",\"user\":\"%s%u\"}",
+			1700000000u + i, next_random(1000000),
+			next_random(10) ? "info" : "warn", next_random(64),
+			words[next_random(16)], next_random(100000), next_random(500),
+			next_random(8) ? "" : " \\\"retry\\\"\\n",
+			words[next_random(16)], next_random(1000));
+	append(text, chunk);
+}
+
+static void generate_logs(text_t* text, unsigned int target) {
+	unsigned int i;
+	append(text, "[");
+	for (i = 0; text->length < target; ++i) {
+		append(text, i ? ",\n" : "");
+		append_log(text, i);
+	}
+	append(text, "]");
+}
+
+static void generate_ndjson(text_t* text, unsigned int target) {
+	unsigned int i;
+	for (i = 0; text->length < target; ++i) {
+		append_log(text, i);
+		append(text, "\n");
+	}
+}
+
+static void append_config(text_t* text, unsigned int depth) {
+	char chunk[64];
+	unsigned int count;
+	unsigned int i;
+	count = 2 + next_random(3);
+	append(text, "{");
+	for (i = 0; i < count; ++i) {
+		sprintf(chunk, "%s\"%s_%u\":", i ? "," : "",
+				words[next_random(16)], i);
+		append(text, chunk);
+		if (depth < 12 && i == 0) {
+			append_config(text, depth + 1);
+		} else if (next_random(2)) {
+			sprintf(chunk, "%u", next_random(10000));
+			append(text, chunk);
+		} else {
+			append(text, next_random(2) ? "true" : "\"enabled\"");
+		}
+	}
+	append(text, "}");
+}
+
+static void generate_nested(text_t* text, unsigned int target) {
+	append(text, "[");
+	while (text->length < target) {
+		append(text, text->data[text->length - 1] == '[' ? "" : ",\n");
+		append_config(text, 0);
+	}
+	append(text, "]");
+}
+
+static void generate_wide(text_t* text, unsigned int target) {
+	char chunk[64];
+	unsigned int i;
+	append(text, "[");
+	while (text->length < target) {
+		append(text, text->data[text->length - 1] == '[' ? "{" : ",\n{");
+		for (i = 0; i < 256; ++i) {
+			sprintf(chunk, "%s\"field_%s_%u\":%u", i ? "," : "",
+					words[i % 16], i, next_random(1000));
+			append(text, chunk);
+		}
+		append(text, "}");
+	}
+	append(text, "]");
+}
+
+static unsigned int count_values(const jsish_value_t* value) {
+	const jsish_value_t* pair;
+	unsigned int count;
+	unsigned int i;
+	count = 1;
+	if (JSISH_IS_ARRAY(value)) {
+		for (i = 0; i < JSISH_ARRAY_SIZE(value); ++i) {
+			count += count_values(JSISH_ARRAY_INDEX(value, i));
+		}
+	} else if (JSISH_IS_KEYVAL(value)) {
+		for (pair = JSISH_KV_FIRST(value); pair; pair = JSISH_KV_NEXT(pair)) {
+			count += count_values(JSISH_KV_VALUE(pair));
+		}
+	}
+	return count;
+}
+
+/* Looks up every key of every object, returning the number of lookups. */
+static unsigned int look_up_keys(const jsish_value_t* value) {
+	const jsish_value_t* pair;
+	unsigned int count;
+	unsigned int i;
+	count = 0;
+	if (JSISH_IS_ARRAY(value)) {
+		for (i = 0; i < JSISH_ARRAY_SIZE(value); ++i) {
+			count += look_up_keys(JSISH_ARRAY_INDEX(value, i));
+		}
+	} else if (JSISH_IS_KEYVAL(value)) {
+		for (pair = JSISH_KV_FIRST(value); pair; pair = JSISH_KV_NEXT(pair)) {
+			if (jsish_get_property(value, JSISH_KV_KEY(pair))
+					!= JSISH_KV_VALUE(pair)) {
+				fputs("Lookup failed\n", stderr);
+				exit(1);
+			}
+			count += 1 + look_up_keys(JSISH_KV_VALUE(pair));
+		}
+	}
+	return count;
+}
+
+static void report(
+		const char* corpus,
+		const char* operation,
+		unsigned int bytes,
+		unsigned int values,
+		double seconds,
+		double pool_per_byte) {
+	if (seconds <= 0.0) {
+		seconds = 1.0 / CLOCKS_PER_SEC;
+	}
+	printf("%s,%s,%u,%u,%.6f,%.1f,%.0f,%.2f\n", corpus, operation, bytes,
+			values, seconds, bytes / seconds / 1e6, values / seconds,
+			pool_per_byte);
+}
+
+static double elapsed(clock_t start) {
+	return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* Output callback for jsish_minify(), appending to a text_t with room. */
+static int append_output(void* user, const char* data, unsigned int length) {
+	text_t* output;
+	output = (text_t*) user;
+	if (output->length + length > output->size) {
+		return 1;
+	}
+	memcpy(&output->data[output->length], data, length);
+	output->length += length;
+	return 0;
+}
+
+static int fail(const char* corpus, const char* what, jsish_result_t result) {
+	fprintf(stderr, "%s: %s failed with %u\n", corpus, what, result);
+	return 2;
+}
+
+/* Times decoding, encoding, lookups, a round trip and minification of a JSON
+ * document. */
+static int bench_document(
+		const char* corpus, const text_t* text, unsigned int repetitions) {
+	jsish_decoder_t decoder;
+	jsish_value_t* values;
+	char* source;
+	char* output;
+	char scratch[65536];
+	text_t minified;
+	unsigned int needed;
+	unsigned int depth;
+	unsigned int count;
+	unsigned int lookups;
+	unsigned int output_size;
+	unsigned int encoded;
+	unsigned int i;
+	double best[5];
+	double seconds;
+	double pool;
+	clock_t start;
+	jsish_result_t result;
+	result = jsish_measure(text->data, JSISH_INDEX_KEYS, &needed, &depth);
+	if (result != JSISH_OK) {
+		return fail(corpus, "jsish_measure()", result);
+	}
+	values = (jsish_value_t*) malloc(needed * sizeof(jsish_value_t));
+	source = (char*) malloc(text->length + 1);
+	if (!values || !source) {
+		return fail(corpus, "malloc()", JSISH_ERR_MEM_OVERFLOW);
+	}
+
+	/* Decode, and size the output for encoding. */
+	best[0] = best[1] = best[2] = best[3] = best[4] = 1e30;
+	for (i = 0; i < repetitions; ++i) {
+		memcpy(source, text->data, text->length + 1);
+		jsish_init_decoder(&decoder, values, needed);
+		start = clock();
+		result = jsish_decode(&decoder, source);
+		seconds = elapsed(start);
+		if (result != JSISH_OK) {
+			return fail(corpus, "jsish_decode()", result);
+		}
+		best[0] = seconds < best[0] ? seconds : best[0];
+	}
+	count = count_values(&decoder.root);
+	pool = (double) decoder.values_cursor * sizeof(jsish_value_t)
+		/ text->length;
+	jsish_encode(&decoder.root, NULL, 0, &output_size);
+	/* Also enough for minifying, which keeps numbers as they are. */
+	if (output_size < text->length) {
+		output_size = text->length;
+	}
+	output = (char*) malloc(output_size);
+	if (!output) {
+		return fail(corpus, "malloc()", JSISH_ERR_MEM_OVERFLOW);
+	}
+
+	for (i = 0; i < repetitions; ++i) {
+		start = clock();
+		result = jsish_encode(&decoder.root, output, output_size, &encoded);
+		seconds = elapsed(start);
+		if (result != JSISH_OK) {
+			return fail(corpus, "jsish_encode()", result);
+		}
+		best[1] = seconds < best[1] ? seconds : best[1];
+	}
+
+	/* Round trip, then lookups in the same tree decoded with hash tables. */
+	for (i = 0; i < repetitions; ++i) {
+		memcpy(source, text->data, text->length + 1);
+		jsish_init_decoder(&decoder, values, needed);
+		decoder.flags = JSISH_INDEX_KEYS;
+		start = clock();
+		result = jsish_decode(&decoder, source);
+		if (result == JSISH_OK) {
+			result = jsish_encode(
+					&decoder.root, output, output_size, &encoded);
+		}
+		seconds = elapsed(start);
+		if (result != JSISH_OK) {
+			return fail(corpus, "round trip", result);
+		}
+		best[2] = seconds < best[2] ? seconds : best[2];
+	}
+	lookups = 0;
+	for (i = 0; i < repetitions; ++i) {
+		start = clock();
+		lookups = look_up_keys(&decoder.root);
+		seconds = elapsed(start);
+		best[3] = seconds < best[3] ? seconds : best[3];
+	}
+
+	/* Straight from text to text, no tree, for comparison with the round
+	 * trip. */
+	for (i = 0; i < repetitions; ++i) {
+		minified.data = output;
+		minified.length = 0;
+		minified.size = output_size;
+		start = clock();
+		result = jsish_minify(text->data, 0, append_output, &minified,
+				scratch, sizeof(scratch));
+		seconds = elapsed(start);
+		if (result != JSISH_OK) {
+			return fail(corpus, "jsish_minify()", result);
+		}
+		best[4] = seconds < best[4] ? seconds : best[4];
+	}
+
+	report(corpus, "decode", text->length, count, best[0], pool);
+	report(corpus, "encode", encoded - 1, count, best[1], 0.0);
+	report(corpus, "lookup", 0, lookups, best[3], 0.0);
+	report(corpus, "roundtrip", text->length, count, best[2], pool);
+	report(corpus, "minify", text->length, count, best[4], 0.0);
+	free(output);
+	free(source);
+	free(values);
+
+	return 0;
+}
+
+/* Times batch decoding and encoding of the records of an NDJSON document. */
+static int bench_lines(
+		const char* corpus, const text_t* text, unsigned int repetitions) {
+	jsish_batch_t batch;
+	jsish_record_t* records;
+	jsish_value_t* values;
+	char* source;
+	char* output;
+	unsigned int values_size;
+	unsigned int count;
+	unsigned int encoded;
+	unsigned int total;
+	unsigned int i;
+	unsigned int j;
+	double best[2];
+	double seconds;
+	double pool;
+	clock_t start;
+	jsish_result_t result;
+	/* Plenty, as each value takes up at least a byte of input. */
+	values_size = text->length + 64;
+	values = (jsish_value_t*) malloc(values_size * sizeof(jsish_value_t));
+	records = (jsish_record_t*) malloc(MAX_RECORDS * sizeof(jsish_record_t));
+	source = (char*) malloc(text->length + 1);
+	output = (char*) malloc(text->length * 2 + 1);
+	if (!values || !records || !source || !output) {
+		return fail(corpus, "malloc()", JSISH_ERR_MEM_OVERFLOW);
+	}
+
+	best[0] = best[1] = 1e30;
+	for (i = 0; i < repetitions; ++i) {
+		memcpy(source, text->data, text->length + 1);
+		start = clock();
+		result = jsish_batch_init(&batch, source, records, MAX_RECORDS,
+				values, values_size, 1);
+		if (result == JSISH_OK) {
+			jsish_batch_decode(&batch, 0);
+			result = jsish_batch_finish(&batch);
+		}
+		seconds = elapsed(start);
+		if (result != JSISH_OK) {
+			return fail(corpus, "jsish_batch_decode()", result);
+		}
+		best[0] = seconds < best[0] ? seconds : best[0];
+	}
+	count = 0;
+	for (j = 0; j < batch.records_count; ++j) {
+		count += count_values(&records[j].root);
+	}
+	pool = (double) batch.used[0] * sizeof(jsish_value_t) / text->length;
+
+	total = 0;
+	for (i = 0; i < repetitions; ++i) {
+		start = clock();
+		total = 0;
+		for (j = 0; j < batch.records_count; ++j) {
+			result = jsish_encode(&records[j].root, &output[total],
+					text->length * 2 + 1 - total, &encoded);
+			if (result != JSISH_OK) {
+				return fail(corpus, "jsish_encode()", result);
+			}
+			/* Overwrite the zero terminator with the next record. */
+			total += encoded - 1;
+		}
+		seconds = elapsed(start);
+		best[1] = seconds < best[1] ? seconds : best[1];
+	}
+
+	report(corpus, "decode", text->length, count, best[0], pool);
+	report(corpus, "encode", total, count, best[1], 0.0);
+	free(output);
+	free(source);
+	free(records);
+	free(values);
+
+	return 0;
+}
+
+int main(int argc, char** argv) {
+	static void (* const generators[])(text_t*, unsigned int) = {
+		generate_numbers, generate_logs, generate_nested, generate_wide,
+		generate_ndjson
+	};
+	static const char* const corpora[] = {
+		"numbers", "logs", "nested", "wide", "ndjson"
+	};
+	text_t text;
+	unsigned int megabytes;
+	unsigned int repetitions;
+	unsigned int i;
+	int status;
+	megabytes = argc > 1 ? (unsigned int) atoi(argv[1]) : DEFAULT_MEGABYTES;
+	repetitions = argc > 2
+		? (unsigned int) atoi(argv[2]) : DEFAULT_REPETITIONS;
+	if (megabytes == 0 || megabytes > 1024 || repetitions == 0) {
+		fputs("Usage: bench [megabytes [repetitions]]\n", stderr);
+		return 1;
+	}
+
+	printf("# jsish bench, %u MB per corpus, best of %u, %u-byte values\n",
+			megabytes, repetitions, (unsigned int) sizeof(jsish_value_t));
+	puts("corpus,operation,bytes,values,seconds,mb_per_s,values_per_s,"
+			"pool_per_byte");
+	for (i = 0; i < sizeof(corpora) / sizeof(corpora[0]); ++i) {
+		seed = 1;
+		text.data = NULL;
+		text.length = 0;
+		text.size = 0;
+		generators[i](&text, megabytes << 20);
+		status = i == 4
+			? bench_lines(corpora[i], &text, repetitions)
+			: bench_document(corpora[i], &text, repetitions);
+		free(text.data);
+		if (status) {
+			return status;
+		}
+		fflush(stdout);
+	}
+
+	return 0;
+}
@@ -0,0 +1,159 @@
+/* Helpers shared by the checks, see check.h. */
+#include <jsish.h>
+
+#include "check.h"
+
+static unsigned long seed = 1;
+
+unsigned int next_random(unsigned int range) {
+	seed = (seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+	return (unsigned int) (seed >> 8) % range;
+}
+
+void append(text_t* text, const char* chars) {
+	unsigned int length;
+	length = (unsigned int) strlen(chars);
+	if (text->length + length + 1 > text->size) {
+		text->size = (text->length + length + 1) * 2;
+		text->data = (char*) realloc(text->data, text->size);
+		CHECK(text->data != NULL);
+	}
+	memcpy(&text->data[text->length], chars, length + 1);
+	text->length += length;
+}
+
+static void append_whitespace(text_t* text) {
+	static const char* const whitespace[] = {
+		"", "", "", " ", "\n", "  ", "\r\n\t", "\t"
+	};
+	append(text, whitespace[next_random(8)]);
+}
+
+/* Strings with escapes, UTF-8 and runs longer than a vector. */
+static void append_string(text_t* text) {
+	static const char* const strings[] = {
+		"\"\"", "\"a\"", "\"key\"", "\"x\\ny\"", "\"\\u00e9t\\u00e9\"",
+		"\"\\\"quoted\\\" \\\\ \\/\"", "\"\\ud83d\\ude00\"", "\"caf\xc3\xa9\"",
+		"\"tab\\there\"",
+		"\"a string that is well over sixty-four bytes long, so that it "
+			"spans several vector blocks\"",
+		"\"escape past the first block ............................... "
+			"\\n\\t\\u0041\""
+	};
+	append(text, strings[next_random(sizeof strings / sizeof strings[0])]);
+}
+
+static void append_number(text_t* text) {
+	static const char* const numbers[] = {
+		"0", "-0", "1", "-1", "42", "3.25", "-1.5e-3", "1E10", "2e+2",
+		"12345678901234567890", "-9223372036854775808", "9007199254740993",
+		"0.1", "1e-320", "1.7976931348623157e308", "123456.789e-2"
+	};
+	char number[32];
+	if (next_random(3)) {
+		append(text, numbers[next_random(sizeof numbers / sizeof numbers[0])]);
+		return;
+	}
+	sprintf(number, "%u", next_random(1000000));
+	append(text, number);
+}
+
+/* Appends a random value nested at most DEPTH more levels, with objects of
+ * up to WIDTH members, some with duplicate keys. */
+static void append_value(text_t* text, unsigned int depth, unsigned int width) {
+	char key[32];
+	unsigned int count;
+	unsigned int i;
+	append_whitespace(text);
+	switch (depth ? next_random(10) : next_random(6)) {
+		case 0:
+			append(text, "null");
+			break;
+		case 1:
+			append(text, next_random(2) ? "true" : "false");
+			break;
+		case 2: case 3:
+			append_number(text);
+			break;
+		case 4: case 5:
+			append_string(text);
+			break;
+		case 6: case 7:
+			append(text, "[");
+			count = next_random(6);
+			for (i = 0; i < count; ++i) {
+				append(text, i ? "," : "");
+				append_value(text, depth - 1, width);
+			}
+			append_whitespace(text);
+			append(text, "]");
+			break;
+		default:
+			append(text, "{");
+			count = next_random(width + 1);
+			for (i = 0; i < count; ++i) {
+				append(text, i ? "," : "");
+				append_whitespace(text);
+				if (next_random(4)) {
+					sprintf(key, "\"k%u\"", next_random(width * 2 + 1));
+					append(text, key);
+				} else {
+					append_string(text);
+				}
+				append_whitespace(text);
+				append(text, ":");
+				append_value(text, depth - 1, width);
+			}
+			append_whitespace(text);
+			append(text, "}");
+			break;
+	}
+	append_whitespace(text);
+}
+
+void generate(text_t* text, unsigned int depth, unsigned int width) {
+	int object;
+	text->length = 0;
+	append(text, "");
+	if (next_random(8)) {
+		object = next_random(2);
+		append(text, object ? "{\"k0\":[" : "[");
+		append_value(text, depth, width);
+		append(text, object ? "]}" : "]");
+	} else {
+		append_value(text, depth, width);
+	}
+}
+
+void damage(text_t* text) {
+	static const char replacements[] = "]}[{,:\"\\x0 ";
+	unsigned int at;
+	if (!text->length) {
+		return;
+	}
+	at = next_random(text->length);
+	if (next_random(4)) {
+		text->data[at] = replacements[next_random(sizeof replacements - 1)];
+	} else {
+		text->data[at] = '\0';
+		text->length = at;
+	}
+}
+
+char* encode(const jsish_value_t* value) {
+	unsigned int size;
+	char* output;
+	CHECK(jsish_encode(value, NULL, 0, &size) == JSISH_ERR_MEM_OVERFLOW);
+	output = (char*) malloc(size);
+	CHECK(output != NULL);
+	CHECK(jsish_encode(value, output, size, &size) == JSISH_OK);
+	return output;
+}
+
+char* copy(const char* text) {
+	char* result;
+	result = (char*) malloc(strlen(text) + 1);
+	CHECK(result != NULL);
+	strcpy(result, text);
+	return result;
+}
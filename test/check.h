@@ -0,0 +1,46 @@
+/* Shared by the checks run by ctest, see check.c: a failure macro,
+ * deterministic random numbers, random documents, and encoding of decoded
+ * trees for comparison. Include after jsish.h. */
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Stops the check with the location of the condition that does not hold. */
+#define CHECK(CONDITION) \
+	do { \
+		if (!(CONDITION)) { \
+			fprintf(stderr, "%s:%d: check failed: %s\n", \
+					__FILE__, __LINE__, #CONDITION); \
+			exit(1); \
+		} \
+	} while (0)
+
+typedef struct {
+	char* data;
+	unsigned int length;
+	unsigned int size;
+} text_t;
+
+/* Returns a random number below RANGE, the same sequence in every run. */
+unsigned int next_random(unsigned int range);
+
+void append(text_t* text, const char* chars);
+
+/* Replaces TEXT with a random document nested at most DEPTH levels, with
+ * objects of up to WIDTH members, an array or object most of the time. */
+void generate(text_t* text, unsigned int depth, unsigned int width);
+
+/* Overwrites or cuts off a character of TEXT at random, which leaves most
+ * documents malformed. */
+void damage(text_t* text);
+
+/* Returns the encoding of VALUE, allocated with malloc(). */
+char* encode(const jsish_value_t* value);
+
+/* Returns a copy of TEXT allocated with malloc(). */
+char* copy(const char* text);
+
+#endif
@@ -0,0 +1,119 @@
+/* Checks that jsish_decode_const() gives the same result and tree as
+ * jsish_decode(), reading nothing past the given length and writing nothing
+ * to the source. Where there is mmap(), each document is read-only and ends
+ * right before a page that cannot be accessed at all, so that doing either
+ * crashes; elsewhere, it is allocated without room for a terminator and
+ * compared afterwards. */
+#if defined(__unix__) || defined(__APPLE__)
+#define _DEFAULT_SOURCE
+#define _DARWIN_C_SOURCE
+#include <sys/mman.h>
+#include <unistd.h>
+#define GUARD_PAGES
+#endif
+
+#define JSISH_MAIN
+#include <jsish.h>
+
+#include "check.h"
+
+#define DOCUMENTS 4000
+#define VALUES_SIZE 65536
+#define MAX_STRUCTURALS 400
+
+static jsish_value_t values[VALUES_SIZE];
+static unsigned int structurals[MAX_STRUCTURALS];
+
+#ifdef GUARD_PAGES
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+static char* pages;
+static unsigned int pages_size;
+
+/* Places TEXT, read-only, right before an inaccessible page. */
+static const char* place(const text_t* text) {
+	unsigned int page;
+	unsigned int size;
+	page = (unsigned int) sysconf(_SC_PAGESIZE);
+	size = (text->length + page - 1) / page * page + page;
+	if (pages) {
+		CHECK(munmap(pages, pages_size) == 0);
+	}
+	pages = (char*) mmap(NULL, size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	CHECK(pages != (char*) MAP_FAILED);
+	pages_size = size;
+	memcpy(&pages[size - page - text->length], text->data, text->length);
+	CHECK(mprotect(pages, size - page, PROT_READ) == 0);
+	CHECK(mprotect(&pages[size - page], page, PROT_NONE) == 0);
+	return &pages[size - page - text->length];
+}
+
+static void release(const char* source) {
+	(void) source;
+	CHECK(munmap(pages, pages_size) == 0);
+	pages = NULL;
+}
+#else
+static const char* place(const text_t* text) {
+	char* source;
+	source = (char*) malloc(text->length ? text->length : 1);
+	CHECK(source != NULL);
+	memcpy(source, text->data, text->length);
+	return source;
+}
+
+static void release(const char* source) {
+	free((void*) source);
+}
+#endif
+
+int main(void) {
+	static const unsigned int flags[] = {
+		0, JSISH_INDEX_KEYS, JSISH_INTEGERS | JSISH_UNESCAPE,
+		JSISH_SORT_KEYS | JSISH_VALIDATE_UTF8
+	};
+	jsish_decoder_t decoder;
+	jsish_result_t expected;
+	text_t text;
+	const char* source;
+	char* reference;
+	char* encoded;
+	unsigned int size;
+	unsigned int i;
+	text.data = NULL;
+	text.size = 0;
+	for (i = 0; i < DOCUMENTS; ++i) {
+		generate(&text, 5, 12);
+		if (i % 4 == 3) {
+			damage(&text);
+		}
+
+		encoded = copy(text.data);
+		jsish_init_decoder(&decoder, values, VALUES_SIZE);
+		decoder.flags = flags[i % 4];
+		expected = jsish_decode(&decoder, encoded);
+		reference = expected == JSISH_OK ? encode(&decoder.root) : NULL;
+		free(encoded);
+
+		size = 65 + (i % 8 ? next_random(MAX_STRUCTURALS - 65) : 0);
+		source = place(&text);
+		jsish_init_decoder(&decoder, values, VALUES_SIZE);
+		decoder.flags = flags[i % 4];
+		CHECK(jsish_decode_const(&decoder, source, text.length,
+					structurals, size) == expected);
+		CHECK(memcmp(source, text.data, text.length) == 0);
+		/* The tree no longer refers to the source. */
+		release(source);
+		if (expected == JSISH_OK) {
+			encoded = encode(&decoder.root);
+			CHECK(strcmp(encoded, reference) == 0);
+			free(encoded);
+		}
+		free(reference);
+	}
+	free(text.data);
+	return 0;
+}
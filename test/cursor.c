@@ -0,0 +1,136 @@
+/* Checks on-demand access against jsish_decode(): walking every element and
+ * member of generated documents with jsish_cursor_first() and
+ * jsish_cursor_next(), looking each up again with jsish_cursor_at() and
+ * jsish_cursor_find(), reading keys with jsish_cursor_key() and decoding the
+ * values with jsish_cursor_decode() must give the same as the tree. */
+#define JSISH_MAIN
+#include <jsish.h>
+
+#include "check.h"
+
+#define DOCUMENTS 3000
+#define VALUES_SIZE 65536
+#define MAX_MEMBERS 64
+
+static jsish_value_t values[VALUES_SIZE];
+static jsish_value_t cursor_values[VALUES_SIZE];
+
+/* The type that jsish_cursor_type() gives for a decoded value. */
+static jsish_type_t cursor_type(const jsish_value_t* value) {
+	switch (value->type) {
+		case JSISH_INTEGER:
+			return JSISH_NUMBER;
+		case JSISH_RAW_STRING:
+			return JSISH_STRING;
+		default:
+			return value->type;
+	}
+}
+
+/* Checks that CURSOR points at the same value as VALUE, decoding it into
+ * DECODER if it is a scalar, or at random if not, and going into it. */
+static void check_cursor(
+		const jsish_cursor_t* cursor,
+		const jsish_value_t* value,
+		jsish_decoder_t* decoder) {
+	unsigned int positions[MAX_MEMBERS];
+	jsish_cursor_t child;
+	jsish_cursor_t found;
+	jsish_value_t* decoded;
+	jsish_result_t result;
+	const jsish_value_t* pair;
+	const char* key;
+	char* expected;
+	char* actual;
+	unsigned int size;
+	unsigned int i;
+	unsigned int j;
+	CHECK(jsish_cursor_type(cursor) == cursor_type(value));
+	if ((value->type != JSISH_ARRAY && value->type != JSISH_KEYVAL)
+			|| !next_random(4)) {
+		CHECK(jsish_cursor_decode(cursor, decoder, &decoded) == JSISH_OK);
+		expected = encode(value);
+		actual = encode(decoded);
+		CHECK(strcmp(expected, actual) == 0);
+		free(expected);
+		free(actual);
+	}
+
+	if (value->type == JSISH_ARRAY) {
+		size = JSISH_ARRAY_SIZE(value);
+		CHECK(jsish_cursor_find(cursor, "k0", &found) == JSISH_NOT_FOUND);
+		for (i = 0, result = jsish_cursor_first(cursor, &child);
+				result == JSISH_OK;
+				++i, result = jsish_cursor_next(&child)) {
+			CHECK(i < size);
+			CHECK(jsish_cursor_key(&child) == NULL);
+			CHECK(jsish_cursor_at(cursor, i, &found) == JSISH_OK);
+			CHECK(found.position == child.position);
+			check_cursor(&child, JSISH_ARRAY_INDEX(value, i), decoder);
+		}
+		CHECK(result == JSISH_NOT_FOUND);
+		CHECK(i == size);
+		CHECK(jsish_cursor_at(cursor, size, &found) == JSISH_NOT_FOUND);
+	} else if (value->type == JSISH_KEYVAL) {
+		size = JSISH_OBJECT_SIZE(value);
+		CHECK(size <= MAX_MEMBERS);
+		CHECK(jsish_cursor_at(cursor, 0, &found) == JSISH_NOT_FOUND);
+		for (i = 0, result = jsish_cursor_first(cursor, &child);
+				result == JSISH_OK;
+				++i, result = jsish_cursor_next(&child)) {
+			CHECK(i < size);
+			pair = JSISH_KV_INDEX(value, i);
+			positions[i] = child.position;
+			/* Of equal keys, the first is found. */
+			for (j = 0; strcmp(JSISH_KV_KEY(JSISH_KV_INDEX(value, j)),
+						JSISH_KV_KEY(pair)) != 0; ++j);
+			CHECK(jsish_cursor_find(cursor, JSISH_KV_KEY(pair), &found)
+					== JSISH_OK);
+			CHECK(found.position == positions[j]);
+			key = jsish_cursor_key(&child);
+			CHECK(key != NULL);
+			CHECK(strcmp(key, JSISH_KV_KEY(pair)) == 0);
+			check_cursor(&child, JSISH_KV_VALUE(pair), decoder);
+		}
+		CHECK(result == JSISH_NOT_FOUND);
+		CHECK(i == size);
+		CHECK(jsish_cursor_find(cursor, "no such key", &found)
+				== JSISH_NOT_FOUND);
+	} else {
+		CHECK(jsish_cursor_first(cursor, &child) == JSISH_NOT_FOUND);
+		CHECK(jsish_cursor_at(cursor, 0, &found) == JSISH_NOT_FOUND);
+		CHECK(jsish_cursor_find(cursor, "k0", &found) == JSISH_NOT_FOUND);
+	}
+}
+
+int main(void) {
+	static const unsigned int flags[] = {
+		0, JSISH_INTEGERS, JSISH_INDEX_KEYS | JSISH_INTEGERS
+	};
+	jsish_decoder_t decoder;
+	jsish_decoder_t cursor_decoder;
+	jsish_cursor_t cursor;
+	text_t text;
+	char* source;
+	char* cursor_source;
+	unsigned int i;
+	text.data = NULL;
+	text.size = 0;
+	for (i = 0; i < DOCUMENTS; ++i) {
+		generate(&text, 4, 6);
+		source = copy(text.data);
+		jsish_init_decoder(&decoder, values, VALUES_SIZE);
+		decoder.flags = flags[i % 3];
+		CHECK(jsish_decode(&decoder, source) == JSISH_OK);
+
+		cursor_source = copy(text.data);
+		CHECK(jsish_cursor_init(&cursor, cursor_source) == JSISH_OK);
+		jsish_init_decoder(&cursor_decoder, cursor_values, VALUES_SIZE);
+		cursor_decoder.flags = flags[i % 3];
+		check_cursor(&cursor, &decoder.root, &cursor_decoder);
+		free(cursor_source);
+		free(source);
+	}
+	free(text.data);
+	return 0;
+}
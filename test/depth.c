@@ -0,0 +1,130 @@
+/* Checks that given as many levels as the decoder's max_depth, the encoder,
+ * jsish_measure_ex() and jsish_minify_ex() handle whatever the decoder
+ * accepts, however deep, and reject one level more, and that the functions
+ * without them stop at their own limits. */
+#define JSISH_MAIN
+#include <jsish.h>
+
+#include "check.h"
+
+#define DEPTH 3000
+#define VALUES_SIZE (DEPTH * 8)
+
+static jsish_value_t values[VALUES_SIZE];
+static jsish_encode_frame_t frames[DEPTH];
+static unsigned int open[DEPTH];
+
+static int write_text(void* user, const char* data, unsigned int length) {
+	text_t* text;
+	text = (text_t*) user;
+	CHECK(text->length + length < text->size);
+	memcpy(&text->data[text->length], data, length);
+	text->length += length;
+	text->data[text->length] = '\0';
+	return 0;
+}
+
+/* Nests DEPTH arrays, or objects, around a number. */
+static void nest(text_t* text, unsigned int depth, int objects) {
+	unsigned int i;
+	text->length = 0;
+	append(text, "");
+	for (i = 0; i < depth; ++i) {
+		append(text, objects ? "{\"a\":" : "[");
+	}
+	append(text, "1");
+	for (i = 0; i < depth; ++i) {
+		append(text, objects ? "}" : "]");
+	}
+}
+
+static void check_depth(unsigned int depth, int objects) {
+	jsish_decoder_t decoder;
+	text_t text;
+	text_t written;
+	char scratch[64];
+	char* source;
+	char* encoded;
+	unsigned int needed;
+	unsigned int deepest;
+	unsigned int size;
+	text.data = NULL;
+	text.size = 0;
+	nest(&text, depth, objects);
+
+	source = copy(text.data);
+	jsish_init_decoder(&decoder, values, VALUES_SIZE);
+	decoder.max_depth = depth - 1;
+	CHECK(jsish_decode(&decoder, source) == JSISH_ERR_DEPTH);
+	free(source);
+	CHECK(jsish_measure_ex(text.data, 0, &needed, &deepest, open, depth - 1)
+			== JSISH_ERR_DEPTH);
+	CHECK(jsish_measure(text.data, 0, &needed, &deepest)
+			== (depth > JSISH_MAX_DEPTH ? JSISH_ERR_DEPTH : JSISH_OK));
+	CHECK(jsish_measure_ex(text.data, 0, &needed, &deepest, open, depth)
+			== JSISH_OK);
+	CHECK(deepest == depth);
+
+	/* Measured exactly, with the same limit. */
+	source = copy(text.data);
+	jsish_init_decoder(&decoder, values, needed);
+	decoder.max_depth = depth;
+	CHECK(jsish_decode(&decoder, source) == JSISH_OK);
+
+	CHECK(jsish_encode(&decoder.root, NULL, 0, &size)
+			== (depth > JSISH_ENCODE_DEPTH
+				? JSISH_ERR_DEPTH : JSISH_ERR_MEM_OVERFLOW));
+	CHECK(jsish_encode_ex(&decoder.root, NULL, 0, &size, frames, depth - 1)
+			== JSISH_ERR_DEPTH);
+	CHECK(jsish_encode_ex(&decoder.root, NULL, 0, &size, frames, depth)
+			== JSISH_ERR_MEM_OVERFLOW);
+	CHECK(size == text.length + 1);
+	encoded = (char*) malloc(size);
+	CHECK(encoded != NULL);
+	CHECK(jsish_encode_ex(&decoder.root, encoded, size, &size, frames, depth)
+			== JSISH_OK);
+	CHECK(strcmp(encoded, text.data) == 0);
+
+	written.data = encoded;
+	written.size = size;
+	written.length = 0;
+	CHECK(jsish_encode_to_ex(&decoder.root, write_text, &written,
+				scratch, sizeof scratch, frames, depth - 1) == JSISH_ERR_DEPTH);
+	written.length = 0;
+	CHECK(jsish_encode_to_ex(&decoder.root, write_text, &written,
+				scratch, sizeof scratch, frames, depth) == JSISH_OK);
+	CHECK(strcmp(encoded, text.data) == 0);
+	written.length = 0;
+	CHECK(jsish_encode_to(&decoder.root, write_text, &written,
+				scratch, sizeof scratch)
+			== (depth > JSISH_ENCODE_DEPTH ? JSISH_ERR_DEPTH : JSISH_OK));
+
+	written.length = 0;
+	CHECK(jsish_minify_ex(text.data, 0, write_text, &written,
+				scratch, sizeof scratch, open, depth - 1) == JSISH_ERR_DEPTH);
+	written.length = 0;
+	CHECK(jsish_minify_ex(text.data, 0, write_text, &written,
+				scratch, sizeof scratch, open, depth) == JSISH_OK);
+	CHECK(strcmp(encoded, text.data) == 0);
+	written.length = 0;
+	CHECK(jsish_minify(text.data, 0, write_text, &written,
+				scratch, sizeof scratch)
+			== (depth > JSISH_MAX_DEPTH ? JSISH_ERR_DEPTH : JSISH_OK));
+	free(encoded);
+	free(source);
+	free(text.data);
+}
+
+int main(void) {
+	/* From 2, as a max_depth of one less than 1 lifts the limit. */
+	static const unsigned int depths[] = {
+		2, 3, JSISH_ENCODE_DEPTH, JSISH_ENCODE_DEPTH + 1, JSISH_MAX_DEPTH,
+		JSISH_MAX_DEPTH + 1, DEPTH
+	};
+	unsigned int i;
+	for (i = 0; i < sizeof depths / sizeof depths[0]; ++i) {
+		check_depth(depths[i], 0);
+		check_depth(depths[i], 1);
+	}
+	return 0;
+}
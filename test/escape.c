@@ -0,0 +1,168 @@
+/* Checks string escaping against a byte-at-a-time escaper: every byte from 1
+ * to 255 at offsets on both sides of vector block boundaries, and random
+ * strings at random alignments, raw and not, encoded with jsish_encode() into
+ * buffers just big enough and one byte short, and with jsish_encode_to()
+ * through scratch buffers of every size up to SCRATCH_SIZE and a write
+ * callback that fails. */
+#define JSISH_MAIN
+#include <jsish.h>
+
+#include "check.h"
+
+#define MAX_OFFSET 80
+#define MAX_LENGTH 200
+#define STRINGS 2000
+#define SCRATCH_SIZE 40
+
+/* Room for the longest string at any alignment within a vector block. */
+static char strings[MAX_LENGTH + 64];
+
+/* Collects what the encoder writes, failing the call after CALLS_LEFT. */
+typedef struct {
+	text_t text;
+	unsigned int calls;
+	unsigned int calls_left;
+	int failed;
+} sink_t;
+
+static int collect(void* user, const char* data, unsigned int length) {
+	sink_t* sink;
+	char chunk[MAX_LENGTH * 6 + 3];
+	sink = (sink_t*) user;
+	/* Nothing more is written once a write has failed. */
+	CHECK(!sink->failed);
+	CHECK(length > 0 && length < sizeof chunk);
+	if (sink->calls++ == sink->calls_left) {
+		sink->failed = 1;
+		return 1;
+	}
+	memcpy(chunk, data, length);
+	chunk[length] = '\0';
+	append(&sink->text, chunk);
+	return 0;
+}
+
+/* Appends S to TEXT as the encoder writes it, one byte at a time. */
+static void escape(text_t* text, const char* s, int raw) {
+	char escaped[8];
+	unsigned char c;
+	append(text, "\"");
+	for (; *s; ++s) {
+		c = (unsigned char) *s;
+		switch (c) {
+			case '"': append(text, raw ? "\"" : "\\\""); break;
+			case '\\': append(text, raw ? "\\" : "\\\\"); break;
+			case '\b': append(text, "\\b"); break;
+			case '\f': append(text, "\\f"); break;
+			case '\n': append(text, "\\n"); break;
+			case '\r': append(text, "\\r"); break;
+			case '\t': append(text, "\\t"); break;
+			default:
+				if (c < 0x20) {
+					sprintf(escaped, "\\u%04x", c);
+				} else {
+					escaped[0] = (char) c;
+					escaped[1] = '\0';
+				}
+				append(text, escaped);
+				break;
+		}
+	}
+	append(text, "\"");
+}
+
+/* Encodes the string S every way, with each scratch size from FIRST_SCRATCH
+ * to LAST_SCRATCH, and checks the output against the reference. */
+static void check_string(
+		const char* s,
+		int raw,
+		unsigned int first_scratch,
+		unsigned int last_scratch) {
+	static text_t expected;
+	jsish_value_t value;
+	sink_t sink;
+	char scratch[SCRATCH_SIZE];
+	char* buffer;
+	unsigned int bytes;
+	unsigned int size;
+	unsigned int calls;
+	memset(&value, 0, sizeof value);
+	value.type = raw ? JSISH_RAW_STRING : JSISH_STRING;
+	value.data.vstr = s;
+	expected.length = 0;
+	escape(&expected, s, raw);
+
+	/* Exactly the room needed, and a byte less, which must not be written
+	 * past. */
+	size = expected.length + 1;
+	buffer = (char*) malloc(size);
+	CHECK(buffer != NULL);
+	CHECK(jsish_encode(&value, buffer, size, &bytes) == JSISH_OK);
+	CHECK(bytes == size);
+	CHECK(strcmp(buffer, expected.data) == 0);
+	free(buffer);
+	buffer = (char*) malloc(size - 1);
+	CHECK(buffer != NULL);
+	CHECK(jsish_encode(&value, buffer, size - 1, &bytes)
+			== JSISH_ERR_MEM_OVERFLOW);
+	CHECK(bytes == size);
+	free(buffer);
+
+	sink.text.data = NULL;
+	sink.text.size = 0;
+	for (size = first_scratch; size <= last_scratch; ++size) {
+		sink.text.length = 0;
+		append(&sink.text, "");
+		sink.calls = 0;
+		sink.calls_left = 0xFFFFFFFFu;
+		sink.failed = 0;
+		CHECK(jsish_encode_to(&value, collect, &sink, scratch, size)
+				== JSISH_OK);
+		CHECK(strcmp(sink.text.data, expected.data) == 0);
+
+		/* Failing any of the writes fails the encode. */
+		calls = sink.calls;
+		sink.calls = 0;
+		sink.calls_left = next_random(calls);
+		sink.failed = 0;
+		CHECK(jsish_encode_to(&value, collect, &sink, scratch, size)
+				== JSISH_ERR_WRITE);
+		CHECK(sink.failed);
+	}
+	free(sink.text.data);
+}
+
+int main(void) {
+	char* s;
+	unsigned int scratch;
+	unsigned int length;
+	unsigned int offset;
+	unsigned int c;
+	unsigned int i;
+	unsigned int j;
+	/* Each byte on its own, in a run of others that need no escaping. */
+	for (c = 1; c < 256; ++c) {
+		for (offset = 0; offset < MAX_OFFSET; ++offset) {
+			s = &strings[next_random(64)];
+			length = offset + 1 + next_random(MAX_LENGTH - MAX_OFFSET);
+			memset(s, 'a' + (int) (offset % 26), length);
+			s[offset] = (char) c;
+			s[length] = '\0';
+			scratch = next_random(SCRATCH_SIZE);
+			check_string(s, (int) (offset & 1), scratch, scratch);
+		}
+	}
+
+	/* Printable text with any other byte mixed in, often or now and then. */
+	for (i = 0; i < STRINGS; ++i) {
+		s = &strings[next_random(64)];
+		length = next_random(MAX_LENGTH);
+		for (j = 0; j < length; ++j) {
+			s[j] = (char) (next_random(i % 2 ? 40 : 4)
+				? 0x20 + next_random(0x60) : 1 + next_random(255));
+		}
+		s[length] = '\0';
+		check_string(s, (int) (i % 3 == 0), 0, SCRATCH_SIZE - 1);
+	}
+	return 0;
+}
@@ -0,0 +1,82 @@
+/* Checks that incremental decoding gives the same result as jsish_decode(),
+ * whatever the sizes of the chunks the document arrives in, including a byte
+ * at a time, so that the decoder suspends and resumes within every string,
+ * number and literal. */
+#define JSISH_MAIN
+#include <jsish.h>
+
+#include "check.h"
+
+#define DOCUMENTS 6000
+#define VALUES_SIZE 65536
+
+static jsish_value_t values[VALUES_SIZE];
+
+/* Feeds TEXT to DECODER in chunks of at most MAX_CHUNK bytes. */
+static jsish_result_t feed(
+		jsish_decoder_t* decoder,
+		const text_t* text,
+		char* buffer,
+		unsigned int max_chunk) {
+	jsish_result_t result;
+	unsigned int offset;
+	unsigned int length;
+	jsish_init_decoder(decoder, values, VALUES_SIZE);
+	jsish_decode_begin(decoder, buffer, text->length + 1);
+	result = JSISH_INCOMPLETE;
+	for (offset = 0; offset < text->length; offset += length) {
+		length = 1 + next_random(max_chunk);
+		if (length > text->length - offset) {
+			length = text->length - offset;
+		}
+		result = jsish_decode_feed(decoder, &text->data[offset], length);
+		if (result != JSISH_INCOMPLETE) {
+			return result;
+		}
+	}
+	return jsish_decode_finish(decoder);
+}
+
+int main(void) {
+	static const unsigned int max_chunks[] = { 1, 2, 7, 64, 1000 };
+	jsish_decoder_t expected;
+	jsish_decoder_t actual;
+	jsish_result_t result;
+	text_t text;
+	char* source;
+	char* buffer;
+	char* encoded;
+	unsigned int i;
+	unsigned int j;
+	text.data = NULL;
+	text.size = 0;
+	for (i = 0; i < DOCUMENTS; ++i) {
+		generate(&text, 4, 6);
+		if (i % 4 == 3) {
+			damage(&text);
+		}
+
+		source = copy(text.data);
+		jsish_init_decoder(&expected, values, VALUES_SIZE);
+		result = jsish_decode(&expected, source);
+		encoded = result == JSISH_OK ? encode(&expected.root) : NULL;
+
+		/* The tree lives in the same values, so only one at a time. */
+		buffer = (char*) malloc(text.length + 1);
+		CHECK(buffer != NULL);
+		for (j = 0; j < sizeof max_chunks / sizeof max_chunks[0]; ++j) {
+			CHECK(feed(&actual, &text, buffer, max_chunks[j]) == result);
+			if (result == JSISH_OK) {
+				char* fed;
+				fed = encode(&actual.root);
+				CHECK(strcmp(fed, encoded) == 0);
+				free(fed);
+			}
+		}
+		free(buffer);
+		free(encoded);
+		free(source);
+	}
+	free(text.data);
+	return 0;
+}
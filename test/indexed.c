@@ -0,0 +1,61 @@
+/* Checks that two-stage decoding gives the same result and tree as
+ * jsish_decode(), with structurals arrays small enough that the first stage
+ * has to refill them many times within a document. */
+#define JSISH_MAIN
+#include <jsish.h>
+
+#include "check.h"
+
+#define DOCUMENTS 6000
+#define VALUES_SIZE 65536
+#define MAX_STRUCTURALS 400
+
+static jsish_value_t values[VALUES_SIZE];
+static unsigned int structurals[MAX_STRUCTURALS];
+
+int main(void) {
+	static const unsigned int flags[] = {
+		0, JSISH_INDEX_KEYS, JSISH_INTEGERS | JSISH_UNESCAPE,
+		JSISH_SORT_KEYS | JSISH_VALIDATE_UTF8 | JSISH_COPY_STRINGS
+	};
+	jsish_decoder_t decoder;
+	jsish_result_t expected;
+	text_t text;
+	char* source;
+	char* reference;
+	char* encoded;
+	unsigned int size;
+	unsigned int i;
+	text.data = NULL;
+	text.size = 0;
+	for (i = 0; i < DOCUMENTS; ++i) {
+		generate(&text, 6, 16);
+		if (i % 4 == 3) {
+			damage(&text);
+		}
+
+		source = copy(text.data);
+		jsish_init_decoder(&decoder, values, VALUES_SIZE);
+		decoder.flags = flags[i % 4];
+		expected = jsish_decode(&decoder, source);
+		reference = expected == JSISH_OK ? encode(&decoder.root) : NULL;
+		free(source);
+
+		/* From the smallest size allowed up to a few hundred. */
+		size = 65 + (i % 8 ? next_random(MAX_STRUCTURALS - 65) : 0);
+		source = copy(text.data);
+		jsish_init_decoder(&decoder, values, VALUES_SIZE);
+		decoder.flags = flags[i % 4];
+		CHECK(jsish_decode_indexed(&decoder, source, structurals, size)
+				== expected);
+		if (expected == JSISH_OK) {
+			encoded = encode(&decoder.root);
+			CHECK(strcmp(encoded, reference) == 0);
+			free(encoded);
+		}
+		free(source);
+		free(reference);
+	}
+	free(text.data);
+	return 0;
+}
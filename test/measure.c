@@ -0,0 +1,61 @@
+/* Checks that jsish_measure() gives the exact number of values that
+ * jsish_decode() needs: decoding succeeds with that many and runs out with one
+ * less, whether keys are indexed and strings copied or not. */
+#define JSISH_MAIN
+#include <jsish.h>
+
+#include "check.h"
+
+#define DOCUMENTS 3000
+#define VALUES_SIZE 65536
+
+static jsish_value_t values[VALUES_SIZE];
+
+static jsish_result_t decode(
+		const text_t* text, unsigned int flags, unsigned int values_size) {
+	jsish_decoder_t decoder;
+	jsish_result_t result;
+	char* source;
+	source = copy(text->data);
+	jsish_init_decoder(&decoder, values, values_size);
+	decoder.flags = flags;
+	result = jsish_decode(&decoder, source);
+	free(source);
+	return result;
+}
+
+int main(void) {
+	static const unsigned int flags[] = {
+		0, JSISH_INDEX_KEYS, JSISH_COPY_STRINGS,
+		JSISH_INDEX_KEYS | JSISH_COPY_STRINGS,
+		JSISH_INDEX_KEYS | JSISH_COPY_STRINGS | JSISH_UNESCAPE
+	};
+	jsish_result_t result;
+	text_t text;
+	unsigned int needed;
+	unsigned int depth;
+	unsigned int i;
+	unsigned int j;
+	text.data = NULL;
+	text.size = 0;
+	for (i = 0; i < DOCUMENTS; ++i) {
+		generate(&text, 5, 12);
+		if (i % 8 == 7) {
+			damage(&text);
+		}
+		for (j = 0; j < sizeof flags / sizeof flags[0]; ++j) {
+			result = jsish_measure(text.data, flags[j], &needed, &depth);
+			CHECK(decode(&text, flags[j], VALUES_SIZE) == result);
+			if (result != JSISH_OK) {
+				continue;
+			}
+			CHECK(needed <= VALUES_SIZE);
+			CHECK(decode(&text, flags[j], needed) == JSISH_OK);
+			/* A scalar root takes none, it is kept in the decoder. */
+			CHECK(!needed || decode(&text, flags[j], needed - 1)
+					== JSISH_ERR_MEM_OVERFLOW);
+		}
+	}
+	free(text.data);
+	return 0;
+}
@@ -0,0 +1,137 @@
+/* Checks that jsish_minify() accepts what jsish_decode() does, and with
+ * JSISH_SORT_KEYS puts members in the order the decoder would, comparing keys
+ * unescaped with JSISH_UNESCAPE: decoding its output without sorting must give
+ * the tree that decoding the document with sorting does. */
+#define JSISH_MAIN
+#include <jsish.h>
+
+#include "check.h"
+
+#define DOCUMENTS 3000
+#define VALUES_SIZE 65536
+#define SCRATCH_SIZE 262144
+
+static jsish_value_t values[VALUES_SIZE];
+static char scratch[SCRATCH_SIZE];
+
+static int write_text(void* user, const char* data, unsigned int length) {
+	text_t* text;
+	static char chunk[SCRATCH_SIZE + 1];
+	text = (text_t*) user;
+	memcpy(chunk, data, length);
+	chunk[length] = '\0';
+	append(text, chunk);
+	return 0;
+}
+
+/* Keys written in different ways, some the same once unescaped, and some that
+ * the decoder leaves escaped. */
+static const char* const keys[] = {
+	"a", "\\u0061", "b", "\\u0062", "B", "\\u0042", "ab", "a\\u0062",
+	"\\u00e9", "\\u00c9", "\\u00E9x", "\\ud83d\\ude00", "\\ud800",
+	"\\u0000", "a\\u0000", "\\n", "\\t", "\\\\", "\\/", "/", "\\\"", "\\\"x",
+	"", "\\uffff", "\\u007f"
+};
+
+/* Appends an object of random members, some of them objects too. */
+static void generate_object(text_t* text, unsigned int depth) {
+	unsigned int size;
+	unsigned int i;
+	append(text, "{");
+	size = next_random(12);
+	for (i = 0; i < size; ++i) {
+		append(text, i ? ", \"" : "\"");
+		append(text, keys[next_random(sizeof keys / sizeof keys[0])]);
+		append(text, "\": ");
+		if (depth && !next_random(4)) {
+			generate_object(text, depth - 1);
+		} else {
+			append(text, next_random(2) ? "1" : "[true]");
+		}
+	}
+	append(text, "}");
+}
+
+static jsish_result_t minify(
+		const text_t* text, unsigned int flags, text_t* output) {
+	output->length = 0;
+	append(output, "");
+	return jsish_minify(
+			text->data, flags, write_text, output, scratch, SCRATCH_SIZE);
+}
+
+static char* decode(const char* text, unsigned int flags) {
+	jsish_decoder_t decoder;
+	char* source;
+	char* encoded;
+	source = copy(text);
+	jsish_init_decoder(&decoder, values, VALUES_SIZE);
+	decoder.flags = flags;
+	CHECK(jsish_decode(&decoder, source) == JSISH_OK);
+	encoded = encode(&decoder.root);
+	free(source);
+	return encoded;
+}
+
+int main(void) {
+	static const unsigned int flags[] = {
+		JSISH_SORT_KEYS | JSISH_UNESCAPE, JSISH_SORT_KEYS,
+		JSISH_SORT_KEYS | JSISH_UNESCAPE | JSISH_COPY_STRINGS,
+		JSISH_SORT_KEYS | JSISH_UNESCAPE | JSISH_INDEX_KEYS, 0
+	};
+	jsish_decoder_t decoder;
+	jsish_result_t result;
+	text_t text;
+	text_t output;
+	char* source;
+	char* expected;
+	char* actual;
+	unsigned int i;
+	unsigned int f;
+	text.data = NULL;
+	text.size = 0;
+	output.data = NULL;
+	output.size = 0;
+
+	text.length = 0;
+	append(&text, "{\"a\":1,\"\\u0062\":2,\"B\":3}");
+	CHECK(minify(&text, JSISH_SORT_KEYS | JSISH_UNESCAPE, &output) == JSISH_OK);
+	CHECK(strcmp(output.data, "{\"B\":3,\"a\":1,\"\\u0062\":2}") == 0);
+	CHECK(minify(&text, JSISH_SORT_KEYS, &output) == JSISH_OK);
+	CHECK(strcmp(output.data, "{\"B\":3,\"\\u0062\":2,\"a\":1}") == 0);
+
+	for (i = 0; i < DOCUMENTS; ++i) {
+		text.length = 0;
+		append(&text, "");
+		generate_object(&text, 3);
+		f = flags[i % 5];
+		CHECK(minify(&text, f, &output) == JSISH_OK);
+		expected = decode(text.data, f);
+		actual = decode(output.data, f & ~JSISH_SORT_KEYS);
+		CHECK(strcmp(expected, actual) == 0);
+		free(expected);
+		free(actual);
+
+		/* Documents of every kind, some of them malformed. */
+		generate(&text, 4, 8);
+		if (i % 4 == 3) {
+			damage(&text);
+		}
+		source = copy(text.data);
+		jsish_init_decoder(&decoder, values, VALUES_SIZE);
+		decoder.flags = f;
+		result = jsish_decode(&decoder, source);
+		free(source);
+		CHECK(minify(&text, f, &output) == result);
+		if (result == JSISH_OK) {
+			expected = decode(text.data, f);
+			actual = decode(output.data, f & ~JSISH_SORT_KEYS);
+			CHECK(strcmp(expected, actual) == 0);
+			free(expected);
+			free(actual);
+		}
+	}
+	free(output.data);
+	free(text.data);
+	return 0;
+}
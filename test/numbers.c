@@ -0,0 +1,138 @@
+/* Checks number parsing and formatting against the C library: random doubles
+ * must parse as strtod() reads their digits and be encoded as text that
+ * strtod() reads back as the same double, and short decimals must be encoded
+ * with no more digits than they were written with. */
+#define JSISH_MAIN
+#include <jsish.h>
+
+#include "check.h"
+
+#define RANDOM_DOUBLES 3000000
+
+/* Another generator than next_random(), for all 64 bits of a double. */
+static _jsish_uint_t next_bits(void) {
+	static _jsish_uint_t state = 88172645u;
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return state;
+}
+
+static int same(double a, double b) {
+	return memcmp(&a, &b, sizeof a) == 0;
+}
+
+static double parse(const char* text) {
+	jsish_value_t values[4];
+	jsish_decoder_t decoder;
+	char source[64];
+	strcpy(source, text);
+	jsish_init_decoder(&decoder, values, 4);
+	CHECK(jsish_decode(&decoder, source) == JSISH_OK);
+	CHECK(JSISH_IS_NUMBER(&decoder.root));
+	return JSISH_GET_NUMBER(&decoder.root);
+}
+
+static void format(double number, char* text) {
+	jsish_value_t value;
+	unsigned int length;
+	memset(&value, 0, sizeof value);
+	value.type = JSISH_NUMBER;
+	value.data.vnum = number;
+	CHECK(jsish_encode(&value, text, 32, &length) == JSISH_OK);
+}
+
+/* Number of significant digits of a formatted number. */
+static int significant(const char* text) {
+	int count;
+	int zeros;
+	count = 0;
+	zeros = 0;
+	for (; *text && *text != 'e'; ++text) {
+		if (*text == '0') {
+			zeros += count > 0;
+		} else if (*text >= '1' && *text <= '9') {
+			count += zeros + 1;
+			zeros = 0;
+		}
+	}
+	return count;
+}
+
+/* The fewest significant digits that read back as NUMBER, up to LIMIT. */
+static int fewest(double number, int limit) {
+	char text[40];
+	int digits;
+	for (digits = 1; digits < limit; ++digits) {
+		sprintf(text, "%.*e", digits - 1, number);
+		if (same(strtod(text, NULL), number)) {
+			break;
+		}
+	}
+	return digits;
+}
+
+int main(void) {
+	static const char* const known[][2] = {
+		{ "1e23", "1e23" },
+		{ "1e126", "1e126" },
+		{ "-1.33e22", "-1.33e22" },
+		{ "0.1", "0.1" },
+		{ "5e-324", "5e-324" },
+		{ "1.7976931348623157e308", "1.7976931348623157e308" },
+		{ "2.2250738585072014e-308", "2.2250738585072014e-308" },
+		{ "9007199254740993", "9007199254740992" },
+		{ "123.456", "123.456" },
+		{ "1e21", "1e21" },
+		{ "1e-7", "1e-7" },
+		{ "0.000001", "0.000001" }
+	};
+	union {
+		double number;
+		_jsish_uint_t bits;
+	} random;
+	char text[40];
+	char formatted[32];
+	unsigned int mantissa;
+	unsigned int i;
+	int exponent;
+	int digits;
+	double number;
+
+	for (i = 0; i < sizeof known / sizeof known[0]; ++i) {
+		format(parse(known[i][0]), formatted);
+		CHECK(strcmp(formatted, known[i][1]) == 0);
+	}
+
+	for (i = 0; i < RANDOM_DOUBLES; ++i) {
+		random.bits = next_bits();
+		if ((random.bits >> 52 & 0x7ff) == 0x7ff) {
+			continue;
+		}
+		sprintf(text, "%.17g", random.number);
+		CHECK(same(parse(text), random.number));
+		format(random.number, formatted);
+		CHECK(same(strtod(formatted, NULL), random.number));
+	}
+
+	/* Decimals of up to three digits over the whole range, where the rounding
+	 * interval often has one of them at its very edge. */
+	for (mantissa = 1; mantissa < 1000; ++mantissa) {
+		if (mantissa % 10 == 0) {
+			continue;
+		}
+		digits = mantissa < 10 ? 1 : mantissa < 100 ? 2 : 3;
+		for (exponent = -325; exponent <= 308; ++exponent) {
+			sprintf(text, "%ue%d", mantissa, exponent);
+			number = strtod(text, NULL);
+			if (number == 0.0 || number > 1.7976931348623157e308) {
+				continue;
+			}
+			CHECK(same(parse(text), number));
+			format(number, formatted);
+			CHECK(same(strtod(formatted, NULL), number));
+			CHECK(significant(formatted) == fewest(number, digits));
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,75 @@
+/* Checks that objects built by hand with jsish_init_object() encode and look
+ * up the same way as decoded ones. */
+#define JSISH_MAIN
+#include <jsish.h>
+
+#include "check.h"
+
+#define MEMBERS 20
+
+static void set_string(jsish_value_t* value, const char* string) {
+	memset(value, 0, sizeof *value);
+	value->type = JSISH_STRING;
+	value->data.vstr = string;
+}
+
+int main(void) {
+	static const char* const keys[] = {
+		"a", "b", "c", "d", "e", "f", "g", "h", "i", "j",
+		"k", "l", "m", "n", "o", "p", "q", "r", "s", "t"
+	};
+	jsish_value_t members[JSISH_OBJECT_VALUES(MEMBERS)];
+	jsish_value_t outer[JSISH_OBJECT_VALUES(1)];
+	jsish_value_t object;
+	jsish_value_t root;
+	jsish_value_t values[256];
+	jsish_decoder_t decoder;
+	text_t expected;
+	char* source;
+	char* encoded;
+	unsigned int size;
+	unsigned int i;
+	expected.data = NULL;
+	expected.size = 0;
+	for (size = 0; size <= MEMBERS; ++size) {
+		expected.length = 0;
+		append(&expected, "{\"outer\":{");
+		for (i = 0; i < size; ++i) {
+			set_string(&members[i * 2], keys[i]);
+			set_string(&members[i * 2 + 1], keys[MEMBERS - 1 - i]);
+			append(&expected, i ? ",\"" : "\"");
+			append(&expected, keys[i]);
+			append(&expected, "\":\"");
+			append(&expected, keys[MEMBERS - 1 - i]);
+			append(&expected, "\"");
+		}
+		append(&expected, "}}");
+		jsish_init_object(&object, members, size);
+		set_string(&outer[0], "outer");
+		outer[1] = object;
+		jsish_init_object(&root, outer, 1);
+
+		CHECK(JSISH_IS_KEYVAL(&root));
+		CHECK(JSISH_OBJECT_SIZE(&object) == size);
+		encoded = encode(&root);
+		CHECK(strcmp(encoded, expected.data) == 0);
+		free(encoded);
+		for (i = 0; i < size; ++i) {
+			CHECK(strcmp(JSISH_KV_KEY(JSISH_KV_INDEX(&object, i)), keys[i]) == 0);
+			CHECK(strcmp(JSISH_GET_STRING(jsish_get_property(&object, keys[i])),
+						keys[MEMBERS - 1 - i]) == 0);
+		}
+		CHECK(jsish_get_property(&object, "u") == NULL);
+
+		/* The same as decoding the text. */
+		source = copy(expected.data);
+		jsish_init_decoder(&decoder, values, 256);
+		CHECK(jsish_decode(&decoder, source) == JSISH_OK);
+		encoded = encode(&decoder.root);
+		CHECK(strcmp(encoded, expected.data) == 0);
+		free(encoded);
+		free(source);
+	}
+	free(expected.data);
+	return 0;
+}
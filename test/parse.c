@@ -0,0 +1,388 @@
+/* Checks the events of jsish_parse() against walking the tree that
+ * jsish_decode() builds: the text written from them must be the same, with
+ * callbacks that skip and stop at random, and on damaged documents. Malformed
+ * input within what is skipped is checked by hand. */
+#define JSISH_MAIN
+#include <jsish.h>
+
+#include "check.h"
+
+#define DOCUMENTS 3000
+#define VALUES_SIZE 65536
+
+static jsish_value_t values[VALUES_SIZE];
+
+/* Text written from events, see rebuild_events. SKIPS is how often in eight
+ * events the callbacks return JSISH_SKIP, and the one numbered STOP_AT returns
+ * JSISH_STOP, if any. Both decide the same way for the same events, with
+ * random numbers of their own, so that parsing and walking the tree agree. */
+typedef struct {
+	text_t text;
+	unsigned long seed;
+	unsigned int skips;
+	unsigned int events;
+	unsigned int stop_at;
+	unsigned int skipped;
+	unsigned int depth;
+	int first[JSISH_MAX_DEPTH];
+	int after_key;
+} rebuild_t;
+
+static int next_action(rebuild_t* rebuild) {
+	rebuild->seed = (rebuild->seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+	if (++rebuild->events == rebuild->stop_at) {
+		return JSISH_STOP;
+	}
+	if ((rebuild->seed >> 8) % 8 < rebuild->skips) {
+		return JSISH_SKIP;
+	}
+	return JSISH_CONTINUE;
+}
+
+/* Appends a comma before all but the first element or member. */
+static void separate(rebuild_t* rebuild) {
+	if (rebuild->depth && !rebuild->after_key) {
+		if (!rebuild->first[rebuild->depth - 1]) {
+			append(&rebuild->text, ",");
+		}
+		rebuild->first[rebuild->depth - 1] = 0;
+	}
+	rebuild->after_key = 0;
+}
+
+/* Appends VALUE as jsish_encode() writes it, unless the callback stops. */
+static int write_scalar(rebuild_t* rebuild, const jsish_value_t* value) {
+	char* encoded;
+	int action;
+	action = next_action(rebuild);
+	if (action == JSISH_STOP) {
+		return action;
+	}
+	separate(rebuild);
+	encoded = encode(value);
+	append(&rebuild->text, encoded);
+	free(encoded);
+	/* Which is the same as JSISH_CONTINUE here. */
+	return action;
+}
+
+static int on_null(void* user) {
+	jsish_value_t value;
+	memset(&value, 0, sizeof value);
+	value.type = JSISH_NULL;
+	return write_scalar((rebuild_t*) user, &value);
+}
+
+static int on_bool(void* user, int bool_value) {
+	jsish_value_t value;
+	memset(&value, 0, sizeof value);
+	value.type = JSISH_BOOL;
+	value.data.vbool = (char) bool_value;
+	return write_scalar((rebuild_t*) user, &value);
+}
+
+static int on_number(void* user, double number) {
+	jsish_value_t value;
+	memset(&value, 0, sizeof value);
+	value.type = JSISH_NUMBER;
+	value.data.vnum = number;
+	return write_scalar((rebuild_t*) user, &value);
+}
+
+static int on_integer(void* user, jsish_int_t integer) {
+	jsish_value_t value;
+	memset(&value, 0, sizeof value);
+	value.type = JSISH_INTEGER;
+	value.data.vint = integer;
+	return write_scalar((rebuild_t*) user, &value);
+}
+
+static int on_string(void* user, const char* string, int raw) {
+	jsish_value_t value;
+	memset(&value, 0, sizeof value);
+	value.type = raw ? JSISH_RAW_STRING : JSISH_STRING;
+	value.data.vstr = string;
+	return write_scalar((rebuild_t*) user, &value);
+}
+
+static int on_key(void* user, const char* key, int raw) {
+	rebuild_t* rebuild;
+	int action;
+	rebuild = (rebuild_t*) user;
+	action = on_string(user, key, raw);
+	if (action == JSISH_SKIP) {
+		/* The key was written all the same, which marks where a value was
+		 * skipped. */
+		rebuild->skipped++;
+		append(&rebuild->text, ":-");
+	} else if (action == JSISH_CONTINUE) {
+		append(&rebuild->text, ":");
+		rebuild->after_key = 1;
+	}
+	return action;
+}
+
+static int begin(rebuild_t* rebuild, const char* bracket) {
+	int action;
+	action = next_action(rebuild);
+	if (action == JSISH_STOP) {
+		return action;
+	}
+	separate(rebuild);
+	if (action == JSISH_SKIP) {
+		rebuild->skipped++;
+		append(&rebuild->text, "-");
+		return action;
+	}
+	append(&rebuild->text, bracket);
+	rebuild->first[rebuild->depth++] = 1;
+	return action;
+}
+
+static int end(rebuild_t* rebuild, const char* bracket) {
+	int action;
+	action = next_action(rebuild);
+	if (action == JSISH_STOP) {
+		return action;
+	}
+	append(&rebuild->text, bracket);
+	rebuild->depth--;
+	return action;
+}
+
+static int on_array_begin(void* user) {
+	return begin((rebuild_t*) user, "[");
+}
+
+static int on_array_end(void* user) {
+	return end((rebuild_t*) user, "]");
+}
+
+static int on_object_begin(void* user) {
+	return begin((rebuild_t*) user, "{");
+}
+
+static int on_object_end(void* user) {
+	return end((rebuild_t*) user, "}");
+}
+
+static const jsish_events_t rebuild_events = {
+	on_null, on_bool, on_number, on_integer, on_string, on_key,
+	on_array_begin, on_array_end, on_object_begin, on_object_end
+};
+
+static int raw_key(const jsish_value_t* pair) {
+#ifdef JSISH_COMPACT
+	return pair->type == JSISH_RAW_STRING;
+#else
+	return pair->data.vobj.key->type == JSISH_RAW_STRING;
+#endif
+}
+
+/* Passes VALUE to the callbacks as jsish_parse() would have, and returns
+ * JSISH_STOP if one of them does. */
+static int walk(const jsish_value_t* value, rebuild_t* rebuild) {
+	const jsish_value_t* pair;
+	unsigned int size;
+	unsigned int i;
+	int action;
+	switch (value->type) {
+		case JSISH_NULL:
+			action = on_null(rebuild);
+			break;
+		case JSISH_BOOL:
+			action = on_bool(rebuild, JSISH_GET_BOOL(value));
+			break;
+		case JSISH_NUMBER:
+			action = on_number(rebuild, JSISH_GET_NUMBER(value));
+			break;
+		case JSISH_INTEGER:
+			action = on_integer(rebuild, JSISH_GET_INTEGER(value));
+			break;
+		case JSISH_STRING: case JSISH_RAW_STRING:
+			action = on_string(rebuild, JSISH_GET_STRING(value),
+					value->type == JSISH_RAW_STRING);
+			break;
+		case JSISH_ARRAY:
+			action = on_array_begin(rebuild);
+			if (action != JSISH_CONTINUE) {
+				break;
+			}
+			size = JSISH_ARRAY_SIZE(value);
+			for (i = 0; i < size; ++i) {
+				if (walk(JSISH_ARRAY_INDEX(value, i), rebuild) == JSISH_STOP) {
+					return JSISH_STOP;
+				}
+			}
+			action = on_array_end(rebuild);
+			break;
+		default:
+			action = on_object_begin(rebuild);
+			if (action != JSISH_CONTINUE) {
+				break;
+			}
+			size = JSISH_OBJECT_SIZE(value);
+			for (i = 0; i < size; ++i) {
+				pair = JSISH_KV_INDEX(value, i);
+				action = on_key(rebuild, JSISH_KV_KEY(pair), raw_key(pair));
+				if (action == JSISH_STOP) {
+					return JSISH_STOP;
+				}
+				if (action == JSISH_SKIP) {
+					continue;
+				}
+				if (walk(JSISH_KV_VALUE(pair), rebuild) == JSISH_STOP) {
+					return JSISH_STOP;
+				}
+			}
+			action = on_object_end(rebuild);
+			break;
+	}
+	return action == JSISH_STOP ? JSISH_STOP : JSISH_CONTINUE;
+}
+
+static void start(
+		rebuild_t* rebuild,
+		unsigned long seed,
+		unsigned int skips,
+		unsigned int stop_at) {
+	rebuild->text.length = 0;
+	append(&rebuild->text, "");
+	rebuild->seed = seed;
+	rebuild->skips = skips;
+	rebuild->events = 0;
+	rebuild->stop_at = stop_at;
+	rebuild->skipped = 0;
+	rebuild->depth = 0;
+	rebuild->after_key = 0;
+}
+
+/* Skips the members whose keys start with "s". */
+static int skip_s(void* user, const char* key, int raw) {
+	(void) user;
+	(void) raw;
+	return key[0] == 's' ? JSISH_SKIP : JSISH_CONTINUE;
+}
+
+/* Skips every array and object but the root. */
+static int skip_nested(void* user) {
+	return (*(int*) user)++ ? JSISH_SKIP : JSISH_CONTINUE;
+}
+
+/* What is skipped needs only its brackets and strings to match up. */
+static void check_skipped(void) {
+	static const struct {
+		const char* source;
+		jsish_result_t result;
+	} cases[] = {
+		{ "{\"s\":[1,,2],\"a\":1}", JSISH_OK },
+		{ "{\"s\":{\"x\" 1 2},\"a\":[]}", JSISH_OK },
+		{ "{\"s\":[tru],\"a\":{}}", JSISH_OK },
+		{ "{\"s\":[\"]\",\"}\"]}", JSISH_OK },
+		{ "{\"s\":[1,2}", JSISH_ERR_MALFORMED },
+		{ "{\"s\":[\"x]}", JSISH_ERR_MALFORMED },
+		{ "{\"s\":[1,2]", JSISH_ERR_MALFORMED },
+		{ "{\"s\":[1,2] \"a\":1}", JSISH_ERR_MALFORMED },
+		{ "{\"s\":[1],\"a\":[1,,2]}", JSISH_ERR_MALFORMED },
+		/* Scalars are read, skipped or not. */
+		{ "{\"s\":tru,\"a\":1}", JSISH_ERR_MALFORMED },
+		{ "{\"s\":\"\\x\"}", JSISH_ERR_MALFORMED }
+	};
+	jsish_events_t events;
+	char* source;
+	unsigned int i;
+	int begun;
+	memset(&events, 0, sizeof events);
+	events.on_key = skip_s;
+	for (i = 0; i < sizeof cases / sizeof cases[0]; ++i) {
+		source = copy(cases[i].source);
+		CHECK(jsish_parse(source, 0, &events, NULL) == cases[i].result);
+		free(source);
+	}
+
+	memset(&events, 0, sizeof events);
+	events.on_array_begin = skip_nested;
+	events.on_object_begin = skip_nested;
+	begun = 0;
+	source = copy("[{\"a\":[1,,]},[{\"b\" 2}],2]");
+	CHECK(jsish_parse(source, 0, &events, &begun) == JSISH_OK);
+	CHECK(begun == 3);
+	free(source);
+	begun = 0;
+	source = copy("[[1,2]}");
+	CHECK(jsish_parse(source, 0, &events, &begun) == JSISH_ERR_MALFORMED);
+	free(source);
+}
+
+int main(void) {
+	static const unsigned int flags[] = {
+		0, JSISH_INTEGERS, JSISH_UNESCAPE,
+		JSISH_INTEGERS | JSISH_UNESCAPE | JSISH_VALIDATE_UTF8
+	};
+	static rebuild_t parsed;
+	static rebuild_t walked;
+	jsish_decoder_t decoder;
+	jsish_result_t reference;
+	jsish_result_t result;
+	text_t text;
+	char* source;
+	char* reference_source;
+	char* expected;
+	unsigned long seed;
+	unsigned int skips;
+	unsigned int stop_at;
+	unsigned int i;
+	check_skipped();
+
+	text.data = NULL;
+	text.size = 0;
+	parsed.text.data = NULL;
+	parsed.text.size = 0;
+	walked.text.data = NULL;
+	walked.text.size = 0;
+	for (i = 0; i < DOCUMENTS; ++i) {
+		generate(&text, 3, 6);
+		if (i % 4 == 3) {
+			damage(&text);
+		}
+		seed = next_random(0x7fffffff);
+		/* Every event, with some skipped, and up to some event. */
+		skips = i % 3 ? next_random(3) : 0;
+		stop_at = i % 3 == 2 ? 1 + next_random(12) : 0;
+
+		reference_source = copy(text.data);
+		jsish_init_decoder(&decoder, values, VALUES_SIZE);
+		decoder.flags = flags[i % 4];
+		reference = jsish_decode(&decoder, reference_source);
+
+		source = copy(text.data);
+		start(&parsed, seed, skips, stop_at);
+		result = jsish_parse(source, flags[i % 4], &rebuild_events, &parsed);
+		if (reference != JSISH_OK) {
+			/* Unless a callback stopped before the error was reached, or it
+			 * is within what was skipped. */
+			CHECK(result == reference || result == JSISH_STOPPED
+					|| (result == JSISH_OK && parsed.skipped));
+			free(reference_source);
+			free(source);
+			continue;
+		}
+
+		start(&walked, seed, skips, stop_at);
+		CHECK(result == (walk(&decoder.root, &walked) == JSISH_STOP
+					? JSISH_STOPPED : JSISH_OK));
+		CHECK(strcmp(parsed.text.data, walked.text.data) == 0);
+		CHECK(parsed.events == walked.events);
+		if (!skips && !stop_at) {
+			expected = encode(&decoder.root);
+			CHECK(strcmp(parsed.text.data, expected) == 0);
+			free(expected);
+		}
+		free(reference_source);
+		free(source);
+	}
+	free(text.data);
+	free(parsed.text.data);
+	free(walked.text.data);
+	return 0;
+}
@@ -0,0 +1,243 @@
+/* Checks that jsish_path_match() on a decoded tree and
+ * jsish_path_match_cursor() on the source find the same values for random
+ * queries on generated documents, with wildcards, escaped keys, segments that
+ * are not array indices, paths listed twice and too little room for the
+ * matches. A hand-written document covers ~0 and ~1 escapes and stopping once
+ * every path has been found. */
+#define JSISH_MAIN
+#include <jsish.h>
+
+#include "check.h"
+
+#define DOCUMENTS 20000
+#define VALUES_SIZE 65536
+#define MAX_PATHS 6
+#define MAX_SEGMENTS 4
+#define MAX_MATCHES 4096
+
+static jsish_value_t values[VALUES_SIZE];
+static jsish_value_t cursor_values[VALUES_SIZE];
+static jsish_match_t tree_matches[MAX_MATCHES];
+static jsish_match_t cursor_matches[MAX_MATCHES];
+
+/* Sorts MATCHES by path, keeping those of the same path in order, as the two
+ * go through arrays in different orders. */
+static void sort_matches(jsish_match_t* matches, unsigned int count) {
+	jsish_match_t match;
+	unsigned int i;
+	unsigned int j;
+	for (i = 1; i < count; ++i) {
+		match = matches[i];
+		for (j = i; j > 0 && matches[j - 1].path > match.path; --j) {
+			matches[j] = matches[j - 1];
+		}
+		matches[j] = match;
+	}
+}
+
+/* Matches the COUNT PATHS against TEXT both ways, with room for
+ * MATCHES_SIZE matches, and checks that they agree. Returns the result. */
+static jsish_result_t check_paths(
+		const char* text,
+		unsigned int flags,
+		const char* const* paths,
+		unsigned int count,
+		unsigned int matches_size,
+		unsigned int* match_count) {
+	jsish_path_node_t nodes[MAX_PATHS * MAX_SEGMENTS + 1];
+	jsish_path_t query;
+	jsish_decoder_t decoder;
+	jsish_decoder_t cursor_decoder;
+	jsish_cursor_t cursor;
+	jsish_result_t result;
+	char* source;
+	char* cursor_source;
+	char* expected;
+	char* actual;
+	unsigned int tree_count;
+	unsigned int cursor_count;
+	unsigned int i;
+	CHECK(jsish_path_compile(&query, paths, count, nodes,
+				MAX_PATHS * MAX_SEGMENTS + 1) == JSISH_OK);
+	source = copy(text);
+	jsish_init_decoder(&decoder, values, VALUES_SIZE);
+	decoder.flags = flags;
+	CHECK(jsish_decode(&decoder, source) == JSISH_OK);
+	result = jsish_path_match(
+			&query, &decoder.root, tree_matches, matches_size, &tree_count);
+
+	cursor_source = copy(text);
+	CHECK(jsish_cursor_init(&cursor, cursor_source) == JSISH_OK);
+	jsish_init_decoder(&cursor_decoder, cursor_values, VALUES_SIZE);
+	cursor_decoder.flags = flags;
+	CHECK(jsish_path_match_cursor(&query, &cursor, &cursor_decoder,
+				cursor_matches, matches_size, &cursor_count) == result);
+
+	/* Which matches were made before running out of room depends on the
+	 * order. */
+	if (result == JSISH_OK) {
+		CHECK(tree_count == cursor_count);
+		sort_matches(tree_matches, tree_count);
+		sort_matches(cursor_matches, cursor_count);
+		for (i = 0; i < tree_count; ++i) {
+			CHECK(tree_matches[i].path == cursor_matches[i].path);
+			CHECK(tree_matches[i].path < count);
+			expected = encode(tree_matches[i].value);
+			actual = encode(cursor_matches[i].value);
+			CHECK(strcmp(expected, actual) == 0);
+			free(expected);
+			free(actual);
+		}
+	} else {
+		CHECK(result == JSISH_ERR_MEM_OVERFLOW);
+		CHECK(tree_count == matches_size && cursor_count == matches_size);
+	}
+	if (match_count) {
+		*match_count = tree_count;
+	}
+	free(cursor_source);
+	free(source);
+	return result;
+}
+
+/* Appends a random path of up to MAX_SEGMENTS segments to PATH, mostly of
+ * the keys and indices most common in generated documents, and otherwise of
+ * others and some that are in none. */
+static void random_path(text_t* path) {
+	static const char* const common[] = { "*", "k0", "0", "k1", "1" };
+	static const char* const segments[] = {
+		"k2", "k3", "k4", "k5", "k6", "k12", "key", "a", "",
+		"x\\ny", "tab\\there", "\\u00e9t\\u00e9", "caf\xc3\xa9",
+		"2", "3", "00", "01", "-1", "1e0", "4294967295",
+		"**", "~0", "~1", "k~10"
+	};
+	unsigned int count;
+	unsigned int i;
+	path->length = 0;
+	append(path, "");
+	count = next_random(MAX_SEGMENTS + 1);
+	for (i = 0; i < count; ++i) {
+		append(path, "/");
+		append(path, next_random(3)
+				? common[next_random(sizeof common / sizeof common[0])]
+				: segments[next_random(sizeof segments / sizeof segments[0])]);
+	}
+}
+
+/* Escapes, empty keys, leading zeros, the first of equal keys, and an early
+ * stop that never reaches what is malformed further on. */
+static void check_pointers(void) {
+	static const char* const text =
+		"{\"a/b\":{\"c~d\":1},\"~1\":2,\"\":{\"\":3},\"01\":4,\"1\":5,"
+		"\"x\":[10,[20,30]],\"1\":6}";
+	static const char* const pointers[] = {
+		"/a~1b/c~0d", "/~01", "//", "/01", "/1", "/x/1/0", "/x/01", "/x/1/*",
+		"", "/a~1b/c~0d", "/a/b", "/x/2"
+	};
+	static const unsigned int paths[] = { 0, 1, 2, 3, 4, 5, 7, 7 };
+	static const char* const expected[] = {
+		"1", "2", "3", "4", "5", "20", "20", "30"
+	};
+	static const char* const malformed_paths[] = { "a", "/~", "/~2" };
+	static const char* const first[] = { "/a" };
+	static const char* const all[] = { "/*" };
+	static const char* const found[] = { "/a", "/b/0", "/a" };
+	jsish_path_node_t nodes[8];
+	jsish_path_t query;
+	jsish_decoder_t decoder;
+	jsish_cursor_t cursor;
+	char* source;
+	char* encoded;
+	unsigned int count;
+	unsigned int i;
+	/* The repeat of /a~1b/c~0d is reported under the first, and /1 finds
+	 * the first of the two members. */
+	CHECK(check_paths(text, 0, pointers, 12, MAX_MATCHES, &count)
+			== JSISH_OK);
+	CHECK(count == 9);
+	for (i = 0; i < 8; ++i) {
+		CHECK(tree_matches[i].path == paths[i]);
+		encoded = encode(tree_matches[i].value);
+		CHECK(strcmp(encoded, expected[i]) == 0);
+		free(encoded);
+	}
+	CHECK(tree_matches[8].path == 8);
+	CHECK(check_paths(text, JSISH_INDEX_KEYS, pointers, 12, MAX_MATCHES, NULL)
+			== JSISH_OK);
+	CHECK(check_paths(text, 0, pointers, 12, 8, NULL)
+			== JSISH_ERR_MEM_OVERFLOW);
+
+	for (i = 0; i < 3; ++i) {
+		CHECK(jsish_path_compile(&query, &malformed_paths[i], 1, nodes, 8)
+				== JSISH_ERR_MALFORMED);
+	}
+	CHECK(jsish_path_compile(&query, pointers, 3, nodes, 4)
+			== JSISH_ERR_MEM_OVERFLOW);
+
+	/* Once /a and /b/0 are found, the rest is not looked at. */
+	CHECK(jsish_path_compile(&query, found, 3, nodes, 8) == JSISH_OK);
+	CHECK(query.targets == 2);
+	source = copy("{\"a\":1,\"b\":[2,3],\"c\":[1,,2]}");
+	CHECK(jsish_cursor_init(&cursor, source) == JSISH_OK);
+	jsish_init_decoder(&decoder, cursor_values, VALUES_SIZE);
+	CHECK(jsish_path_match_cursor(&query, &cursor, &decoder,
+				cursor_matches, MAX_MATCHES, &count) == JSISH_OK);
+	CHECK(count == 2);
+	CHECK(cursor_matches[0].path == 0 && cursor_matches[1].path == 1);
+	free(source);
+	source = copy("{\"a\":1,\"c\":[1,,2]}");
+	CHECK(jsish_path_compile(&query, first, 1, nodes, 8) == JSISH_OK);
+	CHECK(jsish_cursor_init(&cursor, source) == JSISH_OK);
+	CHECK(jsish_path_match_cursor(&query, &cursor, &decoder,
+				cursor_matches, MAX_MATCHES, &count) == JSISH_OK);
+	CHECK(count == 1);
+	free(source);
+	/* Not with a wildcard, which has to look at every member. */
+	source = copy("{\"a\":1,\"c\":[1,,2]}");
+	CHECK(jsish_path_compile(&query, all, 1, nodes, 8) == JSISH_OK);
+	CHECK(jsish_cursor_init(&cursor, source) == JSISH_OK);
+	CHECK(jsish_path_match_cursor(&query, &cursor, &decoder,
+				cursor_matches, MAX_MATCHES, &count) == JSISH_ERR_MALFORMED);
+	free(source);
+}
+
+int main(void) {
+	static const unsigned int flags[] = {
+		0, JSISH_INDEX_KEYS, JSISH_INTEGERS, JSISH_INDEX_KEYS | JSISH_INTEGERS
+	};
+	static text_t paths[MAX_PATHS];
+	const char* pointers[MAX_PATHS];
+	text_t text;
+	unsigned int count;
+	unsigned int matched;
+	unsigned int i;
+	unsigned int j;
+	check_pointers();
+
+	text.data = NULL;
+	text.size = 0;
+	for (i = 0; i < DOCUMENTS; ++i) {
+		generate(&text, 3, 6);
+		count = 1 + next_random(MAX_PATHS);
+		for (j = 0; j < count; ++j) {
+			if (j && !next_random(4)) {
+				/* Reported only under the first. */
+				paths[j].length = 0;
+				append(&paths[j], paths[next_random(j)].data);
+			} else {
+				random_path(&paths[j]);
+			}
+			pointers[j] = paths[j].data;
+		}
+		if (check_paths(text.data, flags[i % 4], pointers, count,
+					MAX_MATCHES, &matched) == JSISH_OK && matched > 1) {
+			CHECK(check_paths(text.data, flags[i % 4], pointers, count,
+						matched - 1, NULL) == JSISH_ERR_MEM_OVERFLOW);
+		}
+	}
+	for (j = 0; j < MAX_PATHS; ++j) {
+		free(paths[j].data);
+	}
+	free(text.data);
+	return 0;
+}
@@ -0,0 +1,125 @@
+/* Checks that a snapshot opened somewhere else than it was written holds the
+ * same tree as the one it was written from, which it no longer depends on:
+ * the same values, encoding and key lookups, indexed objects included. */
+#define JSISH_MAIN
+#include <jsish.h>
+
+#include "check.h"
+
+#define DOCUMENTS 3000
+#define VALUES_SIZE 65536
+
+static jsish_value_t values[VALUES_SIZE];
+static jsish_value_t written[VALUES_SIZE * 2];
+static jsish_value_t moved[VALUES_SIZE * 2 + 1];
+
+/* Index of the member of OBJECT whose value is VALUE. */
+static unsigned int member(const jsish_value_t* object, const jsish_value_t* value) {
+	unsigned int i;
+	for (i = 0; i < JSISH_OBJECT_SIZE(object); ++i) {
+		if (JSISH_KV_VALUE(JSISH_KV_INDEX(object, i)) == value) {
+			return i;
+		}
+	}
+	CHECK(0);
+	return 0;
+}
+
+static void compare(const jsish_value_t* a, const jsish_value_t* b) {
+	const char* key;
+	unsigned int i;
+	CHECK(a->type == b->type);
+	switch (a->type) {
+		case JSISH_NUMBER:
+			CHECK(memcmp(&a->data.vnum, &b->data.vnum, sizeof a->data.vnum) == 0);
+			break;
+		case JSISH_INTEGER:
+			CHECK(JSISH_GET_INTEGER(a) == JSISH_GET_INTEGER(b));
+			break;
+		case JSISH_BOOL:
+			CHECK(JSISH_GET_BOOL(a) == JSISH_GET_BOOL(b));
+			break;
+		case JSISH_STRING: case JSISH_RAW_STRING:
+			CHECK(JSISH_GET_STRING(a) != JSISH_GET_STRING(b));
+			CHECK(strcmp(JSISH_GET_STRING(a), JSISH_GET_STRING(b)) == 0);
+			break;
+		case JSISH_ARRAY:
+			CHECK(JSISH_ARRAY_SIZE(a) == JSISH_ARRAY_SIZE(b));
+			for (i = 0; i < JSISH_ARRAY_SIZE(a); ++i) {
+				compare(JSISH_ARRAY_INDEX(a, i), JSISH_ARRAY_INDEX(b, i));
+			}
+			break;
+		case JSISH_KEYVAL:
+			CHECK(JSISH_OBJECT_SIZE(a) == JSISH_OBJECT_SIZE(b));
+			CHECK(!_JSISH_INDEX(a) == !_JSISH_INDEX(b));
+			for (i = 0; i < JSISH_OBJECT_SIZE(a); ++i) {
+				key = JSISH_KV_KEY(JSISH_KV_INDEX(a, i));
+				CHECK(strcmp(key, JSISH_KV_KEY(JSISH_KV_INDEX(b, i))) == 0);
+				compare(JSISH_KV_VALUE(JSISH_KV_INDEX(a, i)),
+						JSISH_KV_VALUE(JSISH_KV_INDEX(b, i)));
+				/* Lookups find the same member, duplicate keys included. */
+				CHECK(member(a, jsish_get_property(a, key))
+						== member(b, jsish_get_property(b, key)));
+			}
+			if (JSISH_OBJECT_SIZE(a)) {
+				CHECK(jsish_get_property(a, "missing") == NULL);
+				CHECK(jsish_get_property(b, "missing") == NULL);
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+int main(void) {
+	static const unsigned int flags[] = {
+		JSISH_INDEX_KEYS, 0, JSISH_INDEX_KEYS | JSISH_COPY_STRINGS,
+		JSISH_SORT_KEYS | JSISH_INTEGERS | JSISH_UNESCAPE
+	};
+	jsish_decoder_t decoder;
+	jsish_value_t* root;
+	jsish_value_t* again;
+	text_t text;
+	char* source;
+	char* reference;
+	char* encoded;
+	unsigned int size;
+	unsigned int i;
+	text.data = NULL;
+	text.size = 0;
+	for (i = 0; i < DOCUMENTS; ++i) {
+		generate(&text, 5, 12);
+		source = copy(text.data);
+		jsish_init_decoder(&decoder, values, VALUES_SIZE);
+		decoder.flags = flags[i % 4];
+		CHECK(jsish_decode(&decoder, source) == JSISH_OK);
+		reference = encode(&decoder.root);
+
+		CHECK(jsish_snapshot_write(
+					&decoder.root, written, sizeof written, &size) == JSISH_OK);
+		memcpy(&moved[1], written, size);
+		CHECK(jsish_snapshot_open(&moved[1], size, &root) == JSISH_OK);
+		compare(&decoder.root, root);
+
+		/* Nothing of the decoded tree is needed. */
+		memset(values, 0, sizeof values);
+		memset(source, 0, text.length);
+		encoded = encode(root);
+		CHECK(strcmp(encoded, reference) == 0);
+		free(encoded);
+
+		/* Opened again where it was, and then somewhere else again. */
+		CHECK(jsish_snapshot_open(&moved[1], size, &again) == JSISH_OK);
+		CHECK(again == root);
+		memcpy(written, &moved[1], size);
+		CHECK(jsish_snapshot_open(written, size, &again) == JSISH_OK);
+		compare(root, again);
+		encoded = encode(again);
+		CHECK(strcmp(encoded, reference) == 0);
+		free(encoded);
+		free(reference);
+		free(source);
+	}
+	free(text.data);
+	return 0;
+}
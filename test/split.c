@@ -0,0 +1,123 @@
+/* Checks split decoding of large arrays against decoding them whole with
+ * jsish_decode(), with up to JSISH_MAX_WORKERS parts decoded in any order,
+ * runs of short elements at the edges of parts, malformed elements among
+ * well-formed ones, and too few values. With JSISH_THREADS the parts are
+ * decoded by jsish_split_decode_parallel(). */
+#define JSISH_MAIN
+#include <jsish.h>
+
+#include "check.h"
+
+#define ARRAYS 400
+#define MAX_ELEMENTS 200
+#define VALUES_SIZE 262144
+
+static jsish_value_t values[VALUES_SIZE];
+static jsish_value_t reference_values[VALUES_SIZE];
+
+/* Appends a random element to ARRAY, short ones often enough that several of
+ * them can start within reach of where a part does. */
+static void append_element(text_t* array, int malformed) {
+	static const char* const short_elements[] = {
+		"0", "1", "-1", "true", "null", "\"\"", "[]", "{}", "[1]", "\"a\""
+	};
+	static text_t element;
+	if (!malformed && next_random(3) == 0) {
+		append(array, short_elements[next_random(10)]);
+		return;
+	}
+	do {
+		generate(&element, 3, 6);
+		if (malformed) {
+			damage(&element);
+		}
+	} while (strspn(element.data, " \t\r\n") == element.length);
+	append(array, element.data);
+}
+
+int main(void) {
+	static const char* const separators[] = { ",", ", ", " ,\n", "\t,\t" };
+	static const unsigned int flags[] = {
+		0, JSISH_INDEX_KEYS, JSISH_INTEGERS, JSISH_INDEX_KEYS | JSISH_INTEGERS
+	};
+	jsish_split_t split;
+	jsish_decoder_t decoder;
+	jsish_result_t expected;
+	text_t array;
+	char* source;
+	char* reference;
+	char* expected_text;
+	char* actual_text;
+	unsigned int count;
+	unsigned int workers;
+	unsigned int i;
+	unsigned int j;
+	array.data = NULL;
+	array.size = 0;
+	for (i = 0; i < ARRAYS; ++i) {
+		array.length = 0;
+		append(&array, next_random(2) ? "[" : " [\n");
+		count = next_random(4) ? next_random(MAX_ELEMENTS) : next_random(4);
+		for (j = 0; j < count; ++j) {
+			if (j) {
+				append(&array, separators[next_random(4)]);
+			}
+			append_element(&array, i % 5 == 0 && j == count / 2);
+		}
+		append(&array, next_random(2) ? "]" : "\n]\n");
+		if (i % 7 == 3) {
+			damage(&array);
+		}
+
+		source = copy(array.data);
+		reference = copy(array.data);
+		workers = 1 + next_random(i % 4 ? 8 : JSISH_MAX_WORKERS);
+		jsish_init_decoder(&decoder, reference_values, VALUES_SIZE);
+		decoder.flags = flags[i % 4];
+		expected = jsish_decode(&decoder, reference);
+
+		if (jsish_split_init(&split, source, values, VALUES_SIZE, workers)
+				!= JSISH_OK) {
+			/* Only ever for what is not a well-formed array. */
+			CHECK(expected != JSISH_OK || decoder.root.type != JSISH_ARRAY);
+			free(reference);
+			free(source);
+			continue;
+		}
+		CHECK(JSISH_ARRAY_SIZE(&split.root) <= MAX_ELEMENTS);
+
+		/* Values for the elements and a root and frame for each part, and
+		 * not one less. */
+		count = JSISH_ARRAY_SIZE(&split.root);
+		CHECK(jsish_split_init(&split, source, values,
+					count + workers * 2 - 1, workers)
+				== JSISH_ERR_MEM_OVERFLOW);
+		CHECK(jsish_split_init(&split, source, values, VALUES_SIZE, workers)
+				== JSISH_OK);
+
+		split.flags = flags[i % 4];
+#ifdef JSISH_THREADS
+		CHECK(jsish_split_decode_parallel(&split) == expected);
+#else
+		/* The parts in any order, as threads would finish them. */
+		for (j = workers; j > 0; --j) {
+			jsish_split_decode(&split, (j + i) % workers);
+		}
+		CHECK(jsish_split_finish(&split) == expected);
+#endif
+		if (expected == JSISH_OK) {
+			CHECK(decoder.root.type == JSISH_ARRAY);
+			CHECK(JSISH_ARRAY_SIZE(&split.root)
+					== JSISH_ARRAY_SIZE(&decoder.root));
+			expected_text = encode(&decoder.root);
+			actual_text = encode(&split.root);
+			CHECK(strcmp(expected_text, actual_text) == 0);
+			free(expected_text);
+			free(actual_text);
+		}
+		free(reference);
+		free(source);
+	}
+	free(array.data);
+	return 0;
+}
@@ -0,0 +1,393 @@
+/* Checks the statistics kept with JSISH_STATS and the phase hooks they are
+ * handed to: every JSISH_BEGIN_PHASE must be matched by a JSISH_END_PHASE of
+ * the same phase, indexing only within decoding, and the counts must come out
+ * as worked out by hand for small documents, and as counted over the decoded
+ * tree for generated ones, whichever way they are decoded or encoded. */
+#define JSISH_BEGIN_PHASE(PHASE) begin_phase(PHASE)
+#define JSISH_END_PHASE(PHASE, RESULT, STATS) end_phase(PHASE, RESULT, STATS)
+
+struct jsish_stats;
+static void begin_phase(int phase);
+static void end_phase(int phase, int result, const struct jsish_stats* stats);
+
+#define JSISH_MAIN
+#include <jsish.h>
+
+#include "check.h"
+
+#define DOCUMENTS 3000
+#define VALUES_SIZE 65536
+#define BUFFER_SIZE 65536
+#define MAX_STRUCTURALS 200
+#define MAX_OPEN 4
+#define PHASES (JSISH_PHASE_ENCODE + 1)
+
+static jsish_value_t values[VALUES_SIZE];
+static unsigned int structurals[MAX_STRUCTURALS];
+static char buffer[BUFFER_SIZE];
+
+/* The phases begun and not yet ended, innermost last, and what the last of
+ * each ended with. */
+static int open_phases[MAX_OPEN];
+static unsigned int open_count;
+static unsigned int begun[PHASES];
+static unsigned int ended[PHASES];
+static jsish_result_t last_result[PHASES];
+static jsish_stats_t last_stats[PHASES];
+
+static void begin_phase(int phase) {
+	CHECK(phase >= 0 && phase < PHASES);
+	CHECK(open_count < MAX_OPEN);
+	if (phase == JSISH_PHASE_INDEX) {
+		CHECK(open_count > 0);
+		CHECK(open_phases[open_count - 1] == JSISH_PHASE_DECODE);
+	} else {
+		CHECK(open_count == 0);
+	}
+	open_phases[open_count++] = phase;
+	begun[phase]++;
+}
+
+static void end_phase(int phase, int result, const struct jsish_stats* stats) {
+	CHECK(open_count > 0 && open_phases[open_count - 1] == phase);
+	CHECK(stats != NULL);
+	open_count--;
+	ended[phase]++;
+	last_result[phase] = (jsish_result_t) result;
+	last_stats[phase] = *stats;
+}
+
+/* Checks that each phase begun since the counts were last taken has ended,
+ * and that PHASE ended CALLS times, and takes the counts again. */
+static void check_phases(int phase, unsigned int calls) {
+	static unsigned int counted[PHASES];
+	int i;
+	CHECK(open_count == 0);
+	CHECK(ended[phase] - counted[phase] == calls);
+	for (i = 0; i < PHASES; ++i) {
+		CHECK(begun[i] == ended[i]);
+		counted[i] = ended[i];
+	}
+}
+
+/* The counts compared, leaving out peak_stack, which depends on how the tree
+ * is built. */
+static int same_stats(const jsish_stats_t* a, const jsish_stats_t* b) {
+	int i;
+	for (i = 0; i <= JSISH_RAW_STRING; ++i) {
+		if (a->values[i] != b->values[i]) {
+			return 0;
+		}
+	}
+	return a->max_depth == b->max_depth
+		&& a->longest_string == b->longest_string
+		&& a->bytes == b->bytes
+		&& a->escapes == b->escapes;
+}
+
+/* Counts the escapes written in S, as they are kept in raw strings. */
+static unsigned int count_escapes(const char* s) {
+	unsigned int count;
+	count = 0;
+	for (; *s; ++s) {
+		if (*s == '\\') {
+			count++;
+			++s;
+		}
+	}
+	return count;
+}
+
+static void tally_string(const char* s, jsish_stats_t* stats) {
+	if (strlen(s) > stats->longest_string) {
+		stats->longest_string = (unsigned int) strlen(s);
+	}
+	stats->escapes += count_escapes(s);
+}
+
+/* Counts what the encoder comes across in the tree at VALUE, nested DEPTH
+ * levels, for trees decoded without JSISH_UNESCAPE. */
+static void tally(
+		const jsish_value_t* value,
+		unsigned int depth,
+		jsish_stats_t* stats) {
+	const jsish_value_t* pair;
+	unsigned int i;
+	stats->values[value->type]++;
+	if (value->type == JSISH_ARRAY || value->type == JSISH_KEYVAL) {
+		if (depth + 1 > stats->max_depth) {
+			stats->max_depth = depth + 1;
+		}
+	}
+	if (JSISH_IS_STRING(value)) {
+		tally_string(JSISH_GET_STRING(value), stats);
+	} else if (value->type == JSISH_ARRAY) {
+		for (i = 0; i < JSISH_ARRAY_SIZE(value); ++i) {
+			tally(JSISH_ARRAY_INDEX(value, i), depth + 1, stats);
+		}
+	} else if (value->type == JSISH_KEYVAL) {
+		for (i = 0; i < JSISH_OBJECT_SIZE(value); ++i) {
+			pair = JSISH_KV_INDEX(value, i);
+			stats->values[JSISH_PAIR]++;
+			tally_string(JSISH_KV_KEY(pair), stats);
+			tally(JSISH_KV_VALUE(pair), depth + 1, stats);
+		}
+	}
+}
+
+typedef enum { PLAIN, FEED, INDEXED } method_t;
+
+/* Decodes TEXT with METHOD into DECODER and returns the result, checking that
+ * the decode phase ended with it. */
+static jsish_result_t decode(
+		jsish_decoder_t* decoder,
+		const char* text,
+		method_t method,
+		unsigned int flags,
+		char** source) {
+	jsish_result_t result;
+	unsigned int length;
+	unsigned int offset;
+	unsigned int chunk;
+	unsigned int calls;
+	length = (unsigned int) strlen(text);
+	*source = copy(text);
+	jsish_init_decoder(decoder, values, VALUES_SIZE);
+	decoder->flags = flags;
+	calls = 1;
+	switch (method) {
+		case PLAIN:
+			result = jsish_decode(decoder, *source);
+			break;
+		case FEED:
+			jsish_decode_begin(decoder, *source, length + 1);
+			result = JSISH_INCOMPLETE;
+			calls = 0;
+			for (offset = 0; offset < length; offset += chunk) {
+				chunk = 1 + next_random(16);
+				if (chunk > length - offset) {
+					chunk = length - offset;
+				}
+				calls++;
+				result = jsish_decode_feed(decoder, &text[offset], chunk);
+				if (result != JSISH_INCOMPLETE) {
+					break;
+				}
+			}
+			if (result == JSISH_INCOMPLETE) {
+				calls++;
+				result = jsish_decode_finish(decoder);
+			}
+			break;
+		default:
+			result = jsish_decode_indexed(
+					decoder, *source, structurals, MAX_STRUCTURALS);
+			break;
+	}
+	check_phases(JSISH_PHASE_DECODE, calls);
+	CHECK(last_result[JSISH_PHASE_DECODE] == result);
+	CHECK(same_stats(&decoder->stats, &last_stats[JSISH_PHASE_DECODE]));
+	return result;
+}
+
+static int failing_write(void* user, const char* data, unsigned int length) {
+	(void) user;
+	(void) data;
+	(void) length;
+	return 1;
+}
+
+static int collect(void* user, const char* data, unsigned int length) {
+	text_t* text;
+	text = (text_t*) user;
+	CHECK(text->length + length < text->size);
+	memcpy(&text->data[text->length], data, length);
+	text->length += length;
+	text->data[text->length] = '\0';
+	return 0;
+}
+
+/* Encodes VALUE both ways and checks that they give and come across the same.
+ * Returns the encoder's statistics. */
+static jsish_stats_t check_encode(const jsish_value_t* value) {
+	static char collected[BUFFER_SIZE];
+	jsish_stats_t stats;
+	text_t text;
+	char scratch[16];
+	unsigned int bytes;
+	CHECK(jsish_encode(value, buffer, BUFFER_SIZE, &bytes) == JSISH_OK);
+	check_phases(JSISH_PHASE_ENCODE, 1);
+	CHECK(last_result[JSISH_PHASE_ENCODE] == JSISH_OK);
+	stats = last_stats[JSISH_PHASE_ENCODE];
+	CHECK(stats.bytes == bytes - 1 && stats.bytes == strlen(buffer));
+	CHECK(stats.peak_stack == 0);
+
+	text.data = collected;
+	text.length = 0;
+	text.size = BUFFER_SIZE;
+	CHECK(jsish_encode_to(value, collect, &text, scratch,
+				1 + next_random(sizeof scratch)) == JSISH_OK);
+	check_phases(JSISH_PHASE_ENCODE, 1);
+	CHECK(strcmp(collected, buffer) == 0);
+	CHECK(same_stats(&last_stats[JSISH_PHASE_ENCODE], &stats));
+
+	/* A failing write ends the phase too. */
+	CHECK(jsish_encode_to(value, failing_write, NULL, scratch, sizeof scratch)
+			== JSISH_ERR_WRITE);
+	check_phases(JSISH_PHASE_ENCODE, 1);
+	CHECK(last_result[JSISH_PHASE_ENCODE] == JSISH_ERR_WRITE);
+	return stats;
+}
+
+/* A document with what decoding and then encoding it come across, with the
+ * values in jsish_type_t order. */
+typedef struct {
+	const char* text;
+	unsigned int flags;
+	jsish_result_t result;
+	unsigned int values[JSISH_RAW_STRING + 1];
+	unsigned int max_depth;
+	unsigned int longest_string;
+	unsigned int bytes;
+	unsigned int escapes;
+	/* Those that differ when encoding, with JSISH_UNESCAPE. */
+	unsigned int encoded_longest_string;
+	unsigned int encoded_escapes;
+} example_t;
+
+static const example_t examples[] = {
+	{ "[1,2.5,true,null,\"ab\"]", 0, JSISH_OK,
+		{ 1, 2, 1, 1, 1, 0, 0, 0, 0 }, 1, 2, 22, 0, 2, 0 },
+	{ "[1,2.5,true,null,\"ab\"]", JSISH_INTEGERS, JSISH_OK,
+		{ 1, 1, 1, 1, 1, 0, 0, 1, 0 }, 1, 2, 22, 0, 2, 0 },
+	{ "{\"key\":{\"a\":[[]],\"b\":\"x\\ny\\u00e9\"}}", 0, JSISH_OK,
+		{ 0, 0, 0, 0, 2, 2, 3, 0, 1 }, 4, 10, 35, 2, 10, 2 },
+	{ "{\"key\":{\"a\":[[]],\"b\":\"x\\ny\\u00e9\"}}", JSISH_UNESCAPE,
+		JSISH_OK, { 0, 0, 0, 1, 2, 2, 3, 0, 0 }, 4, 10, 35, 2, 5, 1 },
+	{ "{\"t\\tb\":\"\\\"\\\\\",\"t\\tb\":-0}", JSISH_INDEX_KEYS, JSISH_OK,
+		{ 0, 1, 0, 0, 0, 1, 2, 0, 1 }, 1, 4, 25, 4, 4, 4 },
+	{ "  \"just a string\"  ", 0, JSISH_OK,
+		{ 0, 0, 0, 1, 0, 0, 0, 0, 0 }, 0, 13, 17, 0, 13, 0 },
+	{ "7", JSISH_INTEGERS, JSISH_OK,
+		{ 0, 0, 0, 0, 0, 0, 0, 1, 0 }, 0, 0, 1, 0, 0, 0 },
+	{ "[[1,\"a\\nb\"],[2,x]]", 0, JSISH_ERR_MALFORMED,
+		{ 0, 2, 0, 0, 3, 0, 0, 0, 1 }, 2, 4, 15, 1, 0, 0 }
+};
+
+/* Checks what decoding came across against EXAMPLE. */
+static void check_decoded(
+		const jsish_stats_t* stats,
+		const example_t* example) {
+	unsigned int i;
+	for (i = 0; i <= JSISH_RAW_STRING; ++i) {
+		CHECK(stats->values[i] == example->values[i]);
+	}
+	CHECK(stats->max_depth == example->max_depth);
+	CHECK(stats->longest_string == example->longest_string);
+	CHECK(stats->bytes == example->bytes);
+	CHECK(stats->escapes == example->escapes);
+}
+
+/* Checks each example decoded every way, parsed, and encoded again. */
+static void check_examples(void) {
+	static const method_t methods[] = { PLAIN, FEED, INDEXED };
+	static const jsish_events_t events = {
+		NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL
+	};
+	const example_t* example;
+	jsish_decoder_t decoder;
+	jsish_stats_t stats;
+	char* source;
+	unsigned int i;
+	unsigned int j;
+	unsigned int k;
+	for (i = 0; i < sizeof examples / sizeof examples[0]; ++i) {
+		example = &examples[i];
+		for (j = 0; j < 3; ++j) {
+			CHECK(decode(&decoder, example->text, methods[j], example->flags,
+						&source) == example->result);
+			check_decoded(&decoder.stats, example);
+			if (example->result == JSISH_OK) {
+				stats = check_encode(&decoder.root);
+				for (k = 0; k <= JSISH_RAW_STRING; ++k) {
+					CHECK(stats.values[k] == example->values[k]);
+				}
+				CHECK(stats.max_depth == example->max_depth);
+				CHECK(stats.longest_string
+						== example->encoded_longest_string);
+				CHECK(stats.escapes == example->encoded_escapes);
+			}
+			free(source);
+		}
+
+		/* Parsing only has the hooks to hand them to. */
+		source = copy(example->text);
+		CHECK(jsish_parse(source, example->flags, &events, NULL)
+				== example->result);
+		check_phases(JSISH_PHASE_DECODE, 1);
+		CHECK(last_result[JSISH_PHASE_DECODE] == example->result);
+		check_decoded(&last_stats[JSISH_PHASE_DECODE], example);
+		free(source);
+	}
+}
+
+int main(void) {
+	static const unsigned int flags[] = {
+		0, JSISH_INDEX_KEYS, JSISH_INTEGERS,
+		JSISH_INDEX_KEYS | JSISH_INTEGERS | JSISH_COPY_STRINGS
+	};
+	static const method_t methods[] = { PLAIN, FEED, INDEXED };
+	jsish_decoder_t decoder;
+	jsish_decoder_t other;
+	jsish_stats_t expected;
+	jsish_stats_t stats;
+	jsish_result_t result;
+	text_t text;
+	char* source;
+	char* other_source;
+	unsigned int i;
+	unsigned int j;
+	check_examples();
+
+	text.data = NULL;
+	text.size = 0;
+	for (i = 0; i < DOCUMENTS; ++i) {
+		generate(&text, 4, 8);
+		if (i % 4 == 3) {
+			damage(&text);
+		}
+		result = decode(&decoder, text.data, PLAIN, flags[i % 4], &source);
+		if (result == JSISH_OK) {
+			/* Decoding stops at the end of the root, before any whitespace,
+			 * or before whatever damage has left after it. */
+			memset(&expected, 0, sizeof expected);
+			tally(&decoder.root, 0, &expected);
+			for (expected.bytes = text.length;
+					strchr(" \t\r\n", text.data[expected.bytes - 1]);
+					--expected.bytes);
+			if (i % 4 == 3) {
+				CHECK(decoder.stats.bytes <= expected.bytes);
+				expected.bytes = decoder.stats.bytes;
+			}
+			CHECK(same_stats(&decoder.stats, &expected));
+			stats = check_encode(&decoder.root);
+			expected.bytes = stats.bytes;
+			CHECK(same_stats(&stats, &expected));
+		}
+		/* Every way of decoding comes across the same, except for how far
+		 * into a malformed token each gets. */
+		for (j = 1; j < 3; ++j) {
+			CHECK(decode(&other, text.data, methods[j], flags[i % 4],
+						&other_source) == result);
+			if (result != JSISH_OK) {
+				CHECK(other.stats.bytes <= text.length);
+				other.stats.bytes = decoder.stats.bytes;
+			}
+			CHECK(same_stats(&other.stats, &decoder.stats));
+			free(other_source);
+		}
+		free(source);
+	}
+	free(text.data);
+	return 0;
+}
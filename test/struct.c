@@ -0,0 +1,381 @@
+/* Checks jsish_struct_decode() against jsish_decode() and picking the fields
+ * out of the tree by hand, on generated documents with members of the wrong
+ * type, arrays longer than their fields, duplicate keys and members in any
+ * order: the results must be the same, and so must the structs, errors
+ * included. Those decoded in full are written with jsish_struct_encode(),
+ * which must decode to the same struct again. */
+#define JSISH_MAIN
+#include <jsish.h>
+
+#include "check.h"
+
+#define DOCUMENTS 4000
+#define VALUES_SIZE 65536
+
+/* Fields of every struct, named like the keys that generate() writes. */
+#define SCALARS \
+	int b; \
+	int i; \
+	jsish_int_t n; \
+	double d; \
+	char* s; \
+	int ints[3]; \
+	unsigned int ints_count; \
+	char* strings[2]; \
+	unsigned int strings_count; \
+	double numbers[1]; \
+	unsigned int numbers_count;
+
+#define SCALAR_FIELDS(STRUCT) \
+	JSISH_FIELD("k1", JSISH_FIELD_BOOL, STRUCT, b), \
+	JSISH_FIELD("k2", JSISH_FIELD_INT, STRUCT, i), \
+	JSISH_FIELD("k3", JSISH_FIELD_INTEGER, STRUCT, n), \
+	JSISH_FIELD("k4", JSISH_FIELD_NUMBER, STRUCT, d), \
+	JSISH_FIELD("k5", JSISH_FIELD_STRING, STRUCT, s), \
+	JSISH_ARRAY_FIELD("k7", STRUCT, ints, ints_count, int_element), \
+	JSISH_ARRAY_FIELD("k8", STRUCT, strings, strings_count, string_element), \
+	JSISH_ARRAY_FIELD("k9", STRUCT, numbers, numbers_count, number_element)
+
+typedef struct {
+	SCALARS
+} leaf_t;
+
+typedef struct {
+	SCALARS
+	leaf_t object;
+	leaf_t list[2];
+	unsigned int list_count;
+} node_t;
+
+typedef struct {
+	SCALARS
+	double accent;
+	node_t object;
+	node_t list[3];
+	unsigned int list_count;
+} record_t;
+
+static jsish_field_t int_element = JSISH_ELEMENT(JSISH_FIELD_INT);
+static jsish_field_t string_element = JSISH_ELEMENT(JSISH_FIELD_STRING);
+static jsish_field_t number_element = JSISH_ELEMENT(JSISH_FIELD_NUMBER);
+
+static jsish_field_t leaf_fields[] = { SCALAR_FIELDS(leaf_t) };
+static jsish_field_t leaf_element = JSISH_OBJECT_ELEMENT(leaf_fields);
+
+static jsish_field_t node_fields[] = {
+	SCALAR_FIELDS(node_t),
+	JSISH_OBJECT_FIELD("k6", node_t, object, leaf_fields),
+	JSISH_ARRAY_FIELD("k0", node_t, list, list_count, leaf_element)
+};
+static jsish_field_t node_element = JSISH_OBJECT_ELEMENT(node_fields);
+
+/* The array first, as in the documents, and the rest in another order. */
+static jsish_field_t record_fields[] = {
+	JSISH_ARRAY_FIELD("k0", record_t, list, list_count, node_element),
+	JSISH_OBJECT_FIELD("k6", record_t, object, node_fields),
+	JSISH_FIELD("\xc3\xa9t\xc3\xa9", JSISH_FIELD_NUMBER, record_t, accent),
+	SCALAR_FIELDS(record_t)
+};
+
+#define RECORD_FIELDS (sizeof record_fields / sizeof record_fields[0])
+
+static jsish_value_t values[VALUES_SIZE];
+
+static jsish_result_t extract_integer(
+		const jsish_field_t* field, char* address, jsish_int_t value) {
+	switch (field->type) {
+		case JSISH_FIELD_INT:
+			if (value < -2147483647 - 1 || value > 2147483647) {
+				return JSISH_ERR_TYPE;
+			}
+			*(int*) address = (int) value;
+			return JSISH_OK;
+		case JSISH_FIELD_INTEGER:
+			*(jsish_int_t*) address = value;
+			return JSISH_OK;
+		case JSISH_FIELD_NUMBER:
+			*(double*) address = (double) value;
+			return JSISH_OK;
+		default:
+			return JSISH_ERR_TYPE;
+	}
+}
+
+/* Stores VALUE in the field at ADDRESS the way jsish_struct_decode() is
+ * documented to, stopping at the first value that does not fit. */
+static jsish_result_t extract(
+		const jsish_value_t* value, const jsish_field_t* field, char* address) {
+	const jsish_field_t* member;
+	const jsish_value_t* pair;
+	jsish_result_t result;
+	unsigned int size;
+	unsigned int i;
+	unsigned int j;
+	switch (value->type) {
+		case JSISH_NULL:
+			if (field->type == JSISH_FIELD_STRING) {
+				*(char**) address = NULL;
+			}
+			return JSISH_OK;
+		case JSISH_BOOL:
+			if (field->type != JSISH_FIELD_BOOL) {
+				return JSISH_ERR_TYPE;
+			}
+			*(int*) address = JSISH_GET_BOOL(value);
+			return JSISH_OK;
+		case JSISH_INTEGER:
+			return extract_integer(field, address, JSISH_GET_INTEGER(value));
+		case JSISH_NUMBER:
+			if (field->type == JSISH_FIELD_NUMBER) {
+				*(double*) address = JSISH_GET_NUMBER(value);
+				return JSISH_OK;
+			}
+			if (JSISH_GET_NUMBER(value) < -9223372036854775808.0
+					|| JSISH_GET_NUMBER(value) >= 9223372036854775808.0
+					|| (double) (jsish_int_t) JSISH_GET_NUMBER(value)
+						!= JSISH_GET_NUMBER(value)) {
+				return JSISH_ERR_TYPE;
+			}
+			return extract_integer(
+					field, address, (jsish_int_t) JSISH_GET_NUMBER(value));
+		case JSISH_STRING:
+			if (field->type != JSISH_FIELD_STRING) {
+				return JSISH_ERR_TYPE;
+			}
+			*(char**) address = (char*) JSISH_GET_STRING(value);
+			return JSISH_OK;
+		case JSISH_ARRAY:
+			if (field->type != JSISH_FIELD_ARRAY) {
+				return JSISH_ERR_TYPE;
+			}
+			size = JSISH_ARRAY_SIZE(value);
+			for (i = 0; i < size; ++i) {
+				if (i == field->capacity) {
+					return JSISH_ERR_MEM_OVERFLOW;
+				}
+				result = extract(JSISH_ARRAY_INDEX(value, i), field->fields,
+						address + i * field->stride + field->fields->offset);
+				if (result != JSISH_OK) {
+					return result;
+				}
+			}
+			*(unsigned int*) (address - field->offset + field->count_offset)
+				= size;
+			return JSISH_OK;
+		case JSISH_KEYVAL:
+			if (field->type != JSISH_FIELD_OBJECT) {
+				return JSISH_ERR_TYPE;
+			}
+			/* In the order of the source, so the last of equal keys wins. */
+			size = JSISH_OBJECT_SIZE(value);
+			for (i = 0; i < size; ++i) {
+				pair = JSISH_KV_INDEX(value, i);
+				member = NULL;
+				for (j = 0; j < field->fields_count && !member; ++j) {
+					if (!strcmp(field->fields[j].name, JSISH_KV_KEY(pair))) {
+						member = &field->fields[j];
+					}
+				}
+				if (!member) {
+					continue;
+				}
+				result = extract(JSISH_KV_VALUE(pair), member,
+						address + member->offset);
+				if (result != JSISH_OK) {
+					return result;
+				}
+			}
+			return JSISH_OK;
+		default:
+			/* JSISH_RAW_STRING, which cannot be unescaped. */
+			return JSISH_ERR_TYPE;
+	}
+}
+
+static char* encode_record(const record_t* record) {
+	unsigned int size;
+	char* output;
+	CHECK(jsish_struct_encode(record, record_fields, RECORD_FIELDS,
+				NULL, 0, &size) == JSISH_ERR_MEM_OVERFLOW);
+	output = (char*) malloc(size);
+	CHECK(output != NULL);
+	CHECK(jsish_struct_encode(record, record_fields, RECORD_FIELDS,
+				output, size, &size) == JSISH_OK);
+	return output;
+}
+
+/* Decodes SOURCE into a cleared RECORD, whose strings point into a copy of
+ * SOURCE that lasts until the next call. */
+static jsish_result_t decode_record(const char* source, record_t* record) {
+	static char* text = NULL;
+	free(text);
+	text = copy(source);
+	memset(record, 0, sizeof *record);
+	return jsish_struct_decode(text, 0, record_fields, RECORD_FIELDS, record);
+}
+
+/* Members of each type that does and does not fit. */
+static void check_fields(void) {
+	static record_t record;
+	CHECK(decode_record("{\"k4\":1,\"k3\":-9223372036854775808,"
+				"\"k2\":2147483647,\"k1\":true,\"k5\":\"a\\u00e9\"}", &record)
+			== JSISH_OK);
+	CHECK(record.b == 1);
+	CHECK(record.i == 2147483647);
+	CHECK((double) record.n == -9223372036854775808.0);
+	CHECK(record.d == 1.0);
+	CHECK(strcmp(record.s, "a\xc3\xa9") == 0);
+	CHECK(decode_record("{\"k2\":-2147483648,\"k3\":1e18,\"k4\":-0.5}",
+				&record) == JSISH_OK);
+	CHECK(record.i == -2147483647 - 1);
+	CHECK(record.n == (jsish_int_t) 1e18);
+	CHECK(record.d == -0.5);
+
+	CHECK(decode_record("{\"k2\":2147483648}", &record) == JSISH_ERR_TYPE);
+	CHECK(decode_record("{\"k2\":-2147483649}", &record) == JSISH_ERR_TYPE);
+	CHECK(decode_record("{\"k2\":1.5}", &record) == JSISH_ERR_TYPE);
+	CHECK(decode_record("{\"k3\":1e19}", &record) == JSISH_ERR_TYPE);
+	CHECK(decode_record("{\"k3\":12345678901234567890}", &record)
+			== JSISH_ERR_TYPE);
+	CHECK(decode_record("{\"k2\":\"1\"}", &record) == JSISH_ERR_TYPE);
+	CHECK(decode_record("{\"k1\":0}", &record) == JSISH_ERR_TYPE);
+	CHECK(decode_record("{\"k4\":false}", &record) == JSISH_ERR_TYPE);
+	CHECK(decode_record("{\"k5\":1}", &record) == JSISH_ERR_TYPE);
+	CHECK(decode_record("{\"k5\":\"a\\u0000\"}", &record) == JSISH_ERR_TYPE);
+	CHECK(decode_record("{\"k6\":[]}", &record) == JSISH_ERR_TYPE);
+	CHECK(decode_record("{\"k7\":{}}", &record) == JSISH_ERR_TYPE);
+	CHECK(decode_record("{\"k7\":[true]}", &record) == JSISH_ERR_TYPE);
+	CHECK(decode_record("[]", &record) == JSISH_ERR_TYPE);
+	CHECK(decode_record("null", &record) == JSISH_ERR_TYPE);
+	CHECK(decode_record("1", &record) == JSISH_ERR_TYPE);
+
+	/* Members that fit no field are skipped, whatever is in them. */
+	CHECK(decode_record("{\"k10\":{\"k2\":[1.5]},\"k2\\u0000\":\"x\","
+				"\"K2\":true,\"k2\":7}", &record) == JSISH_OK);
+	CHECK(record.i == 7);
+	CHECK(decode_record("{\"\\u00e9t\\u00e9\":2.5}", &record) == JSISH_OK);
+	CHECK(record.accent == 2.5);
+}
+
+/* Arrays up to and past their capacity, nulls, duplicate keys and nesting. */
+static void check_structure(void) {
+	static record_t record;
+	CHECK(decode_record("{\"k7\":[1,2,3]}", &record) == JSISH_OK);
+	CHECK(record.ints_count == 3);
+	CHECK(record.ints[0] == 1 && record.ints[1] == 2 && record.ints[2] == 3);
+	CHECK(decode_record("{\"k7\":[1,2,3,4]}", &record)
+			== JSISH_ERR_MEM_OVERFLOW);
+	CHECK(decode_record("{\"k7\":[1,2,3,null]}", &record)
+			== JSISH_ERR_MEM_OVERFLOW);
+	CHECK(decode_record("{\"k0\":[{},{},{},{}]}", &record)
+			== JSISH_ERR_MEM_OVERFLOW);
+	CHECK(decode_record("{\"k7\":[]}", &record) == JSISH_OK);
+	CHECK(record.ints_count == 0);
+
+	/* Null leaves other fields as they were, but clears strings. */
+	CHECK(decode_record("{\"k2\":5,\"k7\":[1,null,3],\"k2\":null,"
+				"\"k8\":[null,\"x\"],\"k5\":\"y\",\"k5\":null,\"k6\":null}",
+				&record) == JSISH_OK);
+	CHECK(record.i == 5);
+	CHECK(record.ints_count == 3);
+	CHECK(record.ints[1] == 0);
+	CHECK(record.strings_count == 2);
+	CHECK(record.strings[0] == NULL);
+	CHECK(strcmp(record.strings[1], "x") == 0);
+	CHECK(record.s == NULL);
+
+	/* The last of equal keys counts, arrays included. */
+	CHECK(decode_record("{\"k5\":\"x\",\"k2\":1,\"k5\":\"y\",\"k2\":2,"
+				"\"k7\":[1,2,3],\"k7\":[4]}", &record) == JSISH_OK);
+	CHECK(strcmp(record.s, "y") == 0);
+	CHECK(record.i == 2);
+	CHECK(record.ints_count == 1);
+	CHECK(record.ints[0] == 4);
+
+	CHECK(decode_record("{\"k0\":[{\"k6\":{\"k2\":1,\"k6\":{\"k2\":0}}},"
+				"{\"k0\":[{\"k2\":2},{\"k7\":[3]}]}],"
+				"\"k6\":{\"k0\":[{\"k1\":true}],\"k6\":{\"k5\":\"z\"}}}",
+				&record) == JSISH_OK);
+	CHECK(record.list_count == 2);
+	CHECK(record.list[0].object.i == 1);
+	CHECK(record.list[1].list_count == 2);
+	CHECK(record.list[1].list[0].i == 2);
+	CHECK(record.list[1].list[1].ints_count == 1);
+	CHECK(record.list[1].list[1].ints[0] == 3);
+	CHECK(record.object.list_count == 1);
+	CHECK(record.object.list[0].b == 1);
+	CHECK(strcmp(record.object.object.s, "z") == 0);
+	CHECK(decode_record("{\"k6\":{\"k6\":{\"k6\":1}}}", &record) == JSISH_OK);
+	CHECK(decode_record("{\"k6\":{\"k6\":{\"k2\":true}}}", &record)
+			== JSISH_ERR_TYPE);
+}
+
+int main(void) {
+	static const unsigned int flags[] = { 0, JSISH_VALIDATE_UTF8 };
+	static record_t expected;
+	static record_t actual;
+	static record_t again;
+	static jsish_field_t root = JSISH_OBJECT_ELEMENT(record_fields);
+	jsish_decoder_t decoder;
+	jsish_result_t reference;
+	jsish_result_t result;
+	text_t text;
+	char* source;
+	char* reference_source;
+	char* expected_text;
+	char* actual_text;
+	char* again_text;
+	unsigned int i;
+	CHECK(jsish_struct_compile(record_fields, RECORD_FIELDS) == JSISH_OK);
+	check_fields();
+	check_structure();
+
+	text.data = NULL;
+	text.size = 0;
+	for (i = 0; i < DOCUMENTS; ++i) {
+		generate(&text, 3, 6);
+		if (i % 4 == 3) {
+			damage(&text);
+		}
+		source = copy(text.data);
+		reference_source = copy(text.data);
+		jsish_init_decoder(&decoder, values, VALUES_SIZE);
+		decoder.flags = flags[i % 2] | JSISH_INTEGERS | JSISH_UNESCAPE;
+		reference = jsish_decode(&decoder, reference_source);
+
+		memset(&actual, 0, sizeof actual);
+		result = jsish_struct_decode(
+				source, flags[i % 2], record_fields, RECORD_FIELDS, &actual);
+		if (reference != JSISH_OK) {
+			/* Unless a value did not fit before the error was reached, or
+			 * the error is within a member that was skipped. */
+			CHECK(result == reference || result == JSISH_ERR_TYPE
+					|| result == JSISH_ERR_MEM_OVERFLOW || result == JSISH_OK);
+			free(reference_source);
+			free(source);
+			continue;
+		}
+
+		memset(&expected, 0, sizeof expected);
+		CHECK(result == (decoder.root.type == JSISH_KEYVAL
+					? extract(&decoder.root, &root, (char*) &expected)
+					: JSISH_ERR_TYPE));
+		expected_text = encode_record(&expected);
+		actual_text = encode_record(&actual);
+		CHECK(strcmp(expected_text, actual_text) == 0);
+		if (result == JSISH_OK) {
+			memset(&again, 0, sizeof again);
+			CHECK(jsish_struct_decode(actual_text, 0,
+						record_fields, RECORD_FIELDS, &again) == JSISH_OK);
+			again_text = encode_record(&again);
+			CHECK(strcmp(expected_text, again_text) == 0);
+			free(again_text);
+		}
+		free(expected_text);
+		free(actual_text);
+		free(reference_source);
+		free(source);
+	}
+	free(text.data);
+	return 0;
+}
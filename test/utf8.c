@@ -0,0 +1,153 @@
+/* Checks JSISH_VALIDATE_UTF8 against a reference validator following the
+ * table of well-formed byte sequences in the Unicode standard: overlong forms,
+ * surrogates, code points beyond U+10FFFF, stray continuation bytes and
+ * sequences cut short, placed on both sides of vector block boundaries and
+ * right before the closing quotation mark, must be rejected by jsish_decode()
+ * and jsish_measure() alike, in strings and keys, and everything else
+ * accepted. */
+#define JSISH_MAIN
+#include <jsish.h>
+
+#include "check.h"
+
+#define MAX_OFFSET 72
+#define MIXES 20000
+#define VALUES_SIZE 64
+
+static jsish_value_t values[VALUES_SIZE];
+
+static const char* const sequences[] = {
+	/* Well-formed, at the edges of each range. */
+	"\xc2\x80", "\xdf\xbf", "\xe0\xa0\x80", "\xe1\x80\x80", "\xec\xbf\xbf",
+	"\xed\x80\x80", "\xed\x9f\xbf", "\xee\x80\x80", "\xef\xbf\xbf",
+	"\xf0\x90\x80\x80", "\xf1\x80\x80\x80", "\xf3\xbf\xbf\xbf",
+	"\xf4\x80\x80\x80", "\xf4\x8f\xbf\xbf", "caf\xc3\xa9",
+	/* Overlong. */
+	"\xc0\x80", "\xc1\xbf", "\xe0\x80\x80", "\xe0\x9f\xbf",
+	"\xf0\x80\x80\x80", "\xf0\x8f\xbf\xbf",
+	/* Surrogates. */
+	"\xed\xa0\x80", "\xed\xaf\xbf", "\xed\xb0\x80", "\xed\xbf\xbf",
+	/* Beyond U+10FFFF, and bytes that never occur. */
+	"\xf4\x90\x80\x80", "\xf4\xbf\xbf\xbf", "\xf5\x80\x80\x80",
+	"\xf7\xbf\xbf\xbf", "\xf8\x88\x80\x80\x80", "\xfe", "\xff",
+	/* Stray continuation bytes, and sequences cut short or broken off. */
+	"\x80", "\xbf", "\x80\x80", "\xc3", "\xe2\x82", "\xe0\xa0", "\xf0\x9f\x98",
+	"\xf4\x8f\xbf", "\xc3\x41", "\xe2\x28\xa1", "\xe2\x82\x28",
+	"\xf0\x9f\x98\x41", "\xc3\xa9\xa9"
+};
+
+#define SEQUENCES (sizeof sequences / sizeof sequences[0])
+#define WELL_FORMED 15
+
+/* Returns whether the bytes of S are well-formed UTF-8, by the table. */
+static int well_formed(const char* s) {
+	const unsigned char* p;
+	unsigned int length;
+	unsigned int low;
+	unsigned int high;
+	unsigned int i;
+	p = (const unsigned char*) s;
+	while (*p) {
+		low = 0x80;
+		high = 0xbf;
+		if (*p < 0x80) {
+			length = 1;
+		} else if (*p >= 0xc2 && *p <= 0xdf) {
+			length = 2;
+		} else if (*p >= 0xe0 && *p <= 0xef) {
+			length = 3;
+			if (*p == 0xe0) {
+				low = 0xa0;
+			} else if (*p == 0xed) {
+				high = 0x9f;
+			}
+		} else if (*p >= 0xf0 && *p <= 0xf4) {
+			length = 4;
+			if (*p == 0xf0) {
+				low = 0x90;
+			} else if (*p == 0xf4) {
+				high = 0x8f;
+			}
+		} else {
+			return 0;
+		}
+		for (i = 1; i < length; ++i) {
+			if (p[i] < (i == 1 ? low : 0x80) || p[i] > (i == 1 ? high : 0xbf)) {
+				return 0;
+			}
+		}
+		p += length;
+	}
+	return 1;
+}
+
+/* Checks the string S on its own, and as a key, escaped or not. */
+static void check_string(const char* s) {
+	static text_t text;
+	jsish_decoder_t decoder;
+	jsish_result_t expected;
+	unsigned int needed;
+	unsigned int depth;
+	unsigned int i;
+	char* source;
+	expected = well_formed(s) ? JSISH_OK : JSISH_ERR_MALFORMED;
+	for (i = 0; i < 4; ++i) {
+		text.length = 0;
+		append(&text, i % 2 ? "{\"" : "[\"");
+		append(&text, i / 2 ? "\\n" : "");
+		append(&text, s);
+		append(&text, i % 2 ? "\":1}" : "\"]");
+
+		CHECK(jsish_measure(text.data, JSISH_VALIDATE_UTF8, &needed, &depth)
+				== expected);
+		CHECK(jsish_measure(text.data, 0, &needed, &depth) == JSISH_OK);
+		source = copy(text.data);
+		jsish_init_decoder(&decoder, values, VALUES_SIZE);
+		decoder.flags = JSISH_VALIDATE_UTF8 | (i % 2 ? JSISH_UNESCAPE : 0);
+		CHECK(jsish_decode(&decoder, source) == expected);
+		free(source);
+		source = copy(text.data);
+		jsish_init_decoder(&decoder, values, VALUES_SIZE);
+		CHECK(jsish_decode(&decoder, source) == JSISH_OK);
+		free(source);
+	}
+}
+
+int main(void) {
+	static text_t text;
+	unsigned int offset;
+	unsigned int count;
+	unsigned int i;
+	unsigned int j;
+	/* Each sequence after runs of ASCII that end on either side of a block
+	 * boundary, at the end of the string or followed by more. */
+	for (i = 0; i < SEQUENCES; ++i) {
+		for (offset = 0; offset < MAX_OFFSET; ++offset) {
+			for (j = 0; j < 3; ++j) {
+				text.length = 0;
+				append(&text, "");
+				for (count = 0; count < offset; ++count) {
+					append(&text, "a");
+				}
+				append(&text, sequences[i]);
+				append(&text, j == 0 ? "" : j == 1 ? "b" : "\xc3\xa9 and more");
+				check_string(text.data);
+			}
+		}
+	}
+
+	/* Several sequences at once, mostly well-formed. */
+	for (i = 0; i < MIXES; ++i) {
+		text.length = 0;
+		append(&text, "");
+		count = 1 + next_random(8);
+		for (j = 0; j < count; ++j) {
+			append(&text, next_random(3) ? "abcdefgh" + next_random(8) : "");
+			append(&text, sequences[next_random(4)
+					? next_random(WELL_FORMED) : next_random(SEQUENCES)]);
+		}
+		check_string(text.data);
+	}
+	free(text.data);
+	return 0;
+}